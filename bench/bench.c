@@ -0,0 +1,412 @@
+// Micro-benchmarks for the parts of the library that programs call most often.
+//
+// Every benchmark runs in memory: the ones that need a device talk to a
+// simulated jrk (see jrk_simulator_create()), so no hardware is needed.
+//
+// For each benchmark, this program prints the average time per operation and,
+// when it can count them, the average number of heap allocations per
+// operation.  Pass --json to get the results in a machine-readable format that
+// can be saved and compared across versions.
+
+#include <jrk.h>
+#include <config.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+// Counting allocations relies on replacing malloc, which only works reliably
+// with the GNU C library.  On other platforms, the allocation counts are
+// reported as unknown.
+#ifdef __GLIBC__
+#define BENCH_COUNT_ALLOCATIONS 1
+
+extern void * __libc_malloc(size_t);
+extern void * __libc_calloc(size_t, size_t);
+extern void * __libc_realloc(void *, size_t);
+
+static volatile uint64_t allocation_count;
+
+void * malloc(size_t size)
+{
+  allocation_count++;
+  return __libc_malloc(size);
+}
+
+void * calloc(size_t count, size_t size)
+{
+  allocation_count++;
+  return __libc_calloc(count, size);
+}
+
+void * realloc(void * p, size_t size)
+{
+  allocation_count++;
+  return __libc_realloc(p, size);
+}
+#else
+#define BENCH_COUNT_ALLOCATIONS 0
+static uint64_t allocation_count;
+#endif
+
+typedef struct bench_state
+{
+  jrk_simulator * simulator;
+  jrk_handle * handle;
+  jrk_settings * settings;
+  jrk_settings * scratch_settings;
+  jrk_variables * variables;
+  char * settings_string;
+  uint8_t * raw_variables;
+  uint16_t * column;
+} bench_state;
+
+typedef struct bench_result
+{
+  const char * name;
+  uint64_t iterations;
+  double ns_per_op;
+  double allocs_per_op;
+} bench_result;
+
+static void check(jrk_error * error)
+{
+  if (error != NULL)
+  {
+    fprintf(stderr, "Error: %s\n", jrk_error_get_message(error));
+    jrk_error_free(error);
+    exit(1);
+  }
+}
+
+static uint64_t time_ns(void)
+{
+#ifdef _WIN32
+  LARGE_INTEGER frequency, count;
+  QueryPerformanceFrequency(&frequency);
+  QueryPerformanceCounter(&count);
+  return (uint64_t)((double)count.QuadPart * 1e9 / frequency.QuadPart);
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+#endif
+}
+
+// Benchmarks ///////////////////////////////////////////////////////////////////
+
+// Reads and decodes all the variables, which exercises the code that turns a
+// raw variable buffer into a jrk_variables object.
+static void bench_get_variables(bench_state * s)
+{
+  check(jrk_get_variables_into(s->handle, s->variables, 0));
+}
+
+// Reads only the feedback and duty cycle, like a program that plots them.
+static void bench_get_variables_masked(bench_state * s)
+{
+  uint64_t mask = (1ULL << JRK_VAR_FEEDBACK) | (1ULL << JRK_VAR_DUTY_CYCLE);
+  check(jrk_get_variables_masked_into(s->handle, s->variables, mask, 0));
+}
+
+// Reads all the EEPROM settings, which exercises the code that turns a raw
+// settings buffer into a jrk_settings object.
+static void bench_get_eeprom_settings(bench_state * s)
+{
+  jrk_settings * settings;
+  check(jrk_get_eeprom_settings(s->handle, &settings));
+  jrk_settings_free(settings);
+}
+
+// Writes all the RAM settings, which fixes the settings and then exercises the
+// code that turns a jrk_settings object into a raw settings buffer.
+static void bench_set_ram_settings(bench_state * s)
+{
+  check(jrk_set_ram_settings(s->handle, s->settings));
+}
+
+static void bench_settings_to_string(bench_state * s)
+{
+  char * string;
+  check(jrk_settings_to_string(s->settings, &string));
+  jrk_string_free(string);
+}
+
+static void bench_settings_read_from_string(bench_state * s)
+{
+  jrk_settings * settings;
+  check(jrk_settings_read_from_string(s->settings_string, &settings));
+  jrk_settings_free(settings);
+}
+
+static void bench_settings_fix(bench_state * s)
+{
+  jrk_settings_free(s->scratch_settings);
+  s->scratch_settings = NULL;
+  check(jrk_settings_copy(s->settings, &s->scratch_settings));
+  check(jrk_settings_fix(s->scratch_settings, NULL));
+}
+
+// Results of computations that should not be optimized away.
+static volatile uint32_t bench_sink;
+
+static void bench_current_limit_encode(bench_state * s)
+{
+  for (uint32_t ma = 0; ma < 32000; ma += 1000)
+  {
+    bench_sink = jrk_current_limit_encode(s->settings, ma);
+  }
+}
+
+static void bench_diagnose(bench_state * s)
+{
+  char * diagnosis;
+  check(jrk_diagnose(s->settings, s->variables, 0, &diagnosis));
+  jrk_string_free(diagnosis);
+}
+
+// The number of raw variable buffers decoded by the column benchmarks.
+#define BENCH_COLUMN_LENGTH 4096
+
+// Decodes one column from many raw variable buffers, like a program that
+// analyzes a log.
+static void bench_decode_column(bench_state * s)
+{
+  check(jrk_variables_decode_column_uint16(s->raw_variables,
+    JRK_VARIABLES_SIZE, BENCH_COLUMN_LENGTH, JRK_VAR_FEEDBACK, s->column));
+}
+
+typedef struct bench_definition
+{
+  const char * name;
+  void (*function)(bench_state *);
+} bench_definition;
+
+static const bench_definition benchmarks[] =
+{
+  { "get_variables", bench_get_variables },
+  { "get_variables_masked", bench_get_variables_masked },
+  { "get_eeprom_settings", bench_get_eeprom_settings },
+  { "set_ram_settings", bench_set_ram_settings },
+  { "settings_to_string", bench_settings_to_string },
+  { "settings_read_from_string", bench_settings_read_from_string },
+  { "settings_fix", bench_settings_fix },
+  { "current_limit_encode_x32", bench_current_limit_encode },
+  { "diagnose", bench_diagnose },
+  { "decode_column_x4096", bench_decode_column },
+};
+
+// Harness //////////////////////////////////////////////////////////////////////
+
+static void bench_setup(bench_state * s)
+{
+  memset(s, 0, sizeof(*s));
+
+  check(jrk_simulator_create(JRK_PRODUCT_UMC04A_30V, "BENCH", &s->simulator));
+
+  // Don't let time pass, so every run does the same work.
+  jrk_simulator_set_real_time(s->simulator, false);
+
+  jrk_device * device;
+  check(jrk_simulator_get_device(s->simulator, &device));
+  check(jrk_handle_open(device, &s->handle));
+  jrk_device_free(device);
+
+  check(jrk_get_eeprom_settings(s->handle, &s->settings));
+  check(jrk_variables_create(&s->variables));
+  check(jrk_get_variables_into(s->handle, s->variables, 0));
+  check(jrk_settings_to_string(s->settings, &s->settings_string));
+
+  // Make a log of raw variable buffers.
+  s->raw_variables = malloc(BENCH_COLUMN_LENGTH * JRK_VARIABLES_SIZE);
+  s->column = malloc(BENCH_COLUMN_LENGTH * sizeof(uint16_t));
+  if (s->raw_variables == NULL || s->column == NULL)
+  {
+    fprintf(stderr, "Error: Failed to allocate memory.\n");
+    exit(1);
+  }
+  for (size_t i = 0; i < BENCH_COLUMN_LENGTH; i++)
+  {
+    jrk_simulator_advance(s->simulator, 1);
+    check(jrk_get_variable_segment(s->handle, 0, JRK_VARIABLES_SIZE,
+      s->raw_variables + i * JRK_VARIABLES_SIZE, 0));
+  }
+}
+
+static void bench_teardown(bench_state * s)
+{
+  free(s->column);
+  free(s->raw_variables);
+  jrk_string_free(s->settings_string);
+  jrk_variables_free(s->variables);
+  jrk_settings_free(s->scratch_settings);
+  jrk_settings_free(s->settings);
+  jrk_handle_close(s->handle);
+  jrk_simulator_free(s->simulator);
+}
+
+static bench_result bench_run(const bench_definition * def, bench_state * s,
+  double min_time_s)
+{
+  // Warm up and make sure the benchmark works before timing it.
+  def->function(s);
+
+  // Run in batches that double in size until enough time has passed, so
+  // that the cost of reading the clock does not matter.
+  uint64_t min_time_ns = (uint64_t)(min_time_s * 1e9);
+  uint64_t iterations = 0;
+  uint64_t elapsed = 0;
+  uint64_t allocations = 0;
+  uint64_t batch = 1;
+  while (elapsed < min_time_ns)
+  {
+    uint64_t allocation_start = allocation_count;
+    uint64_t start = time_ns();
+    for (uint64_t i = 0; i < batch; i++)
+    {
+      def->function(s);
+    }
+    elapsed += time_ns() - start;
+    allocations += allocation_count - allocation_start;
+    iterations += batch;
+    if (batch < ((uint64_t)1 << 30)) { batch *= 2; }
+  }
+
+  bench_result result;
+  result.name = def->name;
+  result.iterations = iterations;
+  result.ns_per_op = (double)elapsed / iterations;
+  result.allocs_per_op = BENCH_COUNT_ALLOCATIONS ?
+    (double)allocations / iterations : -1;
+  return result;
+}
+
+static void print_results_text(const bench_result * results, size_t count)
+{
+  printf("%-28s %12s %12s %12s\n",
+    "benchmark", "iterations", "ns/op", "allocs/op");
+  for (size_t i = 0; i < count; i++)
+  {
+    const bench_result * r = &results[i];
+    printf("%-28s %12llu %12.1f ", r->name,
+      (unsigned long long)r->iterations, r->ns_per_op);
+    if (r->allocs_per_op < 0)
+    {
+      printf("%12s\n", "?");
+    }
+    else
+    {
+      printf("%12.2f\n", r->allocs_per_op);
+    }
+  }
+}
+
+static void print_results_json(const bench_result * results, size_t count)
+{
+  printf("{\n");
+  printf("  \"version\": \"%s\",\n", SOFTWARE_VERSION_STRING);
+  printf("  \"results\": [\n");
+  for (size_t i = 0; i < count; i++)
+  {
+    const bench_result * r = &results[i];
+    printf("    { \"name\": \"%s\", \"iterations\": %llu, "
+      "\"ns_per_op\": %.1f, \"allocs_per_op\": ", r->name,
+      (unsigned long long)r->iterations, r->ns_per_op);
+    if (r->allocs_per_op < 0)
+    {
+      printf("null");
+    }
+    else
+    {
+      printf("%.2f", r->allocs_per_op);
+    }
+    printf(" }%s\n", i + 1 < count ? "," : "");
+  }
+  printf("  ]\n");
+  printf("}\n");
+}
+
+static void print_usage(void)
+{
+  fprintf(stderr,
+    "Usage: jrk2bench [--json] [--min-time SECONDS] [NAME...]\n"
+    "\n"
+    "Runs the benchmarks whose names contain any of the specified NAMEs, or\n"
+    "all of them if no names are given.\n"
+    "\n"
+    "Benchmarks:\n");
+  for (size_t i = 0; i < sizeof(benchmarks) / sizeof(benchmarks[0]); i++)
+  {
+    fprintf(stderr, "  %s\n", benchmarks[i].name);
+  }
+}
+
+int main(int argc, char ** argv)
+{
+  bool json = false;
+  double min_time_s = 0.5;
+  const char ** filters = calloc(argc, sizeof(const char *));
+  size_t filter_count = 0;
+
+  for (int i = 1; i < argc; i++)
+  {
+    if (strcmp(argv[i], "--json") == 0)
+    {
+      json = true;
+    }
+    else if (strcmp(argv[i], "--min-time") == 0 && i + 1 < argc)
+    {
+      min_time_s = atof(argv[++i]);
+    }
+    else if (argv[i][0] == '-')
+    {
+      print_usage();
+      return 1;
+    }
+    else
+    {
+      filters[filter_count++] = argv[i];
+    }
+  }
+
+  bench_state state;
+  bench_setup(&state);
+
+  size_t benchmark_count = sizeof(benchmarks) / sizeof(benchmarks[0]);
+  bench_result * results = calloc(benchmark_count, sizeof(bench_result));
+  size_t result_count = 0;
+  for (size_t i = 0; i < benchmark_count; i++)
+  {
+    bool selected = filter_count == 0;
+    for (size_t j = 0; j < filter_count; j++)
+    {
+      if (strstr(benchmarks[i].name, filters[j])) { selected = true; }
+    }
+    if (!selected) { continue; }
+
+    results[result_count++] = bench_run(&benchmarks[i], &state, min_time_s);
+  }
+
+  bench_teardown(&state);
+
+  if (json)
+  {
+    print_results_json(results, result_count);
+  }
+  else
+  {
+    print_results_text(results, result_count);
+  }
+
+  free(results);
+  free(filters);
+  return 0;
+}
@@ -12,6 +12,16 @@ static const char help[] =
   "  -l, --list                   List devices connected to computer.\n"
   "  --cmd-port                   Print the name of the command port.\n"
   "  --ttl-port                   Print the name of the TTL port.\n"
+  "  --stream                     Continuously read variables and print them.\n"
+  "  --stream-period MS           Time between samples (default 10, 0 = fast).\n"
+  "  --stream-count NUM           Stop streaming after NUM samples.\n"
+  "  --stream-vars LIST           Comma-separated names of variables to stream.\n"
+  "  --stream-format FORMAT       csv (default) or binary.\n"
+  "  --stream-output FILE         Write streamed data to FILE instead of stdout.\n"
+  "  --daemon                     Keep devices open and serve commands sent with\n"
+  "                               --via-daemon until interrupted.\n"
+  "  --via-daemon                 Send commands through the daemon.\n"
+  "  --socket PATH                Socket for --daemon and --via-daemon.\n"
   "  --pause                      Pause program at the end.\n"
   "  --pause-on-error             Pause program at the end if an error happens.\n"
   "  -h, --help                   Show this help screen.\n"
@@ -55,11 +65,17 @@ static const char help[] =
   "\n"
   "FILE can be \"-\" to specify standard input or output.\n"
   "\n"
+  "The binary stream format starts with the 8 bytes \"JRKSTRM1\" and a byte\n"
+  "holding the number of columns.  Each column is described by a byte holding\n"
+  "the length of its name, the name, a byte holding its size in bytes, and a\n"
+  "byte that is 1 if it is signed.  Each sample is a 64-bit time in\n"
+  "microseconds followed by the columns' values packed together in that order,\n"
+  "all little-endian.  Samples do not have the same layout as the variables in\n"
+  "the device, so use the column descriptions to find each value.\n"
+  "\n"
   "For more help, see: " DOCUMENTATION_URL "\n"
   "\n";
 
-// TODO: add --stream, like the old jrkcmd, for streaming variables
-
 struct arguments
 {
   bool show_status = false;
@@ -75,6 +91,16 @@ struct arguments
 
   bool show_ttl_port = false;
 
+  bool stream = false;
+  ::stream_options stream_options;
+
+  bool run_daemon = false;
+
+  bool via_daemon = false;
+
+  bool socket_path_specified = false;
+  std::string socket_path;
+
   bool pause = false;
 
   bool pause_on_error = false;
@@ -162,6 +188,8 @@ struct arguments
       show_cmd_port ||
       show_ttl_port ||
       show_help ||
+      stream ||
+      run_daemon ||
       set_target ||
       set_target_relative ||
       stop_motor ||
@@ -317,6 +345,56 @@ static arguments parse_args(int argc, char ** argv)
     {
       args.show_ttl_port = true;
     }
+    else if (arg == "--stream")
+    {
+      args.stream = true;
+    }
+    else if (arg == "--stream-period")
+    {
+      args.stream_options.period_ms = parse_arg_int<uint32_t>(arg_reader);
+    }
+    else if (arg == "--stream-count")
+    {
+      args.stream_options.count = parse_arg_int<uint32_t>(arg_reader);
+    }
+    else if (arg == "--stream-vars" || arg == "--stream-variables")
+    {
+      args.stream_options.variables = parse_arg_string(arg_reader);
+    }
+    else if (arg == "--stream-format")
+    {
+      std::string format = parse_arg_string(arg_reader);
+      if (format == "csv")
+      {
+        args.stream_options.binary = false;
+      }
+      else if (format == "binary" || format == "bin")
+      {
+        args.stream_options.binary = true;
+      }
+      else
+      {
+        throw exception_with_exit_code(EXIT_BAD_ARGS,
+          "Unknown stream format: '" + format + "'.");
+      }
+    }
+    else if (arg == "--stream-output")
+    {
+      args.stream_options.filename = parse_arg_string(arg_reader);
+    }
+    else if (arg == "--daemon")
+    {
+      args.run_daemon = true;
+    }
+    else if (arg == "--via-daemon")
+    {
+      args.via_daemon = true;
+    }
+    else if (arg == "--socket")
+    {
+      args.socket_path_specified = true;
+      args.socket_path = parse_arg_string(arg_reader);
+    }
     else if (arg == "--pause")
     {
       args.pause = true;
@@ -493,15 +571,18 @@ static arguments parse_args(int argc, char ** argv)
   return args;
 }
 
-static jrk::handle handle(device_selector & selector)
+// The selector can be a device_selector or a daemon_selector, so the code for
+// each option works the same way with or without --via-daemon.
+template <typename Selector>
+static auto handle(Selector & selector) -> decltype(selector.select_handle())
 {
-  jrk::device device = selector.select_device();
-  return jrk::handle(device);
+  return selector.select_handle();
 }
 
-static void print_list(device_selector & selector)
+template <typename Selector>
+static void print_list(Selector & selector)
 {
-  for (const jrk::device & device : selector.list_devices())
+  for (const auto & device : selector.list_devices())
   {
     std::cout << std::left << std::setfill(' ');
     std::cout << std::setw(17) << device.get_serial_number() + "," << " ";
@@ -510,10 +591,11 @@ static void print_list(device_selector & selector)
   }
 }
 
-static void get_status(device_selector & selector, bool full_output)
+template <typename Selector>
+static void get_status(Selector & selector, bool full_output)
 {
-  jrk::device device = selector.select_device();
-  jrk::handle handle(device);
+  auto & device = selector.select_device();
+  auto & handle = ::handle(selector);
 
   jrk::settings settings = handle.get_ram_settings();
 
@@ -530,7 +612,7 @@ static void get_status(device_selector & selector, bool full_output)
   {
     cmd_port = device.get_cmd_port_name();
   }
-  catch (const jrk::error &)
+  catch (const std::exception &)
   {
     cmd_port = "?";
   }
@@ -540,7 +622,7 @@ static void get_status(device_selector & selector, bool full_output)
   {
     ttl_port = device.get_ttl_port_name();
   }
-  catch (const jrk::error &)
+  catch (const std::exception &)
   {
     ttl_port = "?";
   }
@@ -549,10 +631,11 @@ static void get_status(device_selector & selector, bool full_output)
     firmware_version, cmd_port, ttl_port, full_output);
 }
 
-static void set_target_relative(device_selector & selector,
+template <typename Selector>
+static void set_target_relative(Selector & selector,
   int16_t target_relative)
 {
-  jrk::handle handle = ::handle(selector);
+  auto & handle = ::handle(selector);
   uint8_t buffer[2];
   handle.get_variable_segment(JRK_VAR_TARGET, 2, buffer, 0);
   int32_t target = buffer[0] + 256 * buffer[1];
@@ -564,7 +647,8 @@ static void set_target_relative(device_selector & selector,
   handle.set_target(target);
 }
 
-static void get_eeprom_settings(device_selector & selector,
+template <typename Selector>
+static void get_eeprom_settings(Selector & selector,
   const std::string & filename)
 {
   jrk::settings settings = handle(selector).get_eeprom_settings();
@@ -572,25 +656,29 @@ static void get_eeprom_settings(device_selector & selector,
   write_string_to_file_or_pipe(filename, settings_string);
 }
 
-static void set_eeprom_settings(device_selector & selector,
+template <typename Selector>
+static void set_eeprom_settings(Selector & selector,
   const std::string & filename)
 {
   std::string settings_string = read_string_from_file_or_pipe(filename);
   jrk::settings settings = jrk::settings::read_from_string(settings_string);
 
-  jrk::device device = selector.select_device();
+  auto & device = selector.select_device();
   uint32_t product = device.get_product();
   uint16_t firmware_version = device.get_firmware_version();
   std::string warnings;
   settings.fix_and_change_product(product, firmware_version, &warnings);
   std::cerr << warnings;
 
-  jrk::handle handle(device);
-  handle.set_eeprom_settings(settings);
+  // Only write the bytes that changed to save time and EEPROM wear, and make
+  // sure they were written correctly before using them.
+  auto & handle = ::handle(selector);
+  handle.apply_eeprom_settings(settings);
   handle.reinitialize();
 }
 
-static void get_ram_settings(device_selector & selector,
+template <typename Selector>
+static void get_ram_settings(Selector & selector,
   const std::string & filename)
 {
   jrk::settings settings = handle(selector).get_ram_settings();
@@ -598,27 +686,29 @@ static void get_ram_settings(device_selector & selector,
   write_string_to_file_or_pipe(filename, settings_string);
 }
 
-static void set_ram_settings(device_selector & selector,
+template <typename Selector>
+static void set_ram_settings(Selector & selector,
   const std::string & filename)
 {
   std::string settings_string = read_string_from_file_or_pipe(filename);
   jrk::settings settings = jrk::settings::read_from_string(settings_string);
 
-  jrk::device device = selector.select_device();
+  auto & device = selector.select_device();
   uint32_t product = device.get_product();
   uint16_t firmware_version = device.get_firmware_version();
   std::string warnings;
   settings.fix_and_change_product(product, firmware_version, &warnings);
   std::cerr << warnings;
 
-  jrk::handle handle(device);
+  auto & handle = ::handle(selector);
   handle.set_ram_settings(settings);
 }
 
-static void get_current_limit_table(device_selector & selector)
+template <typename Selector>
+static void get_current_limit_table(Selector & selector)
 {
-  jrk::device device = selector.select_device();
-  jrk::handle handle(device);
+  auto & device = selector.select_device();
+  auto & handle = ::handle(selector);
   jrk::settings settings = handle.get_eeprom_settings();
   std::vector<uint16_t> encoded_limits =
     jrk::get_recommended_encoded_hard_current_limits(device.get_product());
@@ -631,17 +721,19 @@ static void get_current_limit_table(device_selector & selector)
   }
 }
 
-static void current_limit_decode(device_selector & selector, uint16_t encoded_limit)
+template <typename Selector>
+static void current_limit_decode(Selector & selector, uint16_t encoded_limit)
 {
-  jrk::handle handle(selector.select_device());
+  auto & handle = ::handle(selector);
   jrk::settings settings = handle.get_eeprom_settings();
   uint32_t ma = jrk::current_limit_decode(settings, encoded_limit);
   std::cout << ma << std::endl;
 }
 
-static void current_limit_encode(device_selector & selector, uint32_t ma)
+template <typename Selector>
+static void current_limit_encode(Selector & selector, uint32_t ma)
 {
-  jrk::handle handle(selector.select_device());
+  auto & handle = ::handle(selector);
   jrk::settings settings = handle.get_eeprom_settings();
   uint16_t code = jrk::current_limit_encode(settings, ma);
   std::cout << code << std::endl;
@@ -664,10 +756,11 @@ static void fix_settings(const std::string & input_filename,
 // and handle.set_ram_settings(), but this method can be more efficient
 // and demonstrates how to use the lower-level API for overridable settings
 // provided by the jrk API.
-static void override_specific_settings(device_selector & selector,
+template <typename Selector>
+static void override_specific_settings(Selector & selector,
   const arguments & args)
 {
-  jrk::handle handle = jrk::handle(selector.select_device());
+  auto & handle = ::handle(selector);
 
   // Fetch the current calibration constants if we need to convert from
   // milliamps into a current code.
@@ -765,7 +858,8 @@ static void override_specific_settings(device_selector & selector,
   }
 }
 
-static void print_debug_data(device_selector & selector)
+template <typename Selector>
+static void print_debug_data(Selector & selector)
 {
   std::vector<uint8_t> data(4096, 0);
   handle(selector).get_debug_data(data);
@@ -781,15 +875,9 @@ static void print_debug_data(device_selector & selector)
 // A note about ordering: We want to do all the setting stuff first because it
 // could affect subsequent options.  We want to show the status last, because it
 // could be affected by options before it.
-static void run(const arguments & args)
+template <typename Selector>
+static void run_actions(const arguments & args, Selector & selector)
 {
-  if (args.show_help || !args.action_specified())
-  {
-    std::cout << help;
-    return;
-  }
-
-  device_selector selector;
   if (args.serial_number_specified)
   {
     selector.specify_serial_number(args.serial_number);
@@ -924,6 +1012,44 @@ static void run(const arguments & args)
   {
     get_status(selector, args.full_output);
   }
+
+  if (args.stream)
+  {
+    auto & handle = ::handle(selector);
+    stream_variables(handle, args.stream_options);
+  }
+}
+
+// Only called when we use the daemon, since the default path might require
+// creating a directory.
+static std::string socket_path(const arguments & args)
+{
+  if (args.socket_path_specified) { return args.socket_path; }
+  return daemon_default_socket_path();
+}
+
+static void run(const arguments & args)
+{
+  if (args.show_help || !args.action_specified())
+  {
+    std::cout << help;
+    return;
+  }
+
+  if (args.run_daemon)
+  {
+    run_daemon(socket_path(args));
+  }
+  else if (args.via_daemon)
+  {
+    daemon_selector selector(socket_path(args));
+    run_actions(args, selector);
+  }
+  else
+  {
+    device_selector selector;
+    run_actions(args, selector);
+  }
 }
 
 int main(int argc, char ** argv)
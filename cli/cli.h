@@ -7,6 +7,7 @@
 #include "config.h"
 
 #include "arg_reader.h"
+#include "daemon.h"
 #include "device_selector.h"
 #include "exit_codes.h"
 #include "exception_with_exit_code.h"
@@ -30,3 +31,16 @@ void print_status(
   const std::string & cmd_port,
   const std::string & ttl_port,
   bool full_output);
+
+struct stream_options
+{
+  uint32_t period_ms = 10;
+  uint32_t count = 0;
+  std::string variables;
+  bool binary = false;
+  std::string filename = "-";
+};
+
+// Handle can be jrk::handle or daemon_handle.
+template <typename Handle>
+void stream_variables(Handle &, const stream_options &);
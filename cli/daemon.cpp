@@ -0,0 +1,865 @@
+// Code for the --daemon and --via-daemon options.  See daemon.h for a
+// description of the protocol.
+//
+// The daemon handles one request at a time, since they all go to the same USB
+// bus anyway, but any number of clients can be connected at once.  It keeps
+// each jrk open until it is disconnected, so a request usually takes just one
+// or two USB transfers.
+
+#include "cli.h"
+
+#include <csignal>
+#include <cstring>
+#include <map>
+
+#ifndef _WIN32
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+  // The largest request or response we will accept.
+  const uint32_t daemon_max_message_size = 1024 * 1024;
+
+  // How long the daemon waits for a client to finish sending a request, so a
+  // broken client cannot stop it from serving the others.
+  const int daemon_client_timeout_ms = 1000;
+
+  volatile std::sig_atomic_t daemon_stopping = 0;
+
+  // Reads the arguments of a request or the results of a response.
+  class message_reader
+  {
+  public:
+    explicit message_reader(const std::string & message) : message(message)
+    {
+    }
+
+    uint8_t u8()
+    {
+      need(1);
+      return (uint8_t)message[position++];
+    }
+
+    uint16_t u16()
+    {
+      uint16_t value = u8();
+      return value | (uint16_t)(u8() << 8);
+    }
+
+    std::string string()
+    {
+      size_t length = u8();
+      need(length);
+      std::string value = message.substr(position, length);
+      position += length;
+      return value;
+    }
+
+    bool at_end() const
+    {
+      return position == message.size();
+    }
+
+    std::string rest()
+    {
+      std::string value = message.substr(position);
+      position = message.size();
+      return value;
+    }
+
+  private:
+    void need(size_t length)
+    {
+      if (message.size() - position < length)
+      {
+        throw exception_with_exit_code(EXIT_BAD_ARGS,
+          "The daemon received a malformed message.");
+      }
+    }
+
+    const std::string & message;
+    size_t position = 0;
+  };
+
+  void append_u8(std::string & message, uint8_t value)
+  {
+    message.push_back((char)value);
+  }
+
+  void append_u16(std::string & message, uint16_t value)
+  {
+    message.push_back((char)(value & 0xFF));
+    message.push_back((char)(value >> 8 & 0xFF));
+  }
+
+  void append_string(std::string & message, const std::string & value)
+  {
+    append_u8(message, (uint8_t)std::min<size_t>(value.size(), 255));
+    message.append(value, 0, 255);
+  }
+}
+
+static void daemon_handle_signal(int)
+{
+  daemon_stopping = 1;
+}
+
+std::string daemon_default_socket_path()
+{
+#ifdef _WIN32
+  return std::string();
+#else
+  const char * runtime_dir = getenv("XDG_RUNTIME_DIR");
+  if (runtime_dir != NULL && runtime_dir[0] != 0)
+  {
+    return std::string(runtime_dir) + "/" CLI_NAME ".sock";
+  }
+
+  // Without a runtime directory, use a directory in /tmp that only we can
+  // use.  Someone else could have created it first, so check its owner and
+  // permissions before trusting it.
+  std::string dir = "/tmp/" CLI_NAME "-" + std::to_string(getuid());
+  if (mkdir(dir.c_str(), 0700) == -1 && errno != EEXIST)
+  {
+    throw exception_with_exit_code(EXIT_OPERATION_FAILED,
+      "Failed to create '" + dir + "': " + strerror(errno) + ".");
+  }
+  struct stat info;
+  if (lstat(dir.c_str(), &info) == -1 || !S_ISDIR(info.st_mode) ||
+    info.st_uid != getuid() || (info.st_mode & 0077) != 0)
+  {
+    throw exception_with_exit_code(EXIT_OPERATION_FAILED,
+      "'" + dir + "' is not a private directory.  "
+      "Remove it or use the --socket option.");
+  }
+  return dir + "/" CLI_NAME ".sock";
+#endif
+}
+
+#ifdef _WIN32
+
+void run_daemon(const std::string &)
+{
+  throw exception_with_exit_code(EXIT_BAD_ARGS,
+    "The daemon is not supported on Windows.");
+}
+
+daemon_connection::daemon_connection(const std::string &) : fd(-1)
+{
+  throw exception_with_exit_code(EXIT_BAD_ARGS,
+    "The daemon is not supported on Windows.");
+}
+
+daemon_connection::~daemon_connection()
+{
+}
+
+std::string daemon_connection::request(uint8_t, const std::string &,
+  const std::string &)
+{
+  return std::string();
+}
+
+#else
+
+static sockaddr_un daemon_socket_address(const std::string & socket_path)
+{
+  sockaddr_un address;
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (socket_path.size() >= sizeof(address.sun_path))
+  {
+    throw exception_with_exit_code(EXIT_BAD_ARGS,
+      "The socket path is too long: '" + socket_path + "'.");
+  }
+  strcpy(address.sun_path, socket_path.c_str());
+  return address;
+}
+
+static bool write_all(int fd, const std::string & data)
+{
+  size_t written = 0;
+  while (written < data.size())
+  {
+    ssize_t result = write(fd, data.data() + written, data.size() - written);
+    if (result < 0 && errno == EINTR) { continue; }
+    if (result <= 0) { return false; }
+    written += result;
+  }
+  return true;
+}
+
+static bool read_all(int fd, size_t length, std::string & data)
+{
+  data.resize(length);
+  size_t received = 0;
+  while (received < length)
+  {
+    ssize_t result = read(fd, &data[received], length - received);
+    if (result < 0 && errno == EINTR) { continue; }
+    if (result <= 0) { return false; }
+    received += result;
+  }
+  return true;
+}
+
+static bool write_message(int fd, const std::string & message)
+{
+  std::string header;
+  append_u16(header, message.size() & 0xFFFF);
+  append_u16(header, message.size() >> 16 & 0xFFFF);
+  return write_all(fd, header + message);
+}
+
+static bool read_message(int fd, std::string & message)
+{
+  std::string header;
+  if (!read_all(fd, 4, header)) { return false; }
+  message_reader reader(header);
+  uint32_t length = reader.u16();
+  length |= (uint32_t)reader.u16() << 16;
+  if (length > daemon_max_message_size) { return false; }
+  return read_all(fd, length, message);
+}
+
+namespace
+{
+  class daemon_server
+  {
+  public:
+    // Performs a request and returns the response.
+    std::string process(const std::string & request)
+    {
+      std::string response;
+      try
+      {
+        message_reader reader(request);
+        uint8_t command = reader.u8();
+        std::string serial_number = reader.string();
+        append_u8(response, 0);
+        perform(command, serial_number, reader, response);
+      }
+      catch (const exception_with_exit_code & error)
+      {
+        response.clear();
+        append_u8(response, error.get_code());
+        response += error.what();
+      }
+      catch (const std::exception & error)
+      {
+        response.clear();
+        append_u8(response, EXIT_OPERATION_FAILED);
+        response += error.what();
+      }
+      return response;
+    }
+
+  private:
+    struct open_device
+    {
+      jrk::device device;
+      jrk::handle handle;
+    };
+
+    // Returns the open device with the specified serial number (or the only
+    // device if it is empty), opening it if needed.
+    open_device & select(const std::string & serial_number)
+    {
+      if (serial_number.empty())
+      {
+        // The set of connected devices might have changed since the last
+        // request, so check that there is still exactly one.
+        std::vector<jrk::device> list = jrk::list_connected_devices();
+        if (list.size() == 0)
+        {
+          throw exception_with_exit_code(EXIT_DEVICE_NOT_FOUND,
+            "No device was found.");
+        }
+        if (list.size() > 1)
+        {
+          throw exception_with_exit_code(EXIT_DEVICE_MULTIPLE_FOUND,
+            "There are multiple qualifying devices connected to this "
+            "computer.\nUse the -d option to specify which device you want "
+            "to use,\nor disconnect the others.");
+        }
+        open_device * d = find_open(list[0].get_serial_number(),
+          list[0].get_os_id());
+        if (d != NULL) { return *d; }
+        return open(list[0]);
+      }
+
+      open_device * d = find_open(serial_number, "");
+      if (d != NULL) { return *d; }
+
+      jrk::device device = jrk::find_device_by_serial_number(serial_number);
+      if (!device.is_present())
+      {
+        throw exception_with_exit_code(EXIT_DEVICE_NOT_FOUND,
+          "No device was found with serial number '" + serial_number + "'.");
+      }
+      return open(device);
+    }
+
+    // Returns the device we already have open with the specified serial
+    // number, or NULL if there is none.  If the OS ID is not empty, the
+    // device must also have that OS ID.  Forgets devices that were
+    // disconnected, since they might have been reconnected.
+    open_device * find_open(const std::string & serial_number,
+      const std::string & os_id)
+    {
+      auto it = devices.find(serial_number);
+      if (it == devices.end()) { return NULL; }
+      if (it->second.handle.is_alive() &&
+        (os_id.empty() || it->second.device.get_os_id() == os_id))
+      {
+        return &it->second;
+      }
+      devices.erase(it);
+      return NULL;
+    }
+
+    open_device & open(const jrk::device & device)
+    {
+      open_device & d = devices[device.get_serial_number()];
+      d.handle = jrk::handle(device);
+      d.device = device;
+      return d;
+    }
+
+    void perform(uint8_t command, const std::string & serial_number,
+      message_reader & args, std::string & results)
+    {
+      if (command == DAEMON_CMD_LIST)
+      {
+        for (const jrk::device & device : jrk::list_connected_devices())
+        {
+          append_u8(results, device.get_product());
+          append_string(results, device.get_serial_number());
+        }
+        return;
+      }
+
+      open_device & d = select(serial_number);
+      jrk::handle & handle = d.handle;
+
+      switch (command)
+      {
+      case DAEMON_CMD_GET_INFO:
+        {
+          append_u8(results, d.device.get_product());
+          append_u16(results, d.device.get_firmware_version());
+          append_string(results, handle.get_firmware_version_string());
+          append_string(results, d.device.get_serial_number());
+          std::string cmd_port = "?", ttl_port = "?";
+          try { cmd_port = d.device.get_cmd_port_name(); }
+          catch (const jrk::error &) { }
+          try { ttl_port = d.device.get_ttl_port_name(); }
+          catch (const jrk::error &) { }
+          append_string(results, cmd_port);
+          append_string(results, ttl_port);
+          break;
+        }
+
+      case DAEMON_CMD_GET_VARIABLES:
+        {
+          uint8_t offset = args.u8();
+          uint8_t length = args.u8();
+          uint16_t flags = args.u16();
+          uint8_t buffer[256];
+          handle.get_variable_segment(offset, length, buffer, flags);
+          results.append((const char *)buffer, length);
+          break;
+        }
+
+      case DAEMON_CMD_SET_TARGET:
+        handle.set_target(args.u16());
+        break;
+
+      case DAEMON_CMD_STOP_MOTOR:
+        handle.stop_motor();
+        break;
+
+      case DAEMON_CMD_RUN_MOTOR:
+        handle.run_motor();
+        break;
+
+      case DAEMON_CMD_CLEAR_ERRORS:
+        handle.clear_errors();
+        break;
+
+      case DAEMON_CMD_FORCE_DUTY_CYCLE_TARGET:
+        handle.force_duty_cycle_target((int16_t)args.u16());
+        break;
+
+      case DAEMON_CMD_FORCE_DUTY_CYCLE:
+        handle.force_duty_cycle((int16_t)args.u16());
+        break;
+
+      case DAEMON_CMD_GET_SETTINGS:
+        {
+          bool ram = args.u8();
+          jrk::settings settings = ram ? handle.get_ram_settings() :
+            handle.get_eeprom_settings();
+          results += settings.to_string();
+          break;
+        }
+
+      case DAEMON_CMD_SET_SETTINGS:
+        {
+          bool ram = args.u8();
+          jrk::settings settings = jrk::settings::read_from_string(args.rest());
+          if (ram)
+          {
+            handle.set_ram_settings(settings);
+          }
+          else
+          {
+            append_u16(results, handle.apply_eeprom_settings(settings));
+          }
+          break;
+        }
+
+      case DAEMON_CMD_GET_RAM_SETTING_SEGMENT:
+        {
+          uint8_t offset = args.u8();
+          uint8_t length = args.u8();
+          uint8_t buffer[256];
+          handle.get_ram_setting_segment(offset, length, buffer);
+          results.append((const char *)buffer, length);
+          break;
+        }
+
+      case DAEMON_CMD_SET_RAM_SETTING_SEGMENT:
+        {
+          uint8_t offset = args.u8();
+          std::string data = args.rest();
+          handle.set_ram_setting_segment(offset, data.size(),
+            (const uint8_t *)data.data());
+          break;
+        }
+
+      case DAEMON_CMD_REINITIALIZE:
+        handle.reinitialize();
+        break;
+
+      case DAEMON_CMD_RESTORE_DEFAULTS:
+        handle.restore_defaults();
+        break;
+
+      case DAEMON_CMD_GET_DEBUG_DATA:
+        {
+          std::vector<uint8_t> data(4096, 0);
+          handle.get_debug_data(data);
+          results.append(data.begin(), data.end());
+          break;
+        }
+
+      default:
+        throw exception_with_exit_code(EXIT_BAD_ARGS,
+          "The daemon received an unknown command: " +
+          std::to_string(command) + ".");
+      }
+    }
+
+    // The devices we have open, keyed by serial number.
+    std::map<std::string, open_device> devices;
+  };
+}
+
+void run_daemon(const std::string & socket_path)
+{
+  sockaddr_un address = daemon_socket_address(socket_path);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (listen_fd == -1)
+  {
+    throw std::runtime_error(std::string("Failed to create socket: ") +
+      strerror(errno) + ".");
+  }
+
+  // If a socket file is left over from a daemon that did not exit cleanly,
+  // nobody is listening on it, so remove it.  Otherwise, refuse to take over
+  // another daemon's socket.
+  if (connect(listen_fd, (sockaddr *)&address, sizeof(address)) == 0)
+  {
+    close(listen_fd);
+    throw exception_with_exit_code(EXIT_OPERATION_FAILED,
+      "A daemon is already running at '" + socket_path + "'.");
+  }
+  if (errno == ECONNREFUSED) { unlink(socket_path.c_str()); }
+
+  // Only the current user may connect to the socket.
+  mode_t old_umask = umask(0077);
+  int bind_result = bind(listen_fd, (sockaddr *)&address, sizeof(address));
+  umask(old_umask);
+  if (bind_result == -1 || listen(listen_fd, 16) == -1)
+  {
+    std::string message = "Failed to listen on '" + socket_path + "': " +
+      strerror(errno) + ".";
+    close(listen_fd);
+    throw exception_with_exit_code(EXIT_OPERATION_FAILED, message);
+  }
+
+  daemon_stopping = 0;
+  auto old_sigint = std::signal(SIGINT, daemon_handle_signal);
+  auto old_sigterm = std::signal(SIGTERM, daemon_handle_signal);
+  auto old_sigpipe = std::signal(SIGPIPE, SIG_IGN);
+
+  std::cerr << "Listening on " << socket_path << std::endl;
+
+  daemon_server server;
+  std::vector<pollfd> fds(1);
+  fds[0].fd = listen_fd;
+  fds[0].events = POLLIN;
+
+  while (!daemon_stopping)
+  {
+    if (poll(fds.data(), fds.size(), -1) == -1) { continue; }
+
+    for (size_t i = fds.size() - 1; i > 0; i--)
+    {
+      if (fds[i].revents == 0) { continue; }
+
+      std::string request;
+      bool ok = (fds[i].revents & POLLIN) && read_message(fds[i].fd, request);
+      if (ok)
+      {
+        ok = write_message(fds[i].fd, server.process(request));
+      }
+      if (!ok)
+      {
+        // The client disconnected or sent something invalid.
+        close(fds[i].fd);
+        fds.erase(fds.begin() + i);
+      }
+    }
+
+    if (fds[0].revents & POLLIN)
+    {
+      int client_fd = accept(listen_fd, NULL, NULL);
+      if (client_fd != -1)
+      {
+        timeval timeout;
+        timeout.tv_sec = daemon_client_timeout_ms / 1000;
+        timeout.tv_usec = daemon_client_timeout_ms % 1000 * 1000;
+        if (setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO,
+            &timeout, sizeof(timeout)) == -1 ||
+          setsockopt(client_fd, SOL_SOCKET, SO_SNDTIMEO,
+            &timeout, sizeof(timeout)) == -1)
+        {
+          // Without the timeouts, this client could block the daemon.
+          std::cerr << "Failed to set the client timeout: "
+            << strerror(errno) << "." << std::endl;
+          close(client_fd);
+          continue;
+        }
+
+        pollfd client;
+        client.fd = client_fd;
+        client.events = POLLIN;
+        client.revents = 0;
+        fds.push_back(client);
+      }
+    }
+  }
+
+  for (const pollfd & p : fds) { close(p.fd); }
+  unlink(socket_path.c_str());
+
+  std::signal(SIGINT, old_sigint);
+  std::signal(SIGTERM, old_sigterm);
+  std::signal(SIGPIPE, old_sigpipe);
+}
+
+daemon_connection::daemon_connection(const std::string & socket_path)
+{
+  sockaddr_un address = daemon_socket_address(socket_path);
+
+  fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd == -1 || connect(fd, (sockaddr *)&address, sizeof(address)) == -1)
+  {
+    std::string message = "Failed to connect to the daemon at '" +
+      socket_path + "': " + strerror(errno) + ".\n"
+      "Run '" CLI_NAME " --daemon' to start it.";
+    if (fd != -1) { close(fd); }
+    throw exception_with_exit_code(EXIT_OPERATION_FAILED, message);
+  }
+
+  // Report an error instead of getting killed if the daemon exits.
+  std::signal(SIGPIPE, SIG_IGN);
+}
+
+daemon_connection::~daemon_connection()
+{
+  close(fd);
+}
+
+std::string daemon_connection::request(uint8_t command,
+  const std::string & serial_number, const std::string & args)
+{
+  std::string message;
+  append_u8(message, command);
+  append_string(message, serial_number);
+  message += args;
+
+  std::string response;
+  if (!write_message(fd, message) || !read_message(fd, response) ||
+    response.empty())
+  {
+    throw exception_with_exit_code(EXIT_OPERATION_FAILED,
+      "Lost the connection to the daemon.");
+  }
+
+  uint8_t status = response[0];
+  if (status != 0)
+  {
+    throw exception_with_exit_code(status, response.substr(1));
+  }
+  return response.substr(1);
+}
+
+#endif
+
+daemon_handle::daemon_handle(std::shared_ptr<daemon_connection> connection,
+  const std::string & serial_number)
+  : connection(connection), serial_number(serial_number)
+{
+}
+
+std::string daemon_handle::request(uint8_t command, const std::string & args)
+{
+  return connection->request(command, serial_number, args);
+}
+
+void daemon_handle::get_info()
+{
+  if (info_received) { return; }
+  std::string results = request(DAEMON_CMD_GET_INFO);
+  message_reader reader(results);
+  product = reader.u8();
+  firmware_version = reader.u16();
+  firmware_version_string = reader.string();
+  device_serial_number = reader.string();
+  cmd_port = reader.string();
+  ttl_port = reader.string();
+  info_received = true;
+}
+
+uint32_t daemon_handle::get_product()
+{
+  get_info();
+  return product;
+}
+
+uint16_t daemon_handle::get_firmware_version()
+{
+  get_info();
+  return firmware_version;
+}
+
+std::string daemon_handle::get_serial_number()
+{
+  get_info();
+  return device_serial_number;
+}
+
+std::string daemon_handle::get_firmware_version_string()
+{
+  get_info();
+  return firmware_version_string;
+}
+
+std::string daemon_handle::get_cmd_port_name()
+{
+  get_info();
+  if (cmd_port == "?")
+  {
+    throw exception_with_exit_code(EXIT_OPERATION_FAILED,
+      "There was an error getting a serial port name.");
+  }
+  return cmd_port;
+}
+
+std::string daemon_handle::get_ttl_port_name()
+{
+  get_info();
+  if (ttl_port == "?")
+  {
+    throw exception_with_exit_code(EXIT_OPERATION_FAILED,
+      "There was an error getting a serial port name.");
+  }
+  return ttl_port;
+}
+
+void daemon_handle::set_target(uint16_t target)
+{
+  std::string args;
+  append_u16(args, target);
+  request(DAEMON_CMD_SET_TARGET, args);
+}
+
+void daemon_handle::stop_motor()
+{
+  request(DAEMON_CMD_STOP_MOTOR);
+}
+
+void daemon_handle::run_motor()
+{
+  request(DAEMON_CMD_RUN_MOTOR);
+}
+
+void daemon_handle::clear_errors()
+{
+  request(DAEMON_CMD_CLEAR_ERRORS);
+}
+
+void daemon_handle::force_duty_cycle_target(int16_t duty_cycle)
+{
+  std::string args;
+  append_u16(args, (uint16_t)duty_cycle);
+  request(DAEMON_CMD_FORCE_DUTY_CYCLE_TARGET, args);
+}
+
+void daemon_handle::force_duty_cycle(int16_t duty_cycle)
+{
+  std::string args;
+  append_u16(args, (uint16_t)duty_cycle);
+  request(DAEMON_CMD_FORCE_DUTY_CYCLE, args);
+}
+
+void daemon_handle::reinitialize()
+{
+  request(DAEMON_CMD_REINITIALIZE);
+}
+
+void daemon_handle::restore_defaults()
+{
+  request(DAEMON_CMD_RESTORE_DEFAULTS);
+}
+
+jrk::variables daemon_handle::get_variables(uint16_t flags)
+{
+  uint8_t buffer[JRK_VARIABLES_SIZE];
+  get_variable_segment(0, sizeof(buffer), buffer, flags);
+  jrk::variables vars = jrk::variables::create();
+  vars.read_from_buffer(buffer);
+  return vars;
+}
+
+void daemon_handle::get_variable_segment(size_t index, size_t length,
+  uint8_t * output, uint16_t flags)
+{
+  std::string args;
+  append_u8(args, index);
+  append_u8(args, length);
+  append_u16(args, flags);
+  std::string results = request(DAEMON_CMD_GET_VARIABLES, args);
+  if (results.size() != length)
+  {
+    throw exception_with_exit_code(EXIT_OPERATION_FAILED,
+      "The daemon returned the wrong number of bytes.");
+  }
+  memcpy(output, results.data(), length);
+}
+
+jrk::settings daemon_handle::get_eeprom_settings()
+{
+  std::string args;
+  append_u8(args, 0);
+  return jrk::settings::read_from_string(
+    request(DAEMON_CMD_GET_SETTINGS, args));
+}
+
+jrk::settings daemon_handle::get_ram_settings()
+{
+  std::string args;
+  append_u8(args, 1);
+  return jrk::settings::read_from_string(
+    request(DAEMON_CMD_GET_SETTINGS, args));
+}
+
+size_t daemon_handle::apply_eeprom_settings(const jrk::settings & settings)
+{
+  std::string args;
+  append_u8(args, 0);
+  args += settings.to_string();
+  std::string results = request(DAEMON_CMD_SET_SETTINGS, args);
+  message_reader reader(results);
+  return reader.u16();
+}
+
+void daemon_handle::set_ram_settings(const jrk::settings & settings)
+{
+  std::string args;
+  append_u8(args, 1);
+  args += settings.to_string();
+  request(DAEMON_CMD_SET_SETTINGS, args);
+}
+
+void daemon_handle::get_ram_setting_segment(size_t index, size_t length,
+  uint8_t * output)
+{
+  std::string args;
+  append_u8(args, index);
+  append_u8(args, length);
+  std::string results = request(DAEMON_CMD_GET_RAM_SETTING_SEGMENT, args);
+  if (results.size() != length)
+  {
+    throw exception_with_exit_code(EXIT_OPERATION_FAILED,
+      "The daemon returned the wrong number of bytes.");
+  }
+  memcpy(output, results.data(), length);
+}
+
+void daemon_handle::set_ram_setting_segment(size_t index, size_t length,
+  const uint8_t * input)
+{
+  std::string args;
+  append_u8(args, index);
+  args.append((const char *)input, length);
+  request(DAEMON_CMD_SET_RAM_SETTING_SEGMENT, args);
+}
+
+void daemon_handle::get_debug_data(std::vector<uint8_t> & data)
+{
+  std::string results = request(DAEMON_CMD_GET_DEBUG_DATA);
+  data.assign(results.begin(), results.end());
+}
+
+daemon_selector::daemon_selector(const std::string & socket_path)
+  : connection(std::make_shared<daemon_connection>(socket_path)),
+    handle(connection, std::string())
+{
+}
+
+void daemon_selector::specify_serial_number(const std::string & serial_number)
+{
+  this->serial_number = serial_number;
+  handle = daemon_handle(connection, serial_number);
+}
+
+std::vector<daemon_device> daemon_selector::list_devices()
+{
+  std::vector<daemon_device> list;
+  std::string results = connection->request(DAEMON_CMD_LIST, std::string());
+  message_reader reader(results);
+  while (!reader.at_end())
+  {
+    daemon_device device;
+    device.product = reader.u8();
+    device.serial_number = reader.string();
+    if (!serial_number.empty() && device.serial_number != serial_number)
+    {
+      continue;
+    }
+    list.push_back(device);
+  }
+  return list;
+}
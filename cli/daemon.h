@@ -0,0 +1,156 @@
+// Code for the --daemon option, which keeps the jrks open and performs
+// commands that other jrk2cmd processes send to it over a Unix domain socket,
+// and for the --via-daemon option, which sends commands to the daemon instead
+// of opening the device directly.
+//
+// Each request and each response is a 32-bit little-endian length followed by
+// that many bytes.  A request's bytes are the command (one of the
+// daemon_command values), a byte holding the length of the serial number, the
+// serial number (empty to use the only jrk that is connected), and the
+// command's arguments.  A response's bytes are a status, which is 0 for
+// success or one of the exit codes in exit_codes.h, followed by the command's
+// results or by an error message.  Numbers in arguments and results are
+// little-endian, strings in results are preceded by their length as a byte,
+// and a settings file is just the rest of the message.
+
+#pragma once
+
+#include "exception_with_exit_code.h"
+#include <jrk.hpp>
+#include <memory>
+#include <string>
+#include <vector>
+
+enum daemon_command
+{
+  DAEMON_CMD_LIST = 1,  // Result: product (1) and serial number for each jrk
+  DAEMON_CMD_GET_INFO = 2,  // Result: product (1), firmware version (2),
+    // firmware version string, serial number, command port, TTL port
+  DAEMON_CMD_GET_VARIABLES = 3,  // Args: offset (1), length (1), flags (2)
+  DAEMON_CMD_SET_TARGET = 4,  // Args: target (2)
+  DAEMON_CMD_STOP_MOTOR = 5,
+  DAEMON_CMD_RUN_MOTOR = 6,
+  DAEMON_CMD_CLEAR_ERRORS = 7,
+  DAEMON_CMD_FORCE_DUTY_CYCLE_TARGET = 8,  // Args: duty cycle (2)
+  DAEMON_CMD_FORCE_DUTY_CYCLE = 9,  // Args: duty cycle (2)
+  DAEMON_CMD_GET_SETTINGS = 10,  // Args: RAM (1); Result: settings file
+  DAEMON_CMD_SET_SETTINGS = 11,  // Args: RAM (1), settings file;
+    // Result: bytes written (2) if RAM is 0
+  DAEMON_CMD_GET_RAM_SETTING_SEGMENT = 12,  // Args: offset (1), length (1)
+  DAEMON_CMD_SET_RAM_SETTING_SEGMENT = 13,  // Args: offset (1), data
+  DAEMON_CMD_REINITIALIZE = 14,
+  DAEMON_CMD_RESTORE_DEFAULTS = 15,
+  DAEMON_CMD_GET_DEBUG_DATA = 16,
+};
+
+// Returns the socket path to use if the user does not specify one.  It is in
+// $XDG_RUNTIME_DIR if that is set, or else in a directory in /tmp that only
+// the current user can access, which this function creates if needed.
+std::string daemon_default_socket_path();
+
+// Runs the daemon until it gets SIGINT or SIGTERM.
+void run_daemon(const std::string & socket_path);
+
+// A connection to the daemon.
+class daemon_connection
+{
+public:
+  explicit daemon_connection(const std::string & socket_path);
+  ~daemon_connection();
+
+  daemon_connection(const daemon_connection &) = delete;
+  daemon_connection & operator=(const daemon_connection &) = delete;
+
+  // Sends a request and returns the results from the response.  Throws an
+  // exception_with_exit_code if the daemon reports an error.
+  std::string request(uint8_t command, const std::string & serial_number,
+    const std::string & args = std::string());
+
+private:
+  int fd;
+};
+
+// Represents a jrk that we talk to through the daemon.  It has the same
+// functions as jrk::device and jrk::handle that the rest of jrk2cmd uses, so
+// the code for each option works with either one.
+class daemon_handle
+{
+public:
+  daemon_handle(std::shared_ptr<daemon_connection> connection,
+    const std::string & serial_number);
+
+  uint32_t get_product();
+  uint16_t get_firmware_version();
+  std::string get_serial_number();
+  std::string get_firmware_version_string();
+  std::string get_cmd_port_name();
+  std::string get_ttl_port_name();
+
+  void set_target(uint16_t target);
+  void stop_motor();
+  void run_motor();
+  void clear_errors();
+  void force_duty_cycle_target(int16_t duty_cycle);
+  void force_duty_cycle(int16_t duty_cycle);
+  void reinitialize();
+  void restore_defaults();
+
+  jrk::variables get_variables(uint16_t flags);
+  void get_variable_segment(size_t index, size_t length,
+    uint8_t * output, uint16_t flags);
+
+  jrk::settings get_eeprom_settings();
+  jrk::settings get_ram_settings();
+  size_t apply_eeprom_settings(const jrk::settings & settings);
+  void set_ram_settings(const jrk::settings & settings);
+  void get_ram_setting_segment(size_t index, size_t length, uint8_t * output);
+  void set_ram_setting_segment(size_t index, size_t length,
+    const uint8_t * input);
+
+  void get_debug_data(std::vector<uint8_t> & data);
+
+private:
+  std::string request(uint8_t command,
+    const std::string & args = std::string());
+  void get_info();
+
+  std::shared_ptr<daemon_connection> connection;
+  std::string serial_number;
+
+  // Filled in by get_info() the first time they are needed.
+  bool info_received = false;
+  uint8_t product = 0;
+  uint16_t firmware_version = 0;
+  std::string firmware_version_string;
+  std::string device_serial_number;
+  std::string cmd_port;
+  std::string ttl_port;
+};
+
+// A jrk in the list returned by daemon_selector::list_devices().
+struct daemon_device
+{
+  uint8_t product;
+  std::string serial_number;
+
+  uint8_t get_product() const { return product; }
+  std::string get_serial_number() const { return serial_number; }
+};
+
+// The equivalent of device_selector for --via-daemon.  The daemon chooses the
+// device, so this only remembers the serial number.
+class daemon_selector
+{
+public:
+  explicit daemon_selector(const std::string & socket_path);
+
+  void specify_serial_number(const std::string & serial_number);
+  std::vector<daemon_device> list_devices();
+  daemon_handle & select_device() { return handle; }
+  daemon_handle & select_handle() { return handle; }
+
+private:
+  std::shared_ptr<daemon_connection> connection;
+  std::string serial_number;
+  daemon_handle handle;
+};
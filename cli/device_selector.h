@@ -33,10 +33,22 @@ public:
     return list;
   }
 
-  jrk::device select_device()
+  jrk::device & select_device()
   {
     if (device.is_present()) { return device; }
 
+    if (serial_number_specified && !list_initialized)
+    {
+      // Stop at the first jrk with the right serial number instead of
+      // listing all of them.
+      device = jrk::find_device_by_serial_number(serial_number);
+      if (!device.is_present())
+      {
+        throw device_not_found_error();
+      }
+      return device;
+    }
+
     auto list = list_devices();
     if (list.size() == 0)
     {
@@ -52,6 +64,19 @@ public:
     return device;
   }
 
+  // Returns a handle to the selected device.  The handle is opened the first
+  // time this is called and shared by every later action, so its settings
+  // cache saves us from reading the settings more than once.
+  jrk::handle & select_handle()
+  {
+    if (!handle.is_present())
+    {
+      handle = jrk::handle(select_device());
+      handle.set_settings_cache_enabled(true);
+    }
+    return handle;
+  }
+
 private:
 
   std::string device_not_found_message() const
@@ -89,4 +114,5 @@ private:
   std::vector<jrk::device> list;
 
   jrk::device device;
+  jrk::handle handle;
 };
@@ -0,0 +1,304 @@
+// Code for the --stream option, which repeatedly reads variables from the
+// device and writes them to a file or the standard output.
+//
+// In CSV format, the first line names the columns and each following line is
+// one sample.  The first column is the time in microseconds since streaming
+// started, measured on the computer.
+//
+// In binary format, the output starts with the 8 bytes "JRKSTRM1", a byte
+// holding the number of variable columns, and then for each column: a byte
+// holding the length of its name, the name, a byte holding the size of the
+// variable in bytes, and a byte that is 1 if the variable is signed.  Each
+// sample after that is a 64-bit microsecond timestamp followed by the raw bytes
+// of each variable, all in little-endian byte order, just as they are sent by
+// the device.  The variables are packed together in column order, so a sample
+// does not have the same layout as the device's variables.  The force_mode
+// column is one byte holding just the force mode bits of the flag byte.
+
+#include "cli.h"
+
+#include <jrk_schedule.hpp>
+
+#include <csignal>
+
+namespace
+{
+  struct stream_column
+  {
+    const char * name;
+    uint8_t offset;
+    uint8_t size;
+    bool is_signed;
+  };
+
+  const stream_column stream_columns[] = {
+    { "input", JRK_VAR_INPUT, 2, false },
+    { "target", JRK_VAR_TARGET, 2, false },
+    { "feedback", JRK_VAR_FEEDBACK, 2, false },
+    { "scaled_feedback", JRK_VAR_SCALED_FEEDBACK, 2, false },
+    { "integral", JRK_VAR_INTEGRAL, 2, true },
+    { "duty_cycle_target", JRK_VAR_DUTY_CYCLE_TARGET, 2, true },
+    { "duty_cycle", JRK_VAR_DUTY_CYCLE, 2, true },
+    { "current_low_res", JRK_VAR_CURRENT_LOW_RES, 1, false },
+    { "pid_period_exceeded", JRK_VAR_PID_PERIOD_EXCEEDED, 1, false },
+    { "pid_period_count", JRK_VAR_PID_PERIOD_COUNT, 2, false },
+    { "error_flags_halting", JRK_VAR_ERROR_FLAGS_HALTING, 2, false },
+    { "error_flags_occurred", JRK_VAR_ERROR_FLAGS_OCCURRED, 2, false },
+    { "force_mode", JRK_VAR_FLAG_BYTE1, 1, false },
+    { "vin_voltage", JRK_VAR_VIN_VOLTAGE, 2, false },
+    { "current", JRK_VAR_CURRENT, 2, false },
+    { "device_reset", JRK_VAR_DEVICE_RESET, 1, false },
+    { "up_time", JRK_VAR_UP_TIME, 4, false },
+    { "rc_pulse_width", JRK_VAR_RC_PULSE_WIDTH, 2, false },
+    { "fbt_reading", JRK_VAR_FBT_READING, 2, false },
+    { "analog_reading_sda", JRK_VAR_ANALOG_READING_SDA, 2, false },
+    { "analog_reading_fba", JRK_VAR_ANALOG_READING_FBA, 2, false },
+    { "digital_readings", JRK_VAR_DIGITAL_READINGS, 1, false },
+    { "raw_current", JRK_VAR_RAW_CURRENT, 2, false },
+    { "encoded_hard_current_limit", JRK_VAR_ENCODED_HARD_CURRENT_LIMIT, 2, false },
+    { "last_duty_cycle", JRK_VAR_LAST_DUTY_CYCLE, 2, true },
+    { "current_chopping_consecutive_count",
+      JRK_VAR_CURRENT_CHOPPING_CONSECUTIVE_COUNT, 1, false },
+    { "current_chopping_occurrence_count",
+      JRK_VAR_CURRENT_CHOPPING_OCCURRENCE_COUNT, 1, false },
+  };
+
+  // Flush the output when this much data is buffered.
+  const size_t stream_buffer_size = 64 * 1024;
+
+  // Also flush the output at least this often so slow streams can be watched
+  // live.
+  const std::chrono::milliseconds stream_flush_interval(250);
+
+  volatile std::sig_atomic_t stream_interrupted = 0;
+}
+
+static void stream_handle_sigint(int)
+{
+  stream_interrupted = 1;
+}
+
+static std::vector<const stream_column *> parse_stream_columns(
+  const std::string & list)
+{
+  std::vector<const stream_column *> columns;
+
+  if (list.empty())
+  {
+    for (const stream_column & column : stream_columns)
+    {
+      columns.push_back(&column);
+    }
+    return columns;
+  }
+
+  std::istringstream stream(list);
+  std::string name;
+  while (std::getline(stream, name, ','))
+  {
+    const stream_column * found = NULL;
+    for (const stream_column & column : stream_columns)
+    {
+      if (name == column.name) { found = &column; }
+    }
+    if (found == NULL)
+    {
+      std::string message = "Unknown variable name: '" + name + "'.  "
+        "Valid names are:";
+      for (const stream_column & column : stream_columns)
+      {
+        message += std::string(" ") + column.name;
+      }
+      throw exception_with_exit_code(EXIT_BAD_ARGS, message);
+    }
+    columns.push_back(found);
+  }
+  return columns;
+}
+
+static void append_le(std::string & buffer, uint64_t value, size_t size)
+{
+  for (size_t i = 0; i < size; i++)
+  {
+    buffer.push_back((char)(value >> (8 * i) & 0xFF));
+  }
+}
+
+// The force mode is in the lowest two bits of the flag byte, which is the
+// only variable that does not use a whole byte.
+static uint8_t column_force_mode(const uint8_t * vars)
+{
+  return vars[JRK_VAR_FLAG_BYTE1] & 3;
+}
+
+static void append_header(std::string & buffer,
+  const std::vector<const stream_column *> & columns, bool binary)
+{
+  if (binary)
+  {
+    buffer += "JRKSTRM1";
+    buffer.push_back((char)columns.size());
+    for (const stream_column * column : columns)
+    {
+      buffer.push_back((char)strlen(column->name));
+      buffer += column->name;
+      buffer.push_back((char)column->size);
+      buffer.push_back((char)column->is_signed);
+    }
+  }
+  else
+  {
+    buffer += "time_us";
+    for (const stream_column * column : columns)
+    {
+      buffer += ',';
+      buffer += column->name;
+    }
+    buffer += '\n';
+  }
+}
+
+static void append_row(std::string & buffer,
+  const std::vector<const stream_column *> & columns, bool binary,
+  uint64_t time_us, const uint8_t * vars)
+{
+  if (binary)
+  {
+    append_le(buffer, time_us, 8);
+    for (const stream_column * column : columns)
+    {
+      if (column->offset == JRK_VAR_FLAG_BYTE1)
+      {
+        buffer.push_back((char)column_force_mode(vars));
+      }
+      else
+      {
+        buffer.append((const char *)vars + column->offset, column->size);
+      }
+    }
+    return;
+  }
+
+  buffer += std::to_string(time_us);
+  for (const stream_column * column : columns)
+  {
+    const uint8_t * p = vars + column->offset;
+    uint32_t value = 0;
+    for (size_t i = 0; i < column->size; i++)
+    {
+      value |= (uint32_t)p[i] << (8 * i);
+    }
+    if (column->offset == JRK_VAR_FLAG_BYTE1)
+    {
+      value = column_force_mode(vars);
+    }
+
+    buffer += ',';
+    if (column->is_signed && column->size == 2)
+    {
+      buffer += std::to_string((int16_t)value);
+    }
+    else
+    {
+      buffer += std::to_string(value);
+    }
+  }
+  buffer += '\n';
+}
+
+template <typename Handle>
+void stream_variables(Handle & handle, const stream_options & options)
+{
+  std::vector<const stream_column *> columns =
+    parse_stream_columns(options.variables);
+
+  // Read the smallest segment of the variables that has every column.
+  size_t segment_start = JRK_VARIABLES_SIZE;
+  size_t segment_end = 0;
+  for (const stream_column * column : columns)
+  {
+    segment_start = std::min<size_t>(segment_start, column->offset);
+    segment_end = std::max<size_t>(segment_end, column->offset + column->size);
+  }
+  uint8_t vars[JRK_VARIABLES_SIZE] = { 0 };
+
+  auto output = open_file_or_pipe_output(options.filename);
+
+  std::string buffer;
+  buffer.reserve(stream_buffer_size + 1024);
+  append_header(buffer, columns, options.binary);
+
+  auto flush = [&]()
+  {
+    output->write(buffer.data(), buffer.size());
+    output->flush();
+    if (output->fail())
+    {
+      throw std::runtime_error("Failed to write to file or pipe.");
+    }
+    buffer.clear();
+  };
+
+  stream_interrupted = 0;
+  auto old_handler = std::signal(SIGINT, stream_handle_sigint);
+
+  typedef std::chrono::steady_clock clock;
+  const clock::time_point start = clock::now();
+  jrk::periodic_schedule schedule(
+    std::chrono::milliseconds(options.period_ms), start);
+  clock::time_point last_flush = start;
+  uint64_t sample_count = 0;
+  uint64_t missed_deadlines = 0;
+
+  try
+  {
+    while (!stream_interrupted &&
+      (options.count == 0 || sample_count < options.count))
+    {
+      handle.get_variable_segment(segment_start, segment_end - segment_start,
+        vars + segment_start, 0);
+
+      clock::time_point now = clock::now();
+      uint64_t time_us = std::chrono::duration_cast<std::chrono::microseconds>(
+        now - start).count();
+      append_row(buffer, columns, options.binary, time_us, vars);
+      sample_count++;
+
+      if (buffer.size() >= stream_buffer_size ||
+        now - last_flush >= stream_flush_interval)
+      {
+        flush();
+        last_flush = now;
+      }
+
+      if (options.period_ms == 0) { continue; }
+
+      missed_deadlines += schedule.advance();
+      std::this_thread::sleep_until(schedule.get_deadline());
+    }
+  }
+  catch (...)
+  {
+    std::signal(SIGINT, old_handler);
+
+    // Save the samples we have, but report the original error even if that
+    // fails.
+    try
+    {
+      flush();
+    }
+    catch (...)
+    {
+    }
+    throw;
+  }
+
+  std::signal(SIGINT, old_handler);
+  flush();
+
+  std::cerr << "Samples: " << sample_count
+    << ", missed deadlines: " << missed_deadlines << std::endl;
+}
+
+template void stream_variables(jrk::handle &, const stream_options &);
+template void stream_variables(daemon_handle &, const stream_options &);
@@ -7,11 +7,15 @@
 #include <cmath>
 #include <sstream>
 
-// This is how often we fetch the variables from the device.
+// This is how often we update the window with new data from the device.  The
+// variables are sampled at the rate chosen in the graph window, which can be
+// much faster.
 static const uint32_t UPDATE_INTERVAL_MS = 50;
 
-// Only update the device list once per second to save CPU time.
-static const uint32_t UPDATE_DEVICE_LIST_DIVIDER = 20;
+main_controller::~main_controller()
+{
+  worker.stop();
+}
 
 void main_controller::set_window(main_window * window)
 {
@@ -22,6 +26,54 @@ void main_controller::start()
 {
   assert(!connected());
 
+  // Results from the device worker are delivered to the UI thread through
+  // queued connections.  The window is the context object, so nothing is
+  // delivered after the window is destroyed.
+  QObject::connect(&worker, &device_worker::device_list_changed, window,
+    [this](std::vector<jrk::device> list) { handle_device_list_changed(list); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::device_list_failed, window,
+    [this](QString message) { handle_device_list_failed(message.toStdString()); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::connected, window,
+    [this](device_connection_info info) { handle_connected(info); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::connect_failed, window,
+    [this](QString os_id, QString message)
+    {
+      handle_connect_failed(os_id.toStdString(), message.toStdString());
+    },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::connection_lost, window,
+    [this]() { handle_connection_lost(); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::variables_read, window,
+    [this](const std::vector<uint8_t> & samples) { handle_variables_read(samples); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::variables_read_failed, window,
+    [this]() { handle_variables_read_failed(); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::settings_read, window,
+    [this](jrk::settings s) { handle_settings_read(s); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::settings_read_failed, window,
+    [this](QString message) { handle_settings_read_failed(message.toStdString()); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::settings_applied, window,
+    [this](jrk::settings s) { handle_settings_applied(s); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::defaults_restored, window,
+    [this]() { handle_defaults_restored(); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::errors_cleared, window,
+    [this](uint16_t flags) { handle_errors_cleared(flags); },
+    Qt::QueuedConnection);
+  QObject::connect(&worker, &device_worker::command_failed, window,
+    [this](QString message) { window->show_error_message(message.toStdString()); },
+    Qt::QueuedConnection);
+
+  worker.start(UPDATE_INTERVAL_MS);
+
   // Start the update timer so that update() will be called regularly.
   window->set_update_timer_interval(UPDATE_INTERVAL_MS);
   window->start_update_timer();
@@ -64,7 +116,16 @@ void main_controller::connect_device_with_os_id(const std::string & id)
 
 bool main_controller::disconnect_device()
 {
-  if (!connected()) { return true; }
+  if (!connected())
+  {
+    // Cancel the connection the worker is making, if any.
+    if (!connecting_os_id.empty())
+    {
+      connecting_os_id.clear();
+      worker.request_disconnect();
+    }
+    return true;
+  }
 
   if (settings_modified)
   {
@@ -89,24 +150,28 @@ void main_controller::connect_device(const jrk::device & device)
 {
   assert(device.is_present());
 
-  try
-  {
-    // Close the old handle in case one is already open.
-    device_handle.close();
+  connection_error = false;
+  disconnected_by_user = false;
 
-    connection_error = false;
-    disconnected_by_user = false;
+  // The worker opens a handle to the device, gets the port names and
+  // settings, and then reports back to handle_connected().
+  connecting_os_id = device.get_os_id();
+  worker.request_connect(device);
+}
 
-    // Open a handle to the specified device.
-    device_handle = jrk::handle(device);
-  }
-  catch (const std::exception & e)
+void main_controller::handle_connected(const device_connection_info & info)
+{
+  // Ignore the results of a connection that was canceled.
+  if (connecting_os_id.empty() || info.device.get_os_id() != connecting_os_id)
   {
-    set_connection_error("Failed to connect to device.");
-    show_exception(e, "There was an error connecting to the device.");
-    handle_model_changed();
     return;
   }
+  connecting_os_id.clear();
+
+  connected_device = info.device;
+  firmware_version_string = info.firmware_version_string;
+  cmd_port = info.cmd_port;
+  ttl_port = info.ttl_port;
 
   // Clear the variables read from the device because they don't apply anymore.
   variables.pointer_reset();
@@ -120,41 +185,35 @@ void main_controller::connect_device(const jrk::device & device)
 
   window->reset_error_counts();
 
-  // Get the command port name.
-  try
-  {
-    cmd_port = device.get_cmd_port_name();
-  }
-  catch (const jrk::error &)
+  if (info.settings.is_present())
   {
-    cmd_port = "?";
-  }
-
-  // Get the TTL port name.
-  try
-  {
-    ttl_port = device.get_ttl_port_name();
-  }
-  catch (const jrk::error &)
-  {
-    ttl_port = "?";
-  }
-
-  // Load the settings from the device.
-  try
-  {
-    settings = device_handle.get_eeprom_settings();
+    settings = info.settings;
     recalculate_motor_asymmetric();
     handle_settings_loaded();
   }
-  catch (const std::exception & e)
+  else
   {
-    show_exception(e, "There was an error loading settings from the device.");
+    window->show_error_message(
+      "There was an error loading settings from the device.  " +
+      info.settings_error);
   }
 
   handle_model_changed();
 }
 
+void main_controller::handle_connect_failed(const std::string & os_id,
+  const std::string & message)
+{
+  // Ignore the failure of a connection that was canceled.
+  if (connecting_os_id.empty() || os_id != connecting_os_id) { return; }
+  connecting_os_id.clear();
+
+  set_connection_error("Failed to connect to device.");
+  window->show_error_message(
+    "There was an error connecting to the device.  " + message);
+  handle_model_changed();
+}
+
 void main_controller::disconnect_device_by_error(const std::string & error_message)
 {
   really_disconnect();
@@ -164,7 +223,8 @@ void main_controller::disconnect_device_by_error(const std::string & error_messa
 
 void main_controller::really_disconnect()
 {
-  device_handle.close();
+  worker.request_disconnect();
+  connected_device = jrk::device();
   settings_modified = false;
 }
 
@@ -185,16 +245,23 @@ void main_controller::reload_settings(bool ask)
     return;
   }
 
-  try
-  {
-    settings = device_handle.get_eeprom_settings();
-    handle_settings_loaded();
-  }
-  catch (const std::exception & e)
-  {
-    settings_modified = true;
-    show_exception(e, "There was an error loading the settings from the device.");
-  }
+  worker.request_reload_settings();
+}
+
+void main_controller::handle_settings_read(const jrk::settings & new_settings)
+{
+  if (!connected()) { return; }
+  settings = new_settings;
+  handle_settings_loaded();
+  handle_settings_changed();
+}
+
+void main_controller::handle_settings_read_failed(const std::string & message)
+{
+  if (!connected()) { return; }
+  settings_modified = true;
+  window->show_error_message(
+    "There was an error loading the settings from the device.  " + message);
   handle_settings_changed();
 }
 
@@ -211,25 +278,15 @@ void main_controller::restore_default_settings()
     return;
   }
 
-  bool restore_success = false;
-  try
-  {
-    device_handle.restore_defaults();
-    restore_success = true;
-  }
-  catch (std::exception const & e)
-  {
-    show_exception(e);
-  }
-
-  // This takes care of reloading the settings and telling the view to update.
-  reload_settings(false);
+  // The worker reloads the settings afterwards, so handle_settings_read()
+  // takes care of telling the view to update.
+  worker.request_restore_defaults();
+}
 
-  if (restore_success)
-  {
-    window->show_info_message(
-      "Your device's settings have been reset to their default values.");
-  }
+void main_controller::handle_defaults_restored()
+{
+  window->show_info_message(
+    "Your device's settings have been reset to their default values.");
 }
 
 void main_controller::upgrade_firmware()
@@ -246,14 +303,10 @@ void main_controller::upgrade_firmware()
       return;
     }
 
-    try
+    worker.request_command([](jrk::handle & handle)
     {
-      device_handle.start_bootloader();
-    }
-    catch (const std::exception & e)
-    {
-      show_exception(e);
-    }
+      handle.start_bootloader();
+    });
 
     really_disconnect();
     disconnected_by_user = true;
@@ -271,99 +324,115 @@ void main_controller::upgrade_firmware_complete()
   disconnected_by_user = false;
 }
 
-// Returns true if the device list includes the specified device.
-static bool device_list_includes(
-  const std::vector<jrk::device> & device_list,
-  const jrk::device & device)
-{
-  return device_with_os_id(device_list, device.get_os_id()).is_present();
-}
-
 void main_controller::update()
 {
-  // This is called regularly by the view when it is time to check for
-  // updates to the state of USB devices.  This runs on the same thread as
-  // everything else, so we should be careful not to do anything too slow
-  // here.  If the user tries to use the UI at all while this function is
-  // running, the UI cannot respond until this function returns.
+  // This is called regularly by the view.  The device worker does all the
+  // USB I/O on its own thread and reports the results through queued
+  // signals, so all that is left to do here is consider auto-connecting to a
+  // device.
 
-  bool successfully_updated_list = false;
-  if (--update_device_list_counter == 0)
+  if (connected() || !connecting_os_id.empty())
   {
-    update_device_list_counter = UPDATE_DEVICE_LIST_DIVIDER;
-
-    successfully_updated_list = update_device_list();
-    if (successfully_updated_list && device_list_changed)
-    {
-      window->set_device_list_contents(device_list);
-      if (connected())
-      {
-        window->set_device_list_selected(device_handle.get_device());
-      }
-      else
-      {
-        window->set_device_list_selected(jrk::device()); // show "Not connected"
-      }
-    }
+    // We are connected or about to be.
+  }
+  else if (connection_error)
+  {
+    // There is an error related to a previous connection or connection
+    // attempt, so don't automatically reconnect.  That would be
+    // confusing, because the user might be looking away and not notice
+    // that the connection was lost and then regained, or they could be
+    // trying to read the error message.
   }
+  else if (disconnected_by_user)
+  {
+    // The user explicitly disconnected the last connection, so don't
+    // automatically reconnect.
+  }
+  else if (device_list.size() == 1)
+  {
+    // Automatically connect if there is only one device and we were not
+    // recently disconnected from a device.
+    connect_device(device_list.at(0));
+  }
+}
 
+void main_controller::handle_device_list_changed(
+  const std::vector<jrk::device> & list)
+{
+  device_list = list;
+  window->set_device_list_contents(device_list);
   if (connected())
   {
-    // First, see if the device we are connected to is still available.
-    // Note: It would be nice if the libusbp::generic_handle class had a
-    // function that tests if the actual handle we are using is still valid.
-    // This would be better for tricky cases like if someone unplugs and
-    // plugs the same device in very fast.
-    bool device_still_present = device_list_includes(
-      device_list, device_handle.get_device());
-
-    if (device_still_present)
-    {
-      // Reload the variables from the device.
-      try
-      {
-        reload_variables();
-      }
-      catch (const std::exception & e)
-      {
-        // Ignore the exception.  The model provides other ways to tell that
-        // the variable update failed, and the exact message is probably
-        // not that useful since it is probably just a generic problem with
-        // the USB connection.
-      }
-      handle_variables_changed();
-    }
-    else
-    {
-      // The device is gone.
-      disconnect_device_by_error("The connection to the device was lost.");
-      handle_model_changed();
-    }
+    window->set_device_list_selected(connected_device);
   }
   else
   {
-    // We are not connected, so consider auto-connecting to a device.
+    window->set_device_list_selected(jrk::device()); // show "Not connected"
+  }
+}
 
-    if (connection_error)
-    {
-      // There is an error related to a previous connection or connection
-      // attempt, so don't automatically reconnect.  That would be
-      // confusing, because the user might be looking away and not notice
-      // that the connection was lost and then regained, or they could be
-      // trying to read the error message.
-    }
-    else if (disconnected_by_user)
+void main_controller::handle_device_list_failed(const std::string & message)
+{
+  set_connection_error("Failed to get the list of devices.");
+  window->show_error_message(
+    "There was an error getting the list of devices.  " + message);
+}
+
+void main_controller::handle_connection_lost()
+{
+  if (!connected()) { return; }
+
+  // The device is gone.
+  disconnect_device_by_error("The connection to the device was lost.");
+  handle_model_changed();
+}
+
+void main_controller::handle_variables_read(
+  const std::vector<uint8_t> & samples)
+{
+  // Ignore variables from a device we have disconnected from.
+  if (!connected() || samples.empty()) { return; }
+
+  // Every sample goes on the graph and into the running counts, but the rest
+  // of the window only shows the latest one.  Decoding each sample into the
+  // same object leaves the latest one there.
+  if (!variables.is_present()) { variables = jrk::variables::create(); }
+  for (size_t i = 0; i + JRK_VARIABLES_SIZE <= samples.size();
+    i += JRK_VARIABLES_SIZE)
+  {
+    variables.read_from_buffer(&samples[i]);
+
+    // Update the running total of current chopping occurrences.
+    // We store the total in a uint32_t but still let's not let it exceed
+    // INT_MAX because there is no need to.
+    uint8_t new_counts = variables.get_current_chopping_occurrence_count();
+    if (current_chopping_count < INT_MAX - new_counts)
     {
-      // The user explicitly disconnected the last connection, so don't
-      // automatically reconnect.
+      current_chopping_count += new_counts;
     }
-    else if (successfully_updated_list && (device_list.size() == 1))
+    else
     {
-      // Automatically connect if there is only one device and we were not
-      // recently disconnected from a device.
-      connect_device(device_list.at(0));
+      current_chopping_count = INT_MAX;
     }
+
+    window->increment_errors_occurred(variables.get_error_flags_occurred());
+    window->add_graph_sample(variables, cached_settings);
   }
+
+  variables_update_failed = false;
+
+  handle_variables_changed();
+}
+
+void main_controller::handle_variables_read_failed()
+{
+  if (!connected()) { return; }
+
+  // The model provides other ways to tell that the variable update failed, and
+  // the exact message is probably not that useful since it is probably just a
+  // generic problem with the USB connection.
+  variables_update_failed = true;
+  handle_variables_changed();
 }
 
 bool main_controller::exit()
@@ -382,50 +451,6 @@ bool main_controller::exit()
   }
 }
 
-static bool device_lists_different(std::vector<jrk::device> const & list1,
-  std::vector<jrk::device> const & list2)
-{
-  if (list1.size() != list2.size())
-  {
-    return true;
-  }
-  else
-  {
-    for (int i = 0; i < list1.size(); i++)
-    {
-      if (list1.at(i).get_os_id() != list2.at(i).get_os_id())
-      {
-        return true;
-      }
-    }
-    return false;
-  }
-}
-
-bool main_controller::update_device_list()
-{
-  try
-  {
-    std::vector<jrk::device> new_device_list = jrk::list_connected_devices();
-    if (device_lists_different(device_list, new_device_list))
-    {
-      device_list_changed = true;
-    }
-    else
-    {
-      device_list_changed = false;
-    }
-    device_list = new_device_list;
-    return true;
-  }
-  catch (std::exception const & e)
-  {
-    set_connection_error("Failed to get the list of devices.");
-    show_exception(e, "There was an error getting the list of devices.");
-    return false;
-  }
-}
-
 void main_controller::show_exception(std::exception const & e,
     std::string const & context)
 {
@@ -450,13 +475,13 @@ void main_controller::handle_device_changed()
 {
   if (connected())
   {
-    const jrk::device & device = device_handle.get_device();
+    const jrk::device & device = connected_device;
 
     window->set_device_list_selected(device);
 
     window->set_device_name(jrk_look_up_product_name_ui(device.get_product()), true);
     window->set_serial_number(device.get_serial_number());
-    window->set_firmware_version(device_handle.get_firmware_version_string());
+    window->set_firmware_version(firmware_version_string);
 
     window->set_cmd_port(cmd_port);
     window->set_ttl_port(ttl_port);
@@ -528,9 +553,6 @@ void main_controller::handle_variables_changed()
   window->set_raw_current_mv64(
     jrk::calculate_raw_current_mv64(cached_settings, variables));
 
-  // Tell the window if current chopping is happening now.
-  window->set_current_chopping_now(variables.get_current_chopping_occurrence_count() > 0);
-
   // Give it the running tally of current chopping events.
   window->set_current_chopping_count(current_chopping_count);
 
@@ -539,7 +561,6 @@ void main_controller::handle_variables_changed()
   window->set_pid_period_exceeded(variables.get_pid_period_exceeded());
 
   window->set_error_flags_halting(variables.get_error_flags_halting());
-  window->increment_errors_occurred(variables.get_error_flags_occurred());
 
   bool error_active = variables.get_error_flags_halting() != 0;
   window->set_stop_motor_enabled(connected());
@@ -547,7 +568,7 @@ void main_controller::handle_variables_changed()
 
   if (connected() && variables.is_present())
   {
-    window->update_graph(variables.get_up_time());
+    window->update_graph();
     window->set_motor_status_message(jrk::diagnose(cached_settings, variables),
       variables.get_error_flags_halting());
   }
@@ -1494,7 +1515,13 @@ void main_controller::handle_error_hard_input(int index, bool state)
 void main_controller::handle_clear_errors_input()
 {
   if (!connected()) { return; }
-  window->set_error_flags_halting(device_handle.clear_errors());
+  worker.request_clear_errors();
+}
+
+void main_controller::handle_errors_cleared(uint16_t error_flags_halting)
+{
+  if (!connected()) { return; }
+  window->set_error_flags_halting(error_flags_halting);
 }
 
 void main_controller::handle_reset_counts_input()
@@ -1558,9 +1585,9 @@ void main_controller::handle_upload_complete()
   disconnected_by_user = false;
 }
 
-bool main_controller::apply_settings()
+void main_controller::apply_settings()
 {
-  if (!connected()) { return false; }
+  if (!connected()) { return; }
 
   try
   {
@@ -1568,79 +1595,92 @@ bool main_controller::apply_settings()
 
     jrk::settings fixed_settings = settings;
     std::string warnings;
-    assert(device_handle.get_device().get_product() == settings.get_product());
-    assert(device_handle.get_device().get_firmware_version() ==
+    assert(connected_device.get_product() == settings.get_product());
+    assert(connected_device.get_firmware_version() ==
       settings.get_firmware_version());
     fixed_settings.fix(&warnings);
     if (warnings.empty() ||
       window->confirm(warnings.append("\nAccept these changes and apply settings?")))
     {
+      // The worker applies the settings and then reports back to
+      // handle_settings_applied(), or shows an error.
       settings = fixed_settings;
-      device_handle.set_eeprom_settings(settings);
-      device_handle.reinitialize();
-      handle_settings_loaded();
+      worker.request_apply_settings(settings);
     }
   }
   catch (const std::exception & e)
   {
     show_exception(e);
-    return false;
+    return;
+  }
+  handle_settings_changed();
+}
+
+void main_controller::handle_settings_applied(const jrk::settings & applied)
+{
+  if (!connected()) { return; }
+
+  // The user might have changed the settings while they were being applied,
+  // in which case those changes still need to be applied.
+  jrk::settings current_settings = settings;
+  bool changed = current_settings.to_string() != applied.to_string();
+
+  settings = applied;
+  handle_settings_loaded();
+  if (changed)
+  {
+    settings = current_settings;
+    settings_modified = true;
   }
   handle_settings_changed();
-  return true;
 }
 
 void main_controller::stop_motor_nocatch()
 {
   if (!connected()) { return; }
-  device_handle.stop_motor();
+  worker.run_command([](jrk::handle & handle)
+  {
+    handle.stop_motor();
+  });
 }
 
 void main_controller::stop_motor()
 {
   if (!connected()) { return; }
-  try
+  worker.request_command([](jrk::handle & handle)
   {
-    device_handle.stop_motor();
-  }
-  catch (const std::exception & e)
-  {
-    show_exception(e);
-  }
+    handle.stop_motor();
+  });
 }
 
 void main_controller::run_motor()
 {
   if (!connected()) { return; }
 
-  try
+  uint16_t target = window->get_manual_target_numeric_input();
+  worker.request_command([target](jrk::handle & handle)
   {
     // Clear the "Awaiting command" error by sending a "Set target" command,
     // just like the original jrk utility.
-    uint16_t target = window->get_manual_target_numeric_input();
-    device_handle.set_target(target);
+    handle.set_target(target);
 
     // Clear all the other latched errors.
-    device_handle.clear_errors();
-  }
-  catch (const std::exception & e)
-  {
-    show_exception(e);
-  }
+    handle.clear_errors();
+  });
 }
 
 void main_controller::set_target(uint16_t target)
 {
   if (!connected()) { return; }
-
-  try
-  {
-    device_handle.set_target(target);
-  }
-  catch (const std::exception & e)
+  worker.request_command([target](jrk::handle & handle)
   {
-    show_exception(e);
-  }
+    handle.set_target(target);
+  });
+}
+
+void main_controller::set_sample_interval(uint32_t interval_ms)
+{
+  worker.request_sample_interval(interval_ms);
 }
 
 void main_controller::clear_current_chopping_count()
@@ -1651,12 +1691,18 @@ void main_controller::clear_current_chopping_count()
 
 void main_controller::force_duty_cycle_target_nocatch(int16_t duty_cycle)
 {
-  device_handle.force_duty_cycle_target(duty_cycle);
+  worker.run_command([duty_cycle](jrk::handle & handle)
+  {
+    handle.force_duty_cycle_target(duty_cycle);
+  });
 }
 
 void main_controller::clear_errors_nocatch()
 {
-  device_handle.clear_errors();
+  worker.run_command([](jrk::handle & handle)
+  {
+    handle.clear_errors();
+  });
 }
 
 void main_controller::open_settings_from_file(std::string filename)
@@ -1670,7 +1716,7 @@ void main_controller::open_settings_from_file(std::string filename)
     std::string settings_string = read_string_from_file(filename);
     jrk::settings fixed_settings = jrk::settings::read_from_string(settings_string);
     std::string warnings;
-    jrk::device device = device_handle.get_device();
+    jrk::device device = connected_device;
     uint32_t product = device.get_product();
     uint16_t firmware_version = device.get_firmware_version();
     fixed_settings.fix_and_change_product(product, firmware_version, &warnings);
@@ -1729,36 +1775,3 @@ void main_controller::save_settings_to_file(std::string filename)
 
   handle_settings_changed();
 }
-
-void main_controller::reload_variables()
-{
-  assert(connected());
-
-  try
-  {
-    uint16_t flags = (1 << JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_OCCURRED) |
-      (1 << JRK_GET_VARIABLES_FLAG_CLEAR_CURRENT_CHOPPING_OCCURRENCE_COUNT);
-    variables = device_handle.get_variables(flags);
-    variables_update_failed = false;
-  }
-  catch (...)
-  {
-    variables_update_failed = true;
-    throw;
-  }
-
-  // Update the running total of current chopping occurrences.
-  // We store the total in a uint32_t but still let's not let it exceed INT_MAX
-  // because there is no need to.
-  {
-    uint8_t new_counts = variables.get_current_chopping_occurrence_count();
-    if (current_chopping_count < INT_MAX - new_counts)
-    {
-      current_chopping_count += new_counts;
-    }
-    else
-    {
-      current_chopping_count = INT_MAX;
-    }
-  }
-}
@@ -1,12 +1,15 @@
 #pragma once
 
 #include "jrk.hpp"
+#include "device_worker.h"
 
 class main_window;
 
 class main_controller
 {
 public:
+  ~main_controller();
+
   // Stores a pointer to the window so we can update the window.
   void set_window(main_window *);
 
@@ -35,7 +38,8 @@ public:
   // Called when the upgrade has been complete.
   void upgrade_firmware_complete();
 
-  // This is called regularly to do various updates.
+  // This is called regularly to do various updates.  It does not do any USB
+  // I/O; the device worker polls the device on its own thread.
   void update();
 
   // This is called when the user tries to exit the program.  Returns true if
@@ -54,19 +58,28 @@ private:
   void really_disconnect();
   void set_connection_error(std::string const & error_message);
 
-  // Returns true for success, false for failure.
-  bool update_device_list();
-
-  // True if device_list changed the last time update_device_list() was
-  // called.
-  bool device_list_changed;
+  // These are called when the device worker reports results.
+  void handle_device_list_changed(const std::vector<jrk::device> &);
+  void handle_device_list_failed(const std::string & message);
+  void handle_connected(const device_connection_info &);
+  void handle_connect_failed(const std::string & os_id,
+    const std::string & message);
+  void handle_connection_lost();
+  void handle_variables_read(const std::vector<uint8_t> & samples);
+  void handle_variables_read_failed();
+  void handle_settings_read(const jrk::settings &);
+  void handle_settings_read_failed(const std::string & message);
+  void handle_settings_applied(const jrk::settings &);
+  void handle_defaults_restored();
+  void handle_errors_cleared(uint16_t error_flags_halting);
 
   void show_exception(std::exception const & e, std::string const & context = "");
 
 public:
-  // This is called when the user wants to apply the settings.
-  // Returns true on success.
-  bool apply_settings();
+  // This is called when the user wants to apply the settings.  The device
+  // worker applies them in the background: handle_settings_applied() updates
+  // the window when it is done, or an error is shown if it fails.
+  void apply_settings();
 
   void stop_motor_nocatch();
   void stop_motor();
@@ -74,6 +87,9 @@ public:
   void set_target(uint16_t);
   void clear_current_chopping_count();
 
+  // Sets how often the variables are read from the device, in milliseconds.
+  void set_sample_interval(uint32_t interval_ms);
+
   void force_duty_cycle_target_nocatch(int16_t);
   void clear_errors_nocatch();
 
@@ -189,11 +205,20 @@ private:
   // Holds a list of the relevant devices that are connected to the computer.
   std::vector<jrk::device> device_list;
 
-  // Holds an open handle to a device or a null handle if we are not connected.
-  jrk::handle device_handle;
+  // Does all of the USB I/O on a separate thread.
+  device_worker worker;
+
+  // The device we are connected to, or a null device if we are not connected.
+  jrk::device connected_device;
 
-  // The command port and TTL port names for the device we are currently
-  // connected to, or "?" if there was an error getting them.
+  // If we asked the worker to connect to a device and it has not reported
+  // back yet, this is the device's OS ID.  Otherwise, it is empty.
+  std::string connecting_os_id;
+
+  // The firmware version string, command port name, and TTL port name for the
+  // device we are currently connected to, or "?" if there was an error getting
+  // them.
+  std::string firmware_version_string;
   std::string cmd_port;
   std::string ttl_port;
 
@@ -235,16 +260,10 @@ private:
   // to a USB error).
   bool variables_update_failed = false;
 
-  // The number of updates to wait for before updating the
-  // device list again (saves CPU time).
-  uint32_t update_device_list_counter = 1;
-
-  void reload_variables();
-
 public:
 
   // Returns true if we are currently connected to a device.
-  bool connected() const { return device_handle.is_present(); }
+  bool connected() const { return connected_device.is_present(); }
 
 private:
 
@@ -0,0 +1,427 @@
+#include "device_worker.h"
+
+#include <QCoreApplication>
+#include <QTimer>
+
+#include <stdexcept>
+
+// After an error getting the device list, wait this many polls before trying
+// again.
+static const uint32_t DEVICE_LIST_RETRY_DIVIDER = 20;
+
+device_worker::device_worker()
+{
+  qRegisterMetaType<jrk::device>();
+  qRegisterMetaType<jrk::settings>();
+  qRegisterMetaType<std::vector<jrk::device>>();
+  qRegisterMetaType<std::vector<uint8_t>>();
+  qRegisterMetaType<device_connection_info>();
+  qRegisterMetaType<device_worker::job>();
+
+  // The worker lives on its own thread, so these connections queue the
+  // requests and the slots run on the worker thread.
+  connect(this, &device_worker::start_requested,
+    this, &device_worker::start_polling, Qt::QueuedConnection);
+  connect(this, &device_worker::stop_requested,
+    this, &device_worker::stop_polling, Qt::BlockingQueuedConnection);
+  connect(this, &device_worker::connect_requested,
+    this, &device_worker::open_device, Qt::QueuedConnection);
+  connect(this, &device_worker::disconnect_requested,
+    this, &device_worker::close_device, Qt::QueuedConnection);
+  connect(this, &device_worker::reload_settings_requested,
+    this, &device_worker::read_settings, Qt::QueuedConnection);
+  connect(this, &device_worker::restore_defaults_requested,
+    this, &device_worker::restore_defaults, Qt::QueuedConnection);
+  connect(this, &device_worker::apply_settings_requested,
+    this, &device_worker::apply_settings, Qt::QueuedConnection);
+  connect(this, &device_worker::clear_errors_requested,
+    this, &device_worker::clear_errors, Qt::QueuedConnection);
+  connect(this, &device_worker::sample_interval_requested,
+    this, &device_worker::set_sample_interval, Qt::QueuedConnection);
+  connect(this, &device_worker::command_requested,
+    this, &device_worker::run_job, Qt::QueuedConnection);
+  connect(this, &device_worker::command_run_requested,
+    this, &device_worker::run_job, Qt::BlockingQueuedConnection);
+}
+
+device_worker::~device_worker()
+{
+  stop();
+}
+
+void device_worker::start(uint32_t interval_ms)
+{
+  if (thread.isRunning()) { return; }
+  moveToThread(&thread);
+  thread.start();
+  emit start_requested(interval_ms);
+}
+
+void device_worker::stop()
+{
+  if (!thread.isRunning()) { return; }
+  emit stop_requested();
+  thread.quit();
+  thread.wait();
+}
+
+void device_worker::request_connect(const jrk::device & device)
+{
+  emit connect_requested(device);
+}
+
+void device_worker::request_disconnect()
+{
+  emit disconnect_requested();
+}
+
+void device_worker::request_reload_settings()
+{
+  emit reload_settings_requested();
+}
+
+void device_worker::request_restore_defaults()
+{
+  emit restore_defaults_requested();
+}
+
+void device_worker::request_apply_settings(const jrk::settings & settings)
+{
+  emit apply_settings_requested(settings);
+}
+
+void device_worker::request_clear_errors()
+{
+  emit clear_errors_requested();
+}
+
+void device_worker::request_sample_interval(uint32_t interval_ms)
+{
+  emit sample_interval_requested(interval_ms);
+}
+
+void device_worker::request_command(const job & command)
+{
+  emit command_requested([this, command](jrk::handle & handle)
+  {
+    try
+    {
+      command(handle);
+    }
+    catch (const std::exception & e)
+    {
+      emit command_failed(e.what());
+    }
+  });
+}
+
+void device_worker::run_command(const job & command)
+{
+  std::string error_message;
+  bool failed = false;
+
+  job wrapper = [&](jrk::handle & handle)
+  {
+    try
+    {
+      command(handle);
+    }
+    catch (const std::exception & e)
+    {
+      failed = true;
+      error_message = e.what();
+    }
+  };
+
+  // A blocking queued connection would deadlock if the worker belongs to this
+  // thread, which is the case before start() and after stop().  The worker
+  // thread is not using the handle then, so we can run the job here.
+  if (QThread::currentThread() == QObject::thread() || !thread.isRunning())
+  {
+    run_job(wrapper);
+  }
+  else
+  {
+    emit command_run_requested(wrapper);
+  }
+
+  if (failed) { throw std::runtime_error(error_message); }
+}
+
+void device_worker::start_polling(uint32_t interval_ms)
+{
+  poll_timer = new QTimer(this);
+  connect(poll_timer, &QTimer::timeout, this, &device_worker::poll);
+  poll_timer->start(interval_ms);
+
+  // A precise timer lets us sample at intervals of a few milliseconds.
+  sample_timer = new QTimer(this);
+  sample_timer->setTimerType(Qt::PreciseTimer);
+  connect(sample_timer, &QTimer::timeout, this, &device_worker::sample);
+  sample_timer->start(interval_ms);
+
+  poll();
+}
+
+void device_worker::stop_polling()
+{
+  delete poll_timer;
+  poll_timer = NULL;
+  delete sample_timer;
+  sample_timer = NULL;
+  samples.clear();
+  handle.close();
+  device_watch = jrk::device_watch();
+
+  // Give the object back to the main thread so it can be destroyed there
+  // after this thread stops.
+  moveToThread(QCoreApplication::instance()->thread());
+}
+
+void device_worker::poll()
+{
+  update_device_list();
+
+  if (!handle.is_present()) { return; }
+
+  // See if the device we are connected to is still available.  On Linux,
+  // jrk_handle_is_alive() also catches the case where someone unplugs and
+  // plugs the same device in very fast.  On other systems it only notices a
+  // disconnection when a transfer fails, so we also look for the device in the
+  // device list.
+  if (!handle.is_alive() || !device_listed())
+  {
+    handle.close();
+    samples.clear();
+    emit connection_lost();
+    return;
+  }
+
+  if (!samples.empty())
+  {
+    emit variables_read(samples);
+    samples.clear();
+  }
+  else if (sample_failed)
+  {
+    emit variables_read_failed();
+  }
+  sample_failed = false;
+}
+
+void device_worker::sample()
+{
+  if (!handle.is_present()) { return; }
+
+  size_t offset = samples.size();
+  samples.resize(offset + JRK_VARIABLES_SIZE);
+  try
+  {
+    uint16_t flags = (1 << JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_OCCURRED) |
+      (1 << JRK_GET_VARIABLES_FLAG_CLEAR_CURRENT_CHOPPING_OCCURRENCE_COUNT);
+    handle.get_variable_segment(0, JRK_VARIABLES_SIZE, &samples[offset], flags);
+  }
+  catch (const std::exception &)
+  {
+    samples.resize(offset);
+
+    // The exact message is probably not that useful since it is probably just
+    // a generic problem with the USB connection.
+    sample_failed = true;
+  }
+}
+
+void device_worker::set_sample_interval(uint32_t interval_ms)
+{
+  if (sample_timer) { sample_timer->start(interval_ms); }
+}
+
+bool device_worker::device_listed()
+{
+  // If we could not get the device list, assume the device is still there.
+  if (!device_watch.is_present()) { return true; }
+
+  try
+  {
+    std::string os_id = handle.get_device().get_os_id();
+    for (const jrk::device & candidate : device_watch.get_devices())
+    {
+      if (candidate.get_os_id() == os_id) { return true; }
+    }
+    return false;
+  }
+  catch (const std::exception &)
+  {
+    return true;
+  }
+}
+
+void device_worker::update_device_list()
+{
+  if (device_list_retry_counter > 0)
+  {
+    device_list_retry_counter--;
+    return;
+  }
+
+  try
+  {
+    bool changed;
+    if (device_watch.is_present())
+    {
+      changed = device_watch.update();
+    }
+    else
+    {
+      device_watch = jrk::device_watch::create();
+      changed = true;
+    }
+
+    if (changed)
+    {
+      emit device_list_changed(device_watch.get_devices());
+    }
+  }
+  catch (const std::exception & e)
+  {
+    device_list_retry_counter = DEVICE_LIST_RETRY_DIVIDER;
+    emit device_list_failed(e.what());
+  }
+}
+
+void device_worker::open_device(jrk::device device)
+{
+  // Close the old handle in case one is already open.
+  close_device();
+
+  try
+  {
+    handle = jrk::handle(device);
+  }
+  catch (const std::exception & e)
+  {
+    emit connect_failed(QString::fromStdString(device.get_os_id()), e.what());
+    return;
+  }
+
+  device_connection_info info;
+  info.device = device;
+
+  try
+  {
+    info.firmware_version_string = handle.get_firmware_version_string();
+  }
+  catch (const std::exception &)
+  {
+    info.firmware_version_string = "?";
+  }
+
+  try
+  {
+    info.cmd_port = device.get_cmd_port_name();
+  }
+  catch (const std::exception &)
+  {
+    info.cmd_port = "?";
+  }
+
+  try
+  {
+    info.ttl_port = device.get_ttl_port_name();
+  }
+  catch (const std::exception &)
+  {
+    info.ttl_port = "?";
+  }
+
+  try
+  {
+    info.settings = handle.get_eeprom_settings();
+  }
+  catch (const std::exception & e)
+  {
+    info.settings_error = e.what();
+  }
+
+  emit connected(info);
+}
+
+void device_worker::close_device()
+{
+  handle.close();
+  samples.clear();
+  sample_failed = false;
+}
+
+void device_worker::read_settings()
+{
+  if (!handle.is_present()) { return; }
+
+  try
+  {
+    emit settings_read(handle.get_eeprom_settings());
+  }
+  catch (const std::exception & e)
+  {
+    emit settings_read_failed(e.what());
+  }
+}
+
+void device_worker::restore_defaults()
+{
+  if (!handle.is_present()) { return; }
+
+  bool restore_success = false;
+  try
+  {
+    handle.restore_defaults();
+    restore_success = true;
+  }
+  catch (const std::exception & e)
+  {
+    emit command_failed(e.what());
+  }
+
+  read_settings();
+
+  if (restore_success) { emit defaults_restored(); }
+}
+
+void device_worker::apply_settings(jrk::settings settings)
+{
+  if (!handle.is_present()) { return; }
+
+  try
+  {
+    // Only write the bytes that changed, and make sure they were written
+    // correctly before using them.
+    handle.apply_eeprom_settings(settings);
+    handle.reinitialize();
+    emit settings_applied(settings);
+  }
+  catch (const std::exception & e)
+  {
+    emit command_failed(e.what());
+  }
+}
+
+void device_worker::clear_errors()
+{
+  if (!handle.is_present()) { return; }
+
+  try
+  {
+    emit errors_cleared(handle.clear_errors());
+  }
+  catch (const std::exception & e)
+  {
+    emit command_failed(e.what());
+  }
+}
+
+void device_worker::run_job(job command)
+{
+  // If we are not connected, the job's first command fails because the handle
+  // is null, and the job reports that like any other error.
+  command(handle);
+}
@@ -0,0 +1,175 @@
+#pragma once
+
+#include <jrk.hpp>
+
+#include <QMetaType>
+#include <QObject>
+#include <QString>
+#include <QThread>
+
+#include <functional>
+#include <string>
+#include <vector>
+
+class QTimer;
+
+// What the device worker found out when it connected to a device.
+struct device_connection_info
+{
+  jrk::device device;
+  std::string firmware_version_string;
+
+  // The command port and TTL port names, or "?" if there was an error getting
+  // them.
+  std::string cmd_port;
+  std::string ttl_port;
+
+  // The settings from the device, or a null object if there was an error
+  // loading them, in which case settings_error describes the error.
+  jrk::settings settings;
+  std::string settings_error;
+};
+
+// Does all of the GUI's USB I/O on a thread of its own: it keeps track of
+// which jrks are connected, reads the variables from the jrk we are connected
+// to, and sends it the commands and settings that main_controller asks for.
+// A slow or failing transfer never blocks the UI thread.
+//
+// The variables are sampled at their own rate, which can be much faster than
+// the display is refreshed.  Samples are collected in a buffer and delivered
+// in one batch per poll, so the UI thread handles one signal per refresh no
+// matter how fast we sample.  The batch holds the raw bytes of each sample, in
+// the same format as jrk::handle::get_variable_segment() fills them, so
+// passing it to the UI thread only copies one block of memory.
+//
+// The request functions are called from the UI thread.  They queue the
+// request and return right away.  The worker performs requests in the order
+// they were made and reports the results with signals, which main_controller
+// receives through queued connections.  Since every result comes from the same
+// thread, the results arrive in the order they were produced.
+class device_worker : public QObject
+{
+  Q_OBJECT
+
+public:
+  // A job that runs on the worker thread with the open handle.
+  typedef std::function<void (jrk::handle &)> job;
+
+  device_worker();
+  ~device_worker();
+
+  // Starts the worker thread.  The device list is checked and the samples are
+  // delivered every interval_ms milliseconds.  Until
+  // request_sample_interval() is called, the variables are sampled at the same
+  // rate.
+  void start(uint32_t interval_ms);
+
+  // Closes the device and stops the thread.  Blocks until that is done.
+  void stop();
+
+  void request_connect(const jrk::device & device);
+  void request_disconnect();
+  void request_reload_settings();
+  void request_restore_defaults();
+  void request_apply_settings(const jrk::settings & settings);
+  void request_clear_errors();
+
+  // Changes how often the variables are read.  If a read takes longer than
+  // the interval, we read them as fast as the USB connection allows.
+  void request_sample_interval(uint32_t interval_ms);
+
+  // Queues a command that has no results, such as "Set target".  If it fails,
+  // command_failed() is emitted.
+  void request_command(const job & command);
+
+  // Runs a command on the worker thread and waits for it to finish.  Throws an
+  // exception on the calling thread if the command fails.  The wizards use
+  // this because they need to know right away whether a command worked.
+  void run_command(const job & command);
+
+signals:
+  // Results.
+  void device_list_changed(std::vector<jrk::device> device_list);
+  void device_list_failed(QString message);
+  void connected(device_connection_info info);
+  void connect_failed(QString os_id, QString message);
+  void connection_lost();
+  // The samples are JRK_VARIABLES_SIZE bytes each, oldest first.  Decode them
+  // with jrk::variables::read_from_buffer().
+  void variables_read(const std::vector<uint8_t> & samples);
+  void variables_read_failed();
+  void settings_read(jrk::settings settings);
+  void settings_read_failed(QString message);
+  void settings_applied(jrk::settings settings);
+  void defaults_restored();
+  void errors_cleared(uint16_t error_flags_halting);
+  void command_failed(QString message);
+
+  // Requests, which are connected to the slots below with queued connections
+  // so that the slots run on the worker thread.
+  void start_requested(uint32_t interval_ms);
+  void stop_requested();
+  void connect_requested(jrk::device device);
+  void disconnect_requested();
+  void reload_settings_requested();
+  void restore_defaults_requested();
+  void apply_settings_requested(jrk::settings settings);
+  void clear_errors_requested();
+  void sample_interval_requested(uint32_t interval_ms);
+  void command_requested(device_worker::job command);
+  void command_run_requested(device_worker::job command);
+
+private slots:
+  void start_polling(uint32_t interval_ms);
+  void stop_polling();
+  void poll();
+  void sample();
+  void open_device(jrk::device device);
+  void close_device();
+  void read_settings();
+  void restore_defaults();
+  void apply_settings(jrk::settings settings);
+  void clear_errors();
+  void set_sample_interval(uint32_t interval_ms);
+  void run_job(device_worker::job command);
+
+private:
+  void update_device_list();
+
+  // Returns true if the device we are connected to is in the device list.
+  bool device_listed();
+
+  QThread thread;
+
+  // The members below are only used on the worker thread.
+
+  QTimer * poll_timer = NULL;
+  QTimer * sample_timer = NULL;
+
+  // The variables read since the last poll, in the format of the batches
+  // passed to variables_read().  The buffer keeps its capacity when it is
+  // cleared, so reading the variables does not allocate memory once it has
+  // grown to its usual size.
+  std::vector<uint8_t> samples;
+
+  // Whether a read failed since the last poll.
+  bool sample_failed = false;
+
+  // Tells us when devices are connected or disconnected, so we do not have to
+  // list every USB device on each poll.  Null until the first poll.
+  jrk::device_watch device_watch;
+
+  // The number of polls to wait for before trying to update the device list
+  // again after an error.
+  uint32_t device_list_retry_counter = 0;
+
+  // Holds an open handle to a device or a null handle if we are not connected.
+  jrk::handle handle;
+};
+
+Q_DECLARE_METATYPE(jrk::device)
+Q_DECLARE_METATYPE(jrk::settings)
+Q_DECLARE_METATYPE(std::vector<jrk::device>)
+Q_DECLARE_METATYPE(std::vector<uint8_t>)
+Q_DECLARE_METATYPE(device_connection_info)
+Q_DECLARE_METATYPE(device_worker::job)
@@ -7,8 +7,34 @@
 #include <QFontDatabase>
 #include <QGuiApplication>
 #include <QMessageBox>
+#include <QProcessEnvironment>
+#include <QTimer>
 #include <QWidgetAction>
 
+#include <algorithm>
+#include <cmath>
+
+// The shortest time between replots, in milliseconds.  This is about one frame
+// on a 60 Hz display.
+static const int REPLOT_INTERVAL_MS = 16;
+
+// We switch to showing the minimum and maximum in each column of pixels when
+// the number of samples in view is more than LOD_ENABLE_RATIO times the width
+// of the graph, and switch back to the raw data when it is less than
+// LOD_DISABLE_RATIO times the width.  The gap keeps us from switching back and
+// forth when the number is close to the limit.
+static const int LOD_ENABLE_RATIO = 4;
+static const int LOD_DISABLE_RATIO = 2;
+
+// The number of samples per pixel we ask for when drawing with OpenGL, which
+// smooths the edges of the lines.
+static const int OPENGL_MULTISAMPLES = 4;
+
+// How much each replot counts toward the average frame time, and how often we
+// show the average, in milliseconds.
+static const double FRAME_TIME_SMOOTHING = 0.1;
+static const int FRAME_TIME_LABEL_INTERVAL_MS = 500;
+
 graph_widget::graph_widget()
 {
   int id = QFontDatabase::addApplicationFont(":dejavu_sans");
@@ -16,10 +42,29 @@ graph_widget::graph_widget()
   y_label_font.setFamily(family);
   x_label_font.setFamily(family);
 
+  // This must be set up before setup_ui(), which requests a replot.
+  replot_timer = new QTimer(this);
+  replot_timer->setSingleShot(true);
+  connect(replot_timer, &QTimer::timeout, this, &graph_widget::replot);
+  last_replot_time.start();
+  frame_time_label_time.start();
+
   setup_ui();
 
   connect(domain, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
     this, &graph_widget::change_ranges);
+
+  connect(sample_interval,
+    static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged),
+    this, &graph_widget::sample_interval_changed);
+
+  // Set the JRK2GUI_OPENGL environment variable to "Y" to draw the graph with
+  // OpenGL from the start.
+  auto env = QProcessEnvironment::systemEnvironment();
+  if (env.value("JRK2GUI_OPENGL") == "Y")
+  {
+    set_opengl(true);
+  }
 }
 
 // Changes options for the custom_plot when in preview mode.
@@ -60,7 +105,7 @@ void graph_widget::set_preview_mode(bool preview_mode)
   custom_plot->xAxis->setTickLabels(!preview_mode);
   custom_plot->xAxis->setLabel(preview_mode ? "" : "Time (ms)");
 
-  custom_plot->replot();
+  request_replot();
 }
 
 void graph_widget::set_paused(bool paused)
@@ -69,31 +114,58 @@ void graph_widget::set_paused(bool paused)
   {
     graph_paused = paused;
     pause_run_button->setText(graph_paused ? "R&un" : "&Pause");
-    custom_plot->replot();
+    update_level_of_detail();
+    request_replot();
   }
 }
 
 void graph_widget::clear_graphs()
 {
+  lod_column_ms = 0;
   for (auto plot : all_plots)
   {
-    plot->graph->data()->clear();
+    plot->raw_data->clear();
+    plot->lod_data->clear();
+    plot->pending_data.clear();
+    plot->graph->setData(plot->raw_data);
   }
 
-  custom_plot->replot();
+  request_replot();
 }
 
-void graph_widget::plot_data(uint32_t time)
+void graph_widget::add_data(uint32_t time)
 {
   current_time = time;
   if (!graph_paused) { display_time = time; }
 
   for (auto plot : all_plots)
   {
-    plot->graph->addData(time, plot->plot_value);
+    plot->pending_data.append(QCPGraphData(time, plot->plot_value));
+  }
+}
+
+void graph_widget::plot_data()
+{
+  // Add all the samples since the last call at once.  They are usually sorted
+  // and newer than the existing data, so the container can just append them.
+  // The time goes backwards if the device is reset, so we do not tell the
+  // container they are sorted; it sorts the batch and merges it in.  Resizing
+  // the pending list keeps its memory for the next batch.
+  for (auto plot : all_plots)
+  {
+    plot->raw_data->add(plot->pending_data, false);
+    if (lod_column_ms > 0)
+    {
+      for (const QCPGraphData & sample : plot->pending_data)
+      {
+        add_lod_sample(*plot, sample);
+      }
+    }
+    plot->pending_data.resize(0);
   }
 
   remove_old_data();
+  update_level_of_detail();
 
   if (graph_paused) { return; }
 
@@ -107,7 +179,92 @@ void graph_widget::plot_data(uint32_t time)
     }
   }
 
-  custom_plot->replot();
+  request_replot();
+}
+
+void graph_widget::request_replot()
+{
+  if (replot_timer->isActive()) { return; }
+
+  // Replot on the next pass through the event loop, unless we replotted less
+  // than a frame ago, in which case we wait for the frame to end.  Any other
+  // changes made before then are drawn by the same replot.
+  int wait_ms = REPLOT_INTERVAL_MS - (int)last_replot_time.elapsed();
+  replot_timer->start(std::max(wait_ms, 0));
+}
+
+void graph_widget::replot()
+{
+  last_replot_time.restart();
+
+  // Paint the widget right away instead of later in the event loop, so the
+  // time we measure includes copying the image to the screen.  With OpenGL,
+  // that is when the image is read back from the graphics card.
+  QElapsedTimer frame_timer;
+  frame_timer.start();
+  custom_plot->replot(QCustomPlot::rpImmediateRefresh);
+  double ms = frame_timer.nsecsElapsed() / 1e6;
+
+  bool first_frame = frame_time_ms == 0;
+  if (first_frame)
+  {
+    frame_time_ms = ms;
+  }
+  else
+  {
+    frame_time_ms += (ms - frame_time_ms) * FRAME_TIME_SMOOTHING;
+  }
+
+  if (first_frame ||
+    frame_time_label_time.elapsed() >= FRAME_TIME_LABEL_INTERVAL_MS)
+  {
+    update_frame_time_label();
+  }
+}
+
+void graph_widget::update_frame_time_label()
+{
+  frame_time_label_time.restart();
+  frame_time_label->setText(tr(" Frame: %1 ms (%2)")
+    .arg(frame_time_ms, 0, 'f', 1)
+    .arg(custom_plot->openGl() ? tr("OpenGL") : tr("software")));
+}
+
+bool graph_widget::set_opengl(bool enabled)
+{
+#ifdef QCUSTOMPLOT_USE_OPENGL
+  // QCustomPlot saves some of its settings when OpenGL is turned on and
+  // restores them when it is turned off, so only call it for a change.
+  if (enabled != custom_plot->openGl())
+  {
+    custom_plot->setOpenGl(enabled, OPENGL_MULTISAMPLES);
+
+    // If QCustomPlot could not set up OpenGL, it falls back to drawing in
+    // software.  Some OpenGL implementations cannot give us a multisampled
+    // context, so try once more without multisampling first.
+    if (enabled && !custom_plot->openGl())
+    {
+      custom_plot->setOpenGl(true, 0);
+    }
+  }
+#endif
+
+  opengl_action->setChecked(custom_plot->openGl());
+
+  // Start a new average, since the old frame times are no longer relevant.
+  frame_time_ms = 0;
+  request_replot();
+
+  return custom_plot->openGl() == enabled;
+}
+
+void graph_widget::opengl_toggled(bool checked)
+{
+  if (!set_opengl(checked))
+  {
+    show_warning_message("OpenGL could not be set up, so the graph will "
+      "be drawn in software.", custom_plot);
+  }
 }
 
 void graph_widget::set_checkbox_style(plot * plot, const QString & color)
@@ -130,7 +287,7 @@ void graph_widget::change_plot_colors(plot * plot, const QString & color)
     label->setColor(color);
   }
 
-  custom_plot->replot();
+  request_replot();
 }
 
 bool graph_widget::eventFilter(QObject * object, QEvent * e)
@@ -191,7 +348,7 @@ void graph_widget::show_plot_menu(plot * plot, bool with_title)
   {
     reset_graph_interaction_axes();
     set_graph_interaction_axis(*plot);
-    custom_plot->replot();
+    request_replot();
   });
 
   connect(change_color_action, &QAction::triggered, [=]()
@@ -214,7 +371,7 @@ void graph_widget::show_plot_menu(plot * plot, bool with_title)
   connect(reset_range_action, &QAction::triggered, [=]
   {
     reset_plot_range(*plot);
-    custom_plot->replot();
+    request_replot();
   });
 
   menu->popup(QCursor::pos());
@@ -277,6 +434,16 @@ void graph_widget::setup_ui()
   connect(default_theme_action, &QAction::triggered, this,
     &graph_widget::switch_to_default);
 
+  opengl_action = new QAction(this);
+  opengl_action->setText(tr("Use &OpenGL to draw the graph"));
+  opengl_action->setCheckable(true);
+#ifndef QCUSTOMPLOT_USE_OPENGL
+  // This build of the software cannot use OpenGL.
+  opengl_action->setVisible(false);
+#endif
+  connect(opengl_action, &QAction::triggered, this,
+    &graph_widget::opengl_toggled);
+
   pause_run_button = new QPushButton();
   pause_run_button->setObjectName("pause_run_button");
   pause_run_button->setText(tr("&Pause"));
@@ -296,6 +463,26 @@ void graph_widget::setup_ui()
   domain->setValue(10);  // show a time span of 10 seconds by default
   domain->setRange(1, max_domain_ms / 1000);
 
+  sample_interval = new QSpinBox();
+  sample_interval->setRange(min_sample_interval_ms, max_sample_interval_ms);
+  sample_interval->setValue(default_sample_interval_ms);
+  sample_interval->setToolTip(tr(
+    "How often to read the variables from the device.  "
+    "Short intervals capture fast changes in the duty cycle and current."));
+
+  frame_time_label = new QLabel();
+  frame_time_label->setToolTip(tr(
+    "How long it takes to draw the graph, averaged over recent frames, "
+    "and whether it is drawn with OpenGL or in software."));
+  QString longest_frame_time = tr(" Frame: 000.0 ms (software)");
+#if QT_VERSION >= QT_VERSION_CHECK(5, 11, 0)
+  frame_time_label->setMinimumWidth(
+    frame_time_label->fontMetrics().horizontalAdvance(longest_frame_time));
+#else
+  frame_time_label->setMinimumWidth(
+    frame_time_label->fontMetrics().width(longest_frame_time));
+#endif
+
   show_all_none = new QPushButton("Show &all/none");
   show_all_none->setObjectName("show_all_none");
   show_all_none->setStyleSheet("QPushButton{padding: 4px;}");
@@ -311,6 +498,10 @@ void graph_widget::setup_ui()
   QHBoxLayout * bottom_control_layout = new QHBoxLayout();
   bottom_control_layout->addWidget(new QLabel(tr(" Time (s):")), 0, Qt::AlignRight);
   bottom_control_layout->addWidget(domain, 0);
+  bottom_control_layout->addWidget(new QLabel(tr(" Sample interval (ms):")),
+    0, Qt::AlignRight);
+  bottom_control_layout->addWidget(sample_interval, 0);
+  bottom_control_layout->addWidget(frame_time_label, 0);
   bottom_control_layout->addWidget(pause_run_button, 0, Qt::AlignRight);
 
   setup_plot(input, "input", "Input",
@@ -428,6 +619,8 @@ QMenu * graph_widget::setup_options_menu(const QString & title, bool shortcuts)
   options_menu->addAction(dark_theme_action);
   options_menu->addAction(reset_all_colors_action);
   options_menu->addAction(reset_all_ranges_action);
+  options_menu->addSeparator();
+  options_menu->addAction(opengl_action);
 
   connect(save_settings_action, &QAction::triggered, this,
     &graph_widget::save_settings);
@@ -536,6 +729,8 @@ void graph_widget::setup_plot(plot & plot,
   controls_layout->addWidget(plot.scale, row, 2);
 
   plot.graph = custom_plot->addGraph(custom_plot->xAxis2, plot.axis);
+  plot.raw_data = plot.graph->data();
+  plot.lod_data.reset(new QCPGraphDataContainer());
   plot.graph->setPen(QPen(QColor(plot.default_color), 1));
 
   // Briton says StepCenter mode helped with performance issues when dragging
@@ -605,18 +800,133 @@ void graph_widget::update_x_axis()
 // Note: We are not doing anything to handle overflow of the uint32_t
 // time variable, so all data will disappear from the graph every
 // 49 days if you can keep your Jrk running that long.
-// (Add `time -= 30000;` in plot_data() to simulate this.)
+// (Add `time -= 30000;` in add_data() to simulate this.)
 void graph_widget::remove_old_data()
 {
   double oldest_displayable_time = (double)display_time - max_domain_ms - 1000;
   double oldest_later_displayable_time = (double)current_time - max_domain_ms - 1000;
+
+  // All of the plots get their samples at the same times, so we only need to
+  // look at one of them to see if there is anything to remove.
+  QSharedPointer<QCPGraphDataContainer> first = all_plots[0]->raw_data;
+  if (first->isEmpty()) { return; }
+  bool remove_oldest = first->constBegin()->key < oldest_displayable_time;
+  bool remove_hidden = graph_paused &&
+    display_time < oldest_later_displayable_time;
+  if (!remove_oldest && !remove_hidden) { return; }
+
+  for (auto plot : all_plots)
+  {
+    if (remove_oldest)
+    {
+      plot->raw_data->removeBefore(oldest_displayable_time);
+      plot->lod_data->removeBefore(oldest_displayable_time);
+    }
+    if (remove_hidden)
+    {
+      plot->raw_data->remove(display_time, oldest_later_displayable_time);
+    }
+  }
+}
+
+// Decides whether the graphs should show the raw data or the minimum and
+// maximum in each column of pixels, and rebuilds lod_data if needed.  Drawing
+// a graph takes time proportional to the number of points, so this keeps the
+// time bounded by the width of the graph when we are showing many seconds of
+// fast samples.  We show the raw data when paused, since then we only draw
+// the graph occasionally and the details are worth seeing.
+void graph_widget::update_level_of_detail()
+{
+  int width = std::max(custom_plot->axisRect()->width(), 1);
+  double domain_ms = domain->value() * 1000;
+
+  // All of the plots get their samples at the same times, so we only need to
+  // count the samples in view for one of them.
+  QSharedPointer<QCPGraphDataContainer> first = all_plots[0]->raw_data;
+  int count = first->findEnd(display_time, false) -
+    first->findBegin(display_time - domain_ms, false);
+
+  bool enable;
+  if (graph_paused)
+  {
+    enable = false;
+  }
+  else if (lod_column_ms != 0)
+  {
+    enable = count >= LOD_DISABLE_RATIO * width;
+  }
+  else
+  {
+    enable = count > LOD_ENABLE_RATIO * width;
+  }
+
+  double column_ms = enable ? domain_ms / width : 0;
+  if (column_ms == lod_column_ms) { return; }
+  lod_column_ms = column_ms;
+
   for (auto plot : all_plots)
   {
-    plot->graph->data()->removeBefore(oldest_displayable_time);
-    plot->graph->data()->remove(display_time, oldest_later_displayable_time);
+    plot->lod_data->clear();
+    if (lod_column_ms == 0)
+    {
+      plot->graph->setData(plot->raw_data);
+      continue;
+    }
+
+    for (const QCPGraphData & sample : *plot->raw_data)
+    {
+      add_lod_sample(*plot, sample);
+    }
+    plot->graph->setData(plot->lod_data);
   }
 }
 
+void graph_widget::add_lod_sample(plot & plot, const QCPGraphData & sample)
+{
+  double column = std::floor(sample.key / lod_column_ms);
+  QSharedPointer<QCPGraphDataContainer> data = plot.lod_data;
+
+  if (data->isEmpty() || column > plot.lod_column)
+  {
+    // Start a new column.  Its two points start out equal.
+    double start = column * lod_column_ms;
+    plot.lod_column = column;
+    plot.lod_min = plot.lod_max = sample.value;
+    plot.lod_min_first = true;
+    data->add(QCPGraphData(start, sample.value));
+    data->add(QCPGraphData(start + lod_column_ms / 2, sample.value));
+    return;
+  }
+
+  if (column < plot.lod_column)
+  {
+    // The time went backwards, probably because the device was reset.
+    // plot_data() merged the sample into the raw data in order of time, so
+    // update_level_of_detail() will rebuild lod_data from the raw data.
+    lod_column_ms = -1;
+    return;
+  }
+
+  if (sample.value < plot.lod_min)
+  {
+    plot.lod_min = sample.value;
+    plot.lod_min_first = false;
+  }
+  else if (sample.value > plot.lod_max)
+  {
+    plot.lod_max = sample.value;
+    plot.lod_min_first = true;
+  }
+  else
+  {
+    return;
+  }
+
+  QCPGraphDataContainer::iterator last = data->end() - 1;
+  (last - 1)->value = plot.lod_min_first ? plot.lod_min : plot.lod_max;
+  last->value = plot.lod_min_first ? plot.lod_max : plot.lod_min;
+}
+
 // Configures the specified plot so we can use the mouse to change its scale
 // and position.  Display the scale and position labels.
 void graph_widget::set_graph_interaction_axis(const plot & plot)
@@ -810,7 +1120,7 @@ void graph_widget::set_range(const plot & plot)
 
   update_position_step_value(plot);
   update_plot_text_and_arrows(plot);
-  custom_plot->replot();
+  request_replot();
 }
 
 QCPItemText * graph_widget::axis_arrow(const plot & plot, double degrees)
@@ -849,6 +1159,10 @@ void graph_widget::save_settings()
   }
 
   settings_string.append("domain," + QString::number(domain->value()) + "\n");
+  settings_string.append("sample_interval," +
+    QString::number(sample_interval->value()) + "\n");
+  settings_string.append("opengl," +
+    QString::number(custom_plot->openGl()) + "\n");
 
   for (auto plot : all_plots)
   {
@@ -924,6 +1238,19 @@ void graph_widget::load_settings()
       continue;
     }
 
+    if (parts.count() >= 2 && parts[0] == "sample_interval")
+    {
+      sample_interval->setValue(parts[1].toInt());
+      continue;
+    }
+
+    if (parts.count() >= 2 && parts[0] == "opengl")
+    {
+      // If OpenGL cannot be used here, the frame time readout says so.
+      set_opengl(parts[1].toInt());
+      continue;
+    }
+
     for (auto plot : all_plots)
     {
       if (parts.count() < 6 || parts[0] != plot->id_string) { continue; }
@@ -955,7 +1282,7 @@ void graph_widget::load_settings()
   {
     switch_to_default();
   }
-  // custom_plot->replot() was called by the theme-switching functions above
+  // request_replot() was called by the theme-switching functions above
 }
 
 void graph_widget::switch_to_dark()
@@ -984,7 +1311,7 @@ void graph_widget::switch_to_dark()
 
   dark_theme = true;
 
-  custom_plot->replot();
+  request_replot();
 }
 
 void graph_widget::switch_to_default()
@@ -1013,13 +1340,14 @@ void graph_widget::switch_to_default()
 
   dark_theme = false;
 
-  custom_plot->replot();
+  request_replot();
 }
 
 void graph_widget::change_ranges(int domain)
 {
   update_x_axis();
-  custom_plot->replot();
+  update_level_of_detail();
+  request_replot();
 }
 
 void graph_widget::pause_or_run()
@@ -1038,7 +1366,7 @@ void graph_widget::set_line_visible()
     update_plot_text_and_arrows(*plot);
   }
 
-  custom_plot->replot();
+  request_replot();
 }
 
 void graph_widget::show_all_none_clicked()
@@ -1093,7 +1421,7 @@ void graph_widget::reset_all_ranges()
     reset_plot_range(*plot);
   }
   reset_graph_interaction_axes();
-  custom_plot->replot();
+  request_replot();
 }
 
 // Receives a click event from Qt and figures out which plot to select, if any.
@@ -1163,7 +1491,7 @@ void graph_widget::mouse_press(QMouseEvent * event)
     show_plot_menu(plot_clicked, true);
   }
 
-  custom_plot->replot();
+  request_replot();
 }
 
 void dynamic_decimal_spin_box::stepBy(int steps)
@@ -4,6 +4,7 @@
 
 #include <QCheckBox>
 #include <QDoubleSpinBox>
+#include <QElapsedTimer>
 #include <QGridLayout>
 #include <QLabel>
 #include <QMenu>
@@ -26,6 +27,11 @@ public:
   // The maximum time span that can be displayed, in milliseconds.
   const int max_domain_ms = 90000;
 
+  // The range and default value of the time between samples, in milliseconds.
+  const int min_sample_interval_ms = 1;
+  const int max_sample_interval_ms = 1000;
+  const int default_sample_interval_ms = 50;
+
   struct plot
   {
     int index = 0;
@@ -45,6 +51,24 @@ public:
     QCPItemText * axis_position_label;
     QCPItemText * axis_scale_label;
     QList<QCPItemText *> overflow_arrows;
+
+    // Samples added since the last call to plot_data().
+    QVector<QCPGraphData> pending_data;
+
+    // All of the samples we might display.  The graph shows this container
+    // unless there are many more samples in view than pixels, in which case
+    // it shows lod_data.
+    QSharedPointer<QCPGraphDataContainer> raw_data;
+
+    // The smallest and largest sample in each column of pixels, as two points
+    // per column in the order they happened.
+    QSharedPointer<QCPGraphDataContainer> lod_data;
+
+    // The newest column in lod_data and its extremes.
+    double lod_column = 0;
+    double lod_min = 0;
+    double lod_max = 0;
+    bool lod_min_first = true;
   };
 
   QList<plot *> all_plots;
@@ -72,7 +96,22 @@ public:
   void set_preview_mode(bool preview_mode);
   void set_paused(bool paused);
   void clear_graphs();
-  void plot_data(uint32_t time);
+
+  // Adds the plot_value of each plot to the graph as a sample taken at the
+  // specified time.  Samples can arrive much faster than the display is
+  // refreshed, so this does not update the display.
+  void add_data(uint32_t time);
+
+  // Updates the display to show the data added since the last call.
+  void plot_data();
+
+  // Schedules a replot.  Any number of calls made before the replot happens
+  // result in a single replot, and we replot at most once per frame.
+  void request_replot();
+
+  // Turns OpenGL rendering on or off.  If OpenGL cannot be set up, the graph
+  // keeps being drawn in software and this returns false.
+  bool set_opengl(bool enabled);
 
   void set_checkbox_style(plot *, const QString &);
   void change_plot_colors(plot *, const QString &);
@@ -88,6 +127,7 @@ private:
   QMenuBar * menu_bar = NULL;
   QAction * dark_theme_action;
   QAction * default_theme_action;
+  QAction * opengl_action;
 
   // Used to add new plot
   void setup_plot(plot &,
@@ -98,10 +138,14 @@ private:
   QCPItemText * axis_arrow(const plot &, double degrees);
   QPushButton * pause_run_button;
   QSpinBox * domain;
+  QSpinBox * sample_interval;
   QPushButton * show_all_none;
+  QLabel * frame_time_label;
 
   void update_x_axis();
   void remove_old_data();
+  void update_level_of_detail();
+  void add_lod_sample(plot &, const QCPGraphData &);
   void set_graph_interaction_axis(const plot &);
   void reset_graph_interaction_axes();
   void update_plot_text_and_arrows(const plot &);
@@ -110,6 +154,19 @@ private:
   void reset_plot_range(const plot &);
   void set_range(const plot &);
   void set_plot_grid_colors(int value);
+  void update_frame_time_label();
+
+  // The width of the columns in the plots' lod_data, in milliseconds, or 0 if
+  // the graphs are showing the raw data.
+  double lod_column_ms = 0;
+
+  QTimer * replot_timer;
+  QElapsedTimer last_replot_time;
+
+  // An average of how long the recent replots took, in milliseconds, and
+  // when we last showed it.
+  double frame_time_ms = 0;
+  QElapsedTimer frame_time_label_time;
 
   QFont y_label_font;
   QFont x_label_font;
@@ -125,13 +182,19 @@ private:
   bool graph_paused = false;
   bool dark_theme = false;
 
+signals:
+  // Emitted when the user changes the time between samples.
+  void sample_interval_changed(int sample_interval_ms);
+
 public slots:
   void save_settings();
   void load_settings();
 
 private slots:
+  void replot();
   void switch_to_dark();
   void switch_to_default();
+  void opengl_toggled(bool checked);
   void change_ranges(int value);
   void pause_or_run();
   void set_line_visible();
@@ -165,8 +165,6 @@ void main_window::set_up_time(uint32_t up_time)
 
 void main_window::set_input(uint16_t input, uint8_t input_mode)
 {
-  graph->input.plot_value = input;
-
   QString input_pretty = "";
 
   if (input_mode == JRK_INPUT_MODE_RC)
@@ -187,14 +185,11 @@ void main_window::set_input(uint16_t input, uint8_t input_mode)
 
 void main_window::set_target(uint16_t target)
 {
-  graph->target.plot_value = target;
   target_value->setText(QString::number(target));
 }
 
 void main_window::set_feedback(uint16_t feedback, uint8_t feedback_mode)
 {
-  graph->feedback.plot_value = feedback;
-
   QString feedback_pretty = "";
 
   if (feedback_mode == JRK_FEEDBACK_MODE_ANALOG)
@@ -209,35 +204,25 @@ void main_window::set_feedback(uint16_t feedback, uint8_t feedback_mode)
 
 void main_window::set_scaled_feedback(uint16_t scaled_feedback)
 {
-  graph->scaled_feedback.plot_value = scaled_feedback;
   manual_target_slider->set_scaled_feedback(scaled_feedback);
   scaled_feedback_value->setText(QString::number(scaled_feedback));
 }
 
 void main_window::set_feedback_not_applicable()
 {
-  graph->feedback.plot_value = 0;
   feedback_value->setText(tr("N/A"));
-
-  graph->scaled_feedback.plot_value = 0;
   scaled_feedback_value->setText(tr("N/A"));
-
-  graph->error.plot_value = 0;
   error_value->setText("N/A");
-
-  graph->integral.plot_value = 0;
   integral_value->setText("N/A");
 }
 
 void main_window::set_error(int16_t error)
 {
-  graph->error.plot_value = error;
   error_value->setText(QString::number(error));
 }
 
 void main_window::set_integral(int16_t integral)
 {
-  graph->integral.plot_value = integral;
   integral_value->setText(QString::number(integral));
 }
 
@@ -250,13 +235,11 @@ static QString format_duty_cycle(int16_t duty_cycle)
 
 void main_window::set_duty_cycle_target(int16_t duty_cycle_target)
 {
-  graph->duty_cycle_target.plot_value = duty_cycle_target;
   duty_cycle_target_value->setText(format_duty_cycle(duty_cycle_target));
 }
 
 void main_window::set_duty_cycle(int16_t duty_cycle)
 {
-  graph->duty_cycle.plot_value = duty_cycle;
   manual_target_slider->set_duty_cycle(duty_cycle);
   duty_cycle_value->setText(format_duty_cycle(duty_cycle));
   emit duty_cycle_changed(duty_cycle);
@@ -265,21 +248,14 @@ void main_window::set_duty_cycle(int16_t duty_cycle)
 void main_window::set_raw_current_mv64(uint32_t current)
 {
   double current_mv = current / 64.0;
-  graph->raw_current.plot_value = current_mv;
   raw_current_value->setText(QString::number(current_mv, 'f', 2) + " mV");
 }
 
 void main_window::set_current(int32_t current)
 {
-  graph->current.plot_value = current;
   current_value->setText(QString::number(current) + " mA");
 }
 
-void main_window::set_current_chopping_now(bool chopping)
-{
-  graph->current_chopping.plot_value = chopping;
-}
-
 void main_window::set_current_chopping_count(uint32_t count)
 {
   current_chopping_count_value->setText(QString::number(count));
@@ -1180,9 +1156,41 @@ bool main_window::motor_asymmetric_checked()
   return motor_asymmetric_checkbox->isChecked();
 }
 
-void main_window::update_graph(uint32_t up_time)
+void main_window::add_graph_sample(const jrk::variables & vars,
+  const jrk::settings & settings)
 {
-  graph->plot_data(up_time);
+  graph->input.plot_value = vars.get_input();
+  graph->target.plot_value = vars.get_target();
+
+  if (settings.get_feedback_mode() == JRK_FEEDBACK_MODE_NONE)
+  {
+    graph->feedback.plot_value = 0;
+    graph->scaled_feedback.plot_value = 0;
+    graph->error.plot_value = 0;
+    graph->integral.plot_value = 0;
+  }
+  else
+  {
+    graph->feedback.plot_value = vars.get_feedback();
+    graph->scaled_feedback.plot_value = vars.get_scaled_feedback();
+    graph->error.plot_value = vars.get_error();
+    graph->integral.plot_value = vars.get_integral();
+  }
+
+  graph->duty_cycle_target.plot_value = vars.get_duty_cycle_target();
+  graph->duty_cycle.plot_value = vars.get_duty_cycle();
+  graph->raw_current.plot_value =
+    jrk::calculate_raw_current_mv64(settings, vars) / 64.0;
+  graph->current.plot_value = vars.get_current();
+  graph->current_chopping.plot_value =
+    vars.get_current_chopping_occurrence_count() > 0;
+
+  graph->add_data(vars.get_up_time());
+}
+
+void main_window::update_graph()
+{
+  graph->plot_data();
 }
 
 void main_window::reset_graph()
@@ -2304,6 +2312,11 @@ QWidget * main_window::setup_graph()
 
   window_menu->addMenu(graph->setup_options_menu("Graph options"));
 
+  connect(graph, &graph_widget::sample_interval_changed, this,
+    [this](int sample_interval_ms) {
+    controller->set_sample_interval(sample_interval_ms);
+  });
+
   graph_preview_frame = new QFrame();
   graph_preview_frame->setFrameStyle(QFrame::Box | QFrame::Plain);
   graph_preview_frame->setLineWidth(1);
@@ -97,7 +97,6 @@ public:
   void set_duty_cycle(int16_t);
   void set_raw_current_mv64(uint32_t);
   void set_current(int32_t);
-  void set_current_chopping_now(bool);
   void set_current_chopping_count(uint32_t);
   void set_vin_voltage(uint16_t);
   void set_pid_period_count(uint16_t);
@@ -229,7 +228,10 @@ public:
 
   bool motor_asymmetric_checked();
 
-  void update_graph(uint32_t up_time);
+  // Records the values of the variables for the graph.  The graph is not
+  // redrawn until update_graph() is called.
+  void add_graph_sample(const jrk::variables &, const jrk::settings &);
+  void update_graph();
 
   void reset_graph();
 
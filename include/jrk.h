@@ -124,6 +124,10 @@ enum jrk_error_code
   /// The error might have been caused by the device being disconnected, but it
   /// is possible it was caused by something else.
   JRK_ERROR_DEVICE_DISCONNECTED = 4,
+
+  /// Data read back from the device did not match the data that was written
+  /// to it.
+  JRK_ERROR_VERIFY_FAILED = 5,
 };
 
 /// Attempts to copy an error.  If you copy a NULL ::jrk_error pointer, the
@@ -1584,6 +1588,17 @@ uint32_t jrk_settings_achievable_serial_baud_rate(const jrk_settings *, uint32_t
 /// Represents run-time variables that have been read from the jrk.
 typedef struct jrk_variables jrk_variables;
 
+/// Creates a new variables object with every variable set to zero.  You can
+/// pass this object to jrk_get_variables_into() to fill it with variables read
+/// from the jrk.
+///
+/// The variables parameter should be a non-null pointer to a jrk_variables
+/// pointer, which will receive a pointer to a new variables object if and only
+/// if this function is successful.  The caller must free the variables later by
+/// calling jrk_variables_free().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_variables_create(jrk_variables ** variables);
+
 /// Copies a jrk_variables object.  If this function is successful, the caller
 /// must free the settings later by calling jrk_settings_free().
 JRK_API JRK_WARN_UNUSED
@@ -1596,6 +1611,54 @@ jrk_error * jrk_variables_copy(
 JRK_API
 void jrk_variables_free(jrk_variables *);
 
+/// Decodes every variable from a buffer that is JRK_VARIABLES_SIZE bytes long
+/// and has the same layout as the jrk's variables, such as a buffer filled by
+/// jrk_get_variable_segment() or read from a recording, and stores them in the
+/// variables object.
+JRK_API
+void jrk_variables_read_from_buffer(jrk_variables *, const uint8_t * buffer);
+
+/// Decodes one variable from many raw variable buffers at once, storing the
+/// results in a contiguous array.  This is meant for offline analysis of
+/// buffers that were logged with jrk_get_variable_segment() or read with
+/// jrk_recording_read_buffer(): decoding only the variables you need, one
+/// column at a time, is much faster than calling jrk_get_variables() on a
+/// jrk_variables object for every buffer.  The samples in the binary output of
+/// "jrk2cmd --stream" do not have this layout (the selected variables are
+/// packed together after a timestamp), so they cannot be decoded this way.
+///
+/// The buffers argument points to the first buffer.  Each buffer has the same
+/// layout as the jrk's variables, so the variable being decoded starts at
+/// the specified offset, which should be one of the JRK_VAR_* macros from
+/// jrk_protocol.h.  The stride argument is the distance in bytes from the start
+/// of one buffer to the start of the next.  That is usually JRK_VARIABLES_SIZE,
+/// but it can be larger if each buffer is stored with other data, such as a
+/// timestamp.  The count argument is the number of buffers, and the output
+/// array must have room for that many elements.
+///
+/// Use the function whose type matches the size and signedness of the variable;
+/// it is an error to use a function of the wrong size.  The uint8 function
+/// returns whole bytes, so for JRK_VAR_FLAG_BYTE1 you need to extract the
+/// force mode yourself with `& 3`.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_variables_decode_column_uint8(const uint8_t * buffers,
+  size_t stride, size_t count, uint8_t offset, uint8_t * output);
+
+/// See jrk_variables_decode_column_uint8().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_variables_decode_column_uint16(const uint8_t * buffers,
+  size_t stride, size_t count, uint8_t offset, uint16_t * output);
+
+/// See jrk_variables_decode_column_uint8().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_variables_decode_column_int16(const uint8_t * buffers,
+  size_t stride, size_t count, uint8_t offset, int16_t * output);
+
+/// See jrk_variables_decode_column_uint8().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_variables_decode_column_uint32(const uint8_t * buffers,
+  size_t stride, size_t count, uint8_t offset, uint32_t * output);
+
 // Beginning of auto-generated variables getter prototypes.
 
 // Gets the input variable.
@@ -1871,6 +1934,133 @@ JRK_API
 bool jrk_variables_get_digital_reading(const jrk_variables *, uint8_t pin);
 
 
+// jrk_recorder and jrk_recording ///////////////////////////////////////////////
+
+/// Writes a stream of variables read from a jrk to a file in a compact binary
+/// format, which can be read back with jrk_recording_open().
+///
+/// Each record is a buffer that is JRK_VARIABLES_SIZE bytes long and has the
+/// same layout as the jrk's variables, like the buffers returned by
+/// jrk_get_variable_segment() when reading all of the variables.  Records are
+/// grouped into blocks of up to 256, and each record after the first one in a
+/// block is stored as the difference between it and the previous record,
+/// which is mostly zeros when the jrk is sampled frequently.  Compressing the
+/// blocks (see ::JRK_RECORDER_FLAG_COMPRESS) usually makes the recording
+/// several times smaller than the raw buffers.
+///
+/// A jrk_recorder is not thread-safe.  To record several jrks, use one
+/// recorder for each of them.
+typedef struct jrk_recorder jrk_recorder;
+
+/// If this flag is passed to jrk_recorder_create(), blocks of records are
+/// compressed by collapsing runs of zeros.  This is fast enough that you
+/// should generally use it.
+#define JRK_RECORDER_FLAG_COMPRESS (1 << 0)
+
+/// Creates a new recording file, overwriting any existing file with the same
+/// name.
+///
+/// The flags argument should be 0 or ::JRK_RECORDER_FLAG_COMPRESS.
+///
+/// If this function is successful, the caller must call jrk_recorder_finish()
+/// when done writing records and then free the recorder with
+/// jrk_recorder_free().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_recorder_create(const char * filename, uint32_t flags,
+  jrk_recorder ** recorder);
+
+/// Adds a record to the recording.  The buffer must be JRK_VARIABLES_SIZE
+/// bytes long.
+///
+/// Records are written to the file one block at a time, so this function
+/// usually just stores the record in memory.
+///
+/// Recordings can be searched by the up_time variable in each record (see
+/// jrk_recording_seek_up_time()), which only works well if the records are
+/// added in the order they were read from the jrk.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_recorder_write(jrk_recorder *, const uint8_t * buffer);
+
+/// Writes any records that are stored in memory to the file.  Calling this
+/// regularly limits how many records could be lost if the program stops
+/// unexpectedly, but calling it too often makes the recording bigger because
+/// each call ends a block.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_recorder_flush(jrk_recorder *);
+
+/// Writes any records that are stored in memory, writes the index that allows
+/// fast seeking, and closes the file.  After calling this, the only thing you
+/// can do with the recorder is free it.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_recorder_finish(jrk_recorder *);
+
+/// Frees a recorder and closes its file.  If jrk_recorder_finish() was not
+/// called, this tries to write the records that are stored in memory but does
+/// not write the index.  Such a recording can still be read, but opening it is
+/// slower.  It is OK to pass a NULL pointer to this function.
+JRK_API
+void jrk_recorder_free(jrk_recorder *);
+
+/// Represents a recording made by jrk_recorder that has been opened for
+/// reading.  The file is mapped into memory, so opening a recording is fast
+/// even if it is large, and records are decoded straight from the mapped
+/// file as you read them.
+///
+/// A recording has a current position, which starts at the first record and
+/// advances each time you read a record.
+///
+/// A jrk_recording is not thread-safe, but you can open the same file more
+/// than once to read it from several threads.
+typedef struct jrk_recording jrk_recording;
+
+/// Opens a recording for reading.  If this function is successful, the caller
+/// must close the recording later with jrk_recording_close().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_recording_open(const char * filename,
+  jrk_recording ** recording);
+
+/// Closes a recording.  It is OK to pass a NULL pointer to this function.
+JRK_API
+void jrk_recording_close(jrk_recording *);
+
+/// Returns the number of records in the recording.
+JRK_API
+uint64_t jrk_recording_get_record_count(const jrk_recording *);
+
+/// Sets the current position to the specified record, where 0 is the first
+/// record.  Seeking past the last record moves to the end of the recording.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_recording_seek(jrk_recording *, uint64_t record);
+
+/// Sets the current position to the first record whose up_time variable is
+/// greater than or equal to the specified value, or the end of the recording
+/// if there is no such record.  This uses the recording's index to find the
+/// right block, so it is fast even for long recordings.
+///
+/// This assumes that the up_time variable increases from each record to the
+/// next, which will not be true if the jrk was reset or its up time wrapped
+/// around (after about 49 days) during the recording.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_recording_seek_up_time(jrk_recording *, uint32_t up_time);
+
+/// Reads the record at the current position into a buffer that is
+/// JRK_VARIABLES_SIZE bytes long and advances the position.  If the position
+/// is at the end of the recording, this writes true to the done pointer and
+/// does not modify the buffer.  Otherwise, it writes false to it.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_recording_read_buffer(jrk_recording *, uint8_t * buffer,
+  bool * done);
+
+/// Reads the record at the current position into a variables object and
+/// advances the position, so you can use the jrk_variables_get_* functions to
+/// examine it.  The variables object can be created with
+/// jrk_variables_create() and reused for each record.  The done pointer works
+/// the same way as in jrk_recording_read_buffer().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_recording_read_variables(jrk_recording *,
+  jrk_variables * variables, bool * done);
+
+
 // jrk_device ///////////////////////////////////////////////////////////////////
 
 /// Represents a Jrk that is or was connected to the computer.
@@ -1891,6 +2081,32 @@ jrk_error * jrk_list_connected_devices(
   jrk_device *** device_list,
   size_t * device_count);
 
+/// Like jrk_list_connected_devices(), but does not get the serial number, OS
+/// ID, or firmware version of each device until you first ask for it with
+/// jrk_device_get_serial_number(), jrk_device_get_os_id(), or
+/// jrk_device_get_firmware_version().  Getting the serial number requires
+/// reading a string from the device on some operating systems, so this is
+/// faster if you only need to count the devices or look at a few of them.
+///
+/// Since those functions cannot report errors, they return an empty string
+/// (or 0xFFFF for the firmware version) if the property cannot be read.  The
+/// first call to each of them modifies the device object, so a device from
+/// this function should not be used by more than one thread at a time.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_list_connected_devices_lazy(
+  jrk_device *** device_list,
+  size_t * device_count);
+
+/// Finds the connected jrk with the specified serial number.  This is faster
+/// than calling jrk_list_connected_devices() and checking each device: it
+/// only reads the serial numbers of jrks, and it stops at the first match.
+///
+/// If no such jrk is connected, sets the device pointer to NULL and returns
+/// no error.  Otherwise, you must free the device with jrk_device_free().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_find_device_by_serial_number(const char * serial_number,
+  jrk_device ** device);
+
 /// Frees a device list returned by ::jrk_list_connected_devices.  It is OK to
 /// pass NULL to this function.
 JRK_API
@@ -1945,6 +2161,156 @@ JRK_API JRK_WARN_UNUSED
 jrk_error * jrk_device_get_ttl_port_name(const jrk_device *, char ** name);
 
 
+// jrk_device_watch /////////////////////////////////////////////////////////////
+
+/// Keeps an up-to-date list of the jrks that are connected to the computer
+/// and reports when they are connected or disconnected.
+///
+/// Calling jrk_list_connected_devices() regularly to see if anything changed
+/// is expensive on computers with many USB devices, since it has to examine
+/// every one of them.  On Linux, a device watch instead listens for the
+/// kernel's notifications about USB devices being added and removed, and only
+/// lists the devices again after a Pololu device is added.  On other
+/// operating systems, and on Linux if the notifications are not available, it
+/// falls back to listing the devices about once per second.
+///
+/// A device watch is not thread-safe.
+typedef struct jrk_device_watch jrk_device_watch;
+
+/// The event passed to a ::jrk_device_watch_callback when a device is
+/// connected.
+#define JRK_DEVICE_EVENT_ARRIVED 1
+
+/// The event passed to a ::jrk_device_watch_callback when a device is
+/// disconnected.
+#define JRK_DEVICE_EVENT_REMOVED 2
+
+/// A function that jrk_device_watch_update() calls for each device that was
+/// connected or disconnected.  The event is one of the JRK_DEVICE_EVENT_*
+/// macros.  The device is only valid until the callback returns, so use
+/// jrk_device_copy() if you need to keep it.
+typedef void jrk_device_watch_callback(void * user_data, uint8_t event,
+  const jrk_device * device);
+
+/// Creates a device watch and lists the devices that are connected now.
+///
+/// If this function is successful, the caller must free the watch later by
+/// calling jrk_device_watch_free().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_device_watch_create(jrk_device_watch ** watch);
+
+/// Frees a device watch.  It is OK to pass NULL to this function.
+JRK_API
+void jrk_device_watch_free(jrk_device_watch *);
+
+/// Returns true if the watch is getting notifications from the operating
+/// system, or false if it is falling back to listing the devices regularly.
+JRK_API
+bool jrk_device_watch_has_notifications(const jrk_device_watch *);
+
+/// Checks for devices being connected or disconnected and updates the watch's
+/// list of devices.  This does not block and is cheap when nothing happened,
+/// so you can call it often, for example every time your program updates its
+/// display.
+///
+/// For each device that was connected or disconnected, the callback (if it is
+/// not NULL) is called with the user_data pointer.  If the changed pointer is
+/// not NULL, this function writes true to it if the list changed and false
+/// otherwise.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_device_watch_update(jrk_device_watch *,
+  jrk_device_watch_callback * callback, void * user_data, bool * changed);
+
+/// Gets a copy of the watch's list of devices, in the same format as
+/// jrk_list_connected_devices().  The caller must free each device with
+/// jrk_device_free() and free the list with jrk_list_free().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_device_watch_get_devices(const jrk_device_watch *,
+  jrk_device *** device_list, size_t * device_count);
+
+
+// jrk_serial_port //////////////////////////////////////////////////////////////
+
+/// Represents an open serial port that can be used to communicate with one or
+/// more jrks using their TTL serial interface.  See jrk_handle_open_serial().
+typedef struct jrk_serial_port jrk_serial_port;
+
+/// Opens the specified serial port (e.g. "/dev/ttyS0" or "COM4") and
+/// configures it to use the specified baud rate with 8 data bits, one stop
+/// bit, no parity, and no flow control.  The baud rate should match the jrk's
+/// serial baud rate setting, or the jrk should be configured to detect the baud
+/// rate automatically.
+///
+/// The port must later be closed with jrk_serial_port_close().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_serial_port_open(const char * name, uint32_t baud_rate,
+  jrk_serial_port **);
+
+/// Closes and frees the specified serial port.  It is OK to pass NULL to this
+/// function.  Any handles that were opened with this port must be closed
+/// first.
+JRK_API
+void jrk_serial_port_close(jrk_serial_port *);
+
+
+// jrk_simulator ////////////////////////////////////////////////////////////////
+
+/// Represents a simulated Jrk G2 that runs inside this process.  It can be used
+/// to exercise software that uses this library without any hardware.
+///
+/// The simulator implements the same USB requests as the real firmware for
+/// reading variables (including the flags for clearing them), reading and
+/// writing EEPROM and RAM settings, reinitializing, setting the target,
+/// stopping the motor, and forcing the duty cycle.  It runs a simplified
+/// version of the jrk's PID loop on a simple model of a motor with analog
+/// position feedback, so the target, feedback, integral, and duty cycle
+/// variables respond to commands and settings in a plausible way.  It does not
+/// simulate the input pins, current limiting, or most errors.
+///
+/// Each simulator has a mutex that serializes the requests it receives, so
+/// handles for the same simulator can be used from different threads, just like
+/// handles for the same real jrk.  A single handle should still only be used
+/// from one thread at a time.
+typedef struct jrk_simulator jrk_simulator;
+
+/// Creates a simulated jrk with default settings.  The product argument should
+/// be one of the JRK_PRODUCT_* macros.  The serial number can be any string.
+///
+/// The simulator must later be freed with jrk_simulator_free().
+///
+/// Setting the environment variable JRK2_SIMULATED_DEVICES to a number N makes
+/// jrk_list_connected_devices() also return N simulated jrks.  The variable is
+/// read when the list is first requested, and the simulators are created then
+/// and never freed.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_simulator_create(uint8_t product, const char * serial_number,
+  jrk_simulator **);
+
+/// Frees a simulator.  It is OK to pass NULL to this function.  All the device
+/// objects and handles that refer to the simulator must be freed first.
+JRK_API
+void jrk_simulator_free(jrk_simulator *);
+
+/// Creates a device object for the simulator, which can be passed to
+/// jrk_handle_open() just like a device returned by
+/// jrk_list_connected_devices().  The device must later be freed with
+/// jrk_device_free().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_simulator_get_device(jrk_simulator *, jrk_device **);
+
+/// Controls how time passes for the simulator.  By default, the simulator runs
+/// in real time: every request it receives first catches up on the PID periods
+/// that should have happened since the last request.  If real_time is false,
+/// time only passes when jrk_simulator_advance() is called, which makes the
+/// simulation deterministic.
+JRK_API
+void jrk_simulator_set_real_time(jrk_simulator *, bool real_time);
+
+/// Advances the simulation by the specified number of milliseconds.
+JRK_API
+void jrk_simulator_advance(jrk_simulator *, uint32_t milliseconds);
+
+
 // jrk_handle ///////////////////////////////////////////////////////////////////
 
 /// Represents an open handle that can be used to read and write data from a
@@ -1960,11 +2326,74 @@ typedef struct jrk_handle jrk_handle;
 JRK_API JRK_WARN_UNUSED
 jrk_error * jrk_handle_open(const jrk_device *, jrk_handle **);
 
+/// Opens a handle that communicates with a jrk over a serial port.
+///
+/// This function does not do any I/O.  It just records how to reach the jrk.
+/// The port is not owned by the handle: several handles can share one port to
+/// talk to several jrks that are daisy-chained on the same serial line, and the
+/// port must stay open until all of those handles are closed.  Handles that
+/// share a port must not be used from more than one thread at the same time.
+///
+/// The flags argument should be zero or a bitwise-or combination of some
+/// these flags:
+/// - `(1 << JRK_SERIAL_FLAG_POLOLU_PROTOCOL)`: Use the Pololu protocol, which
+///   includes the device number in every command, instead of the compact
+///   protocol.  Without this flag, the device number is ignored and every jrk
+///   on the line will obey every command.
+/// - `(1 << JRK_SERIAL_FLAG_14BIT_DEVICE_NUMBER)`: Send the device number as
+///   two bytes.  Use this if the jrk's "Enable 14-bit device number" setting
+///   is on.
+/// - `(1 << JRK_SERIAL_FLAG_CRC)`: Add a CRC byte to every command.  Use this
+///   if the jrk's "Enable CRC" setting is on.
+///
+/// Commands that do not return any data, like jrk_set_target(), are written to
+/// the port without waiting, so a series of them can be sent back to back.
+/// Commands that read data wait for the response.
+///
+/// Only the commands that the jrk supports over serial can be used with a
+/// serial handle: setting the target, stopping the motor, forcing the duty
+/// cycle, reading variables, reading settings, and writing RAM settings.  The
+/// other commands, such as writing EEPROM settings, will return an error.
+///
+/// The jrk cannot report its product or firmware version over serial, so pass
+/// them in the product argument (one of the JRK_PRODUCT_* macros) and the
+/// firmware_version argument.  Settings read with the handle are marked with
+/// that product and firmware version, and settings written with it are fixed
+/// for that product, just like with a USB handle.  If you do not know them,
+/// pass 0 for both: settings read with the handle will then have a product of
+/// 0, and settings written with it keep the product they already have.
+/// jrk_handle_get_device() returns NULL for serial handles.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_handle_open_serial(jrk_serial_port *, uint16_t device_number,
+  uint32_t flags, uint8_t product, uint16_t firmware_version, jrk_handle **);
+
+#define JRK_SERIAL_FLAG_POLOLU_PROTOCOL 0
+#define JRK_SERIAL_FLAG_14BIT_DEVICE_NUMBER 1
+#define JRK_SERIAL_FLAG_CRC 2
+
 /// Closes and frees the specified handle.  It is OK to pass NULL to this
 /// function.  Do not close the same non-NULL handle twice.
 JRK_API
 void jrk_handle_close(jrk_handle *);
 
+/// Returns false if the device that the handle refers to has been
+/// disconnected, or true if it is probably still usable.
+///
+/// This is much cheaper than calling jrk_list_connected_devices() and looking
+/// for the device in the list.  A handle is considered dead once a command
+/// fails with an error that has the ::JRK_ERROR_DEVICE_DISCONNECTED code, so a
+/// program that polls the device regularly will notice that it was unplugged
+/// within one poll.  On Linux, this function also asks the kernel whether the
+/// USB device is still present, so it can detect that the device was
+/// unplugged even if no command has been sent since then, and it can tell
+/// when the device was unplugged and plugged in again (which requires a new
+/// handle).
+///
+/// Once this returns false for a handle, it always returns false for that
+/// handle.  It returns false if the handle is NULL.
+JRK_API
+bool jrk_handle_is_alive(jrk_handle *);
+
 /// Gets the device object that corresponds to this handle.
 /// The device object will be valid for at least as long as the handle.
 JRK_API JRK_WARN_UNUSED
@@ -1978,6 +2407,30 @@ const jrk_device * jrk_handle_get_device(const jrk_handle *);
 JRK_API JRK_WARN_UNUSED
 const char * jrk_get_firmware_version_string(jrk_handle *);
 
+/// Enables or disables the settings cache for this handle, which is disabled by
+/// default.
+///
+/// While the cache is enabled, jrk_get_eeprom_settings() and
+/// jrk_get_ram_settings() remember the settings they read, and later calls
+/// return a copy of those settings instead of reading them from the device
+/// again.  Sending any request through this handle that could change the
+/// settings, such as jrk_set_eeprom_settings(), jrk_set_ram_settings(),
+/// jrk_restore_defaults(), or jrk_reinitialize(), discards the cached
+/// settings.
+///
+/// The cache cannot know about changes made through other handles or
+/// programs, so only enable it if this handle is the only thing that changes
+/// the jrk's settings.
+JRK_API
+void jrk_handle_set_settings_cache_enabled(jrk_handle *, bool enabled);
+
+/// Returns a number that increases every time a request sent through this
+/// handle might have changed the jrk's settings, whether or not the settings
+/// cache is enabled.  If the number has not changed since you last read the
+/// settings, you do not need to read them again.
+JRK_API JRK_WARN_UNUSED
+uint32_t jrk_handle_get_settings_generation(const jrk_handle *);
+
 /// Sets the target of the Jrk to a value in the range 0 to 4095.
 ///
 /// The target can represent a target duty cycle, speed, or position depending
@@ -2104,6 +2557,64 @@ JRK_API JRK_WARN_UNUSED
 jrk_error * jrk_get_variables(jrk_handle *, jrk_variables ** variables,
   uint16_t flags);
 
+/// Reads only some of the jrk's status variables and returns them as an object.
+///
+/// This is like jrk_get_variables(), but it only transfers and decodes the
+/// variables selected by the mask parameter.  Bit N of the mask selects the
+/// variable that starts at offset N in the variables data structure, so you can
+/// build a mask from the JRK_VAR_* constants in jrk_protocol.h.  For example,
+/// to read the feedback and duty cycle:
+///
+///     (1ULL << JRK_VAR_FEEDBACK) | (1ULL << JRK_VAR_DUTY_CYCLE)
+///
+/// Bits that do not correspond to the start of a variable are ignored, so
+/// JRK_VARIABLES_MASK_ALL selects every variable.  Use JRK_VAR_FLAG_BYTE1 to
+/// select the force mode, and JRK_VAR_ANALOG_READING_SDA,
+/// JRK_VAR_ANALOG_READING_FBA, or JRK_VAR_DIGITAL_READINGS to select pin
+/// readings.
+///
+/// The selected variables are read with as few "Get variables" commands as
+/// possible: variables that are next to each other or only separated by a few
+/// bytes are read together.  Variables that were not selected will be zero in
+/// the returned object.  If the mask does not select any variables, no
+/// commands are sent.
+///
+/// The flags parameter is the same as the flags parameter for
+/// jrk_get_variables().  If more than one command is needed, each flag that
+/// clears a variable is sent with the command that reads that variable, so
+/// the value returned includes everything that happened before it was
+/// cleared.  The other flags are sent with the last command.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_get_variables_masked(jrk_handle *, jrk_variables ** variables,
+  uint64_t mask, uint16_t flags);
+
+/// A mask for jrk_get_variables_masked() that selects every variable.
+#define JRK_VARIABLES_MASK_ALL (~(uint64_t)0)
+
+/// Reads the jrk's status variables into an existing variables object.
+///
+/// This is like jrk_get_variables(), but instead of allocating a new object, it
+/// overwrites the object you pass in.  The object can come from
+/// jrk_variables_create() or from an earlier call to jrk_get_variables().  By
+/// reusing the same object, a polling loop can read variables without any heap
+/// allocations.
+///
+/// If there is an error, the variables object is not modified.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_get_variables_into(jrk_handle *, jrk_variables * variables,
+  uint16_t flags);
+
+/// Reads some of the jrk's status variables into an existing variables object.
+///
+/// This is like jrk_get_variables_masked(), but it overwrites the object you
+/// pass in instead of allocating a new one.  Variables that were not selected
+/// by the mask keep the values they had before.
+///
+/// If there is an error, the variables object is not modified.
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_get_variables_masked_into(jrk_handle *,
+  jrk_variables * variables, uint64_t mask, uint16_t flags);
+
 /// Reads the specified bytes from the Jrk variables data structure.
 ///
 /// The index parameter specifies the address of the first byte to read, and the
@@ -2149,6 +2660,57 @@ jrk_error * jrk_get_eeprom_settings(jrk_handle *, jrk_settings ** settings);
 JRK_API JRK_WARN_UNUSED
 jrk_error * jrk_set_eeprom_settings(jrk_handle *, const jrk_settings *);
 
+/// Writes the jrk's non-volatile EEPROM settings, but only the bytes that are
+/// different from what is already stored in the EEPROM.
+///
+/// This function is like jrk_set_eeprom_settings() except that it first reads
+/// the current settings from the EEPROM and then only sends the bytes that
+/// need to change.  This is much faster if only a few settings changed, and it
+/// causes less wear on the jrk's EEPROM.
+///
+/// The optional bytes_written parameter is used to return the number of bytes
+/// that were written to the EEPROM.  If the settings on the device already
+/// match, this will be zero.
+///
+/// After calling this function, to make the settings actually take effect, you
+/// should call jrk_reinitialize().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_set_eeprom_settings_delta(jrk_handle *, const jrk_settings *,
+  size_t * bytes_written);
+
+/// The type of the progress callbacks that can be passed to
+/// jrk_apply_eeprom_settings().  The progress argument counts up to
+/// max_progress.  The user_data argument is the pointer that was passed to the
+/// function that calls the callback.
+typedef void jrk_progress_callback(void * user_data,
+  uint32_t progress, uint32_t max_progress);
+
+/// Writes the jrk's non-volatile EEPROM settings and then reads them back to
+/// verify that they were written correctly.
+///
+/// The jrk can only write one EEPROM byte per request, so this function
+/// minimizes the number of requests instead: it reads the current settings in
+/// one request, writes only the bytes that need to change (like
+/// jrk_set_eeprom_settings_delta()), and then reads all the settings back in
+/// one request and compares them to what it meant to write.
+///
+/// If the settings read back do not match, this function returns an error
+/// with the ::JRK_ERROR_VERIFY_FAILED code.
+///
+/// The callback argument is optional.  If it is not NULL, it is called after
+/// each request so you can display a progress bar.  Its max_progress argument
+/// is the number of requests needed, which is not known until the current
+/// settings have been read.
+///
+/// The optional bytes_written parameter is used to return the number of bytes
+/// that were written to the EEPROM.
+///
+/// After calling this function, to make the settings actually take effect, you
+/// should call jrk_reinitialize().
+JRK_API JRK_WARN_UNUSED
+jrk_error * jrk_apply_eeprom_settings(jrk_handle *, const jrk_settings *,
+  jrk_progress_callback * callback, void * user_data, size_t * bytes_written);
+
 /// Reads the jrk's RAM settings.
 ///
 /// The RAM settings are a copy of the jrk's settings that is stored
@@ -13,6 +13,7 @@
 
 #include "jrk.h"
 #include <cstddef>
+#include <functional>
 #include <utility>
 #include <memory>
 #include <string>
@@ -90,6 +91,36 @@ namespace jrk
     jrk_handle_close(p);
   }
 
+  /// Wrapper for jrk_serial_port_close().
+  inline void pointer_free(jrk_serial_port * p) noexcept
+  {
+    jrk_serial_port_close(p);
+  }
+
+  /// Wrapper for jrk_simulator_free().
+  inline void pointer_free(jrk_simulator * p) noexcept
+  {
+    jrk_simulator_free(p);
+  }
+
+  /// Wrapper for jrk_device_watch_free().
+  inline void pointer_free(jrk_device_watch * p) noexcept
+  {
+    jrk_device_watch_free(p);
+  }
+
+  /// Wrapper for jrk_recorder_free().
+  inline void pointer_free(jrk_recorder * p) noexcept
+  {
+    jrk_recorder_free(p);
+  }
+
+  /// Wrapper for jrk_recording_close().
+  inline void pointer_free(jrk_recording * p) noexcept
+  {
+    jrk_recording_close(p);
+  }
+
   /// This class is not part of the public API of the library and you should
   /// not use it directly, but you can use the public methods it provides to
   /// the classes that inherit from it.
@@ -1293,6 +1324,20 @@ namespace jrk
     {
     }
 
+    /// Wrapper for jrk_variables_create().
+    static variables create()
+    {
+      jrk_variables * p;
+      throw_if_needed(jrk_variables_create(&p));
+      return variables(p);
+    }
+
+    /// Wrapper for jrk_variables_read_from_buffer().
+    void read_from_buffer(const uint8_t * buffer) noexcept
+    {
+      jrk_variables_read_from_buffer(pointer, buffer);
+    }
+
     // Beginning of auto-generated variables C++ getters.
 
     /// Wrapper for jrk_variables_get_input().
@@ -1536,6 +1581,263 @@ namespace jrk
     return vector;
   }
 
+  /// Like list_connected_devices(), but each device's serial number, OS ID,
+  /// and firmware version are only read when you first ask for them.  See
+  /// jrk_list_connected_devices_lazy().
+  inline std::vector<jrk::device> list_connected_devices_lazy()
+  {
+    jrk_device ** device_list;
+    size_t size;
+    throw_if_needed(jrk_list_connected_devices_lazy(&device_list, &size));
+    std::vector<device> vector;
+    for (size_t i = 0; i < size; i++)
+    {
+      vector.push_back(device(device_list[i]));
+    }
+    jrk_list_free(device_list);
+    return vector;
+  }
+
+  /// Finds the connected jrk with the specified serial number, stopping at
+  /// the first match.  Returns a null device if there is none.
+  inline jrk::device find_device_by_serial_number(
+    const std::string & serial_number)
+  {
+    jrk_device * p;
+    throw_if_needed(jrk_find_device_by_serial_number(
+      serial_number.c_str(), &p));
+    return device(p);
+  }
+
+  /// Keeps an up-to-date list of the connected jrks.  Can also be in a null
+  /// state where it does not represent a device watch.
+  class device_watch : public unique_pointer_wrapper<jrk_device_watch>
+  {
+  public:
+    /// The type of callback that update() takes.  The event is one of the
+    /// JRK_DEVICE_EVENT_* macros.  It must not throw exceptions.
+    typedef std::function<void(uint8_t event, const jrk::device &)> callback;
+
+    /// Constructor that takes a pointer from the C API.  This object will free
+    /// the pointer when it is destroyed.
+    explicit device_watch(jrk_device_watch * p = NULL) noexcept
+      : unique_pointer_wrapper(p)
+    {
+    }
+
+    /// Wrapper for jrk_device_watch_create().
+    static device_watch create()
+    {
+      jrk_device_watch * p;
+      throw_if_needed(jrk_device_watch_create(&p));
+      return device_watch(p);
+    }
+
+    /// Wrapper for jrk_device_watch_has_notifications().
+    bool has_notifications() const noexcept
+    {
+      return jrk_device_watch_has_notifications(pointer);
+    }
+
+    /// Wrapper for jrk_device_watch_update().  Returns true if the list of
+    /// devices changed.
+    bool update(const callback & handler = nullptr)
+    {
+      bool changed;
+      throw_if_needed(jrk_device_watch_update(pointer,
+          handler ? call_callback : NULL, (void *)&handler, &changed));
+      return changed;
+    }
+
+    /// Wrapper for jrk_device_watch_get_devices().
+    std::vector<jrk::device> get_devices() const
+    {
+      jrk_device ** device_list;
+      size_t size;
+      throw_if_needed(jrk_device_watch_get_devices(pointer,
+          &device_list, &size));
+      std::vector<device> vector;
+      for (size_t i = 0; i < size; i++)
+      {
+        vector.push_back(device(device_list[i]));
+      }
+      jrk_list_free(device_list);
+      return vector;
+    }
+
+  private:
+    static void call_callback(void * user_data, uint8_t event,
+      const jrk_device * device)
+    {
+      jrk_device * copy;
+      jrk_error * error = jrk_device_copy(device, &copy);
+      if (error != NULL)
+      {
+        jrk_error_free(error);
+        return;
+      }
+      (*(const callback *)user_data)(event, jrk::device(copy));
+    }
+  };
+
+  /// Represents an open serial port that can be used to talk to jrks.  Can
+  /// also be in a null state where it does not represent a port.
+  class serial_port : public unique_pointer_wrapper<jrk_serial_port>
+  {
+  public:
+    /// Constructor that takes a pointer from the C API.  This object will free
+    /// the pointer when it is destroyed.
+    explicit serial_port(jrk_serial_port * p = NULL) noexcept
+      : unique_pointer_wrapper(p)
+    {
+    }
+
+    /// Wrapper for jrk_serial_port_open().
+    serial_port(const std::string & name, uint32_t baud_rate)
+    {
+      throw_if_needed(jrk_serial_port_open(name.c_str(), baud_rate, &pointer));
+    }
+
+    /// Closes the port and puts this object into the null state.
+    void close() noexcept
+    {
+      pointer_reset();
+    }
+  };
+
+  /// Represents a simulated jrk.  Can also be in a null state where it does
+  /// not represent a simulator.
+  class simulator : public unique_pointer_wrapper<jrk_simulator>
+  {
+  public:
+    /// Constructor that takes a pointer from the C API.  This object will free
+    /// the pointer when it is destroyed.
+    explicit simulator(jrk_simulator * p = NULL) noexcept
+      : unique_pointer_wrapper(p)
+    {
+    }
+
+    /// Wrapper for jrk_simulator_create().
+    simulator(uint8_t product, const std::string & serial_number)
+    {
+      throw_if_needed(jrk_simulator_create(product, serial_number.c_str(),
+        &pointer));
+    }
+
+    /// Wrapper for jrk_simulator_get_device().
+    jrk::device get_device() const
+    {
+      jrk_device * device;
+      throw_if_needed(jrk_simulator_get_device(pointer, &device));
+      return jrk::device(device);
+    }
+
+    /// Wrapper for jrk_simulator_set_real_time().
+    void set_real_time(bool real_time) noexcept
+    {
+      jrk_simulator_set_real_time(pointer, real_time);
+    }
+
+    /// Wrapper for jrk_simulator_advance().
+    void advance(uint32_t milliseconds) noexcept
+    {
+      jrk_simulator_advance(pointer, milliseconds);
+    }
+  };
+
+  /// Writes variables read from a jrk to a recording file.  Can also be in a
+  /// null state where it does not represent a recorder.
+  class recorder : public unique_pointer_wrapper<jrk_recorder>
+  {
+  public:
+    /// Constructor that takes a pointer from the C API.  This object will free
+    /// the pointer when it is destroyed.
+    explicit recorder(jrk_recorder * p = NULL) noexcept
+      : unique_pointer_wrapper(p)
+    {
+    }
+
+    /// Wrapper for jrk_recorder_create().
+    recorder(const std::string & filename, uint32_t flags)
+    {
+      throw_if_needed(jrk_recorder_create(filename.c_str(), flags, &pointer));
+    }
+
+    /// Wrapper for jrk_recorder_write().
+    void write(const uint8_t * buffer)
+    {
+      throw_if_needed(jrk_recorder_write(pointer, buffer));
+    }
+
+    /// Wrapper for jrk_recorder_flush().
+    void flush()
+    {
+      throw_if_needed(jrk_recorder_flush(pointer));
+    }
+
+    /// Wrapper for jrk_recorder_finish().
+    void finish()
+    {
+      throw_if_needed(jrk_recorder_finish(pointer));
+    }
+  };
+
+  /// Represents a recording file opened for reading.  Can also be in a null
+  /// state where it does not represent a recording.
+  class recording : public unique_pointer_wrapper<jrk_recording>
+  {
+  public:
+    /// Constructor that takes a pointer from the C API.  This object will free
+    /// the pointer when it is destroyed.
+    explicit recording(jrk_recording * p = NULL) noexcept
+      : unique_pointer_wrapper(p)
+    {
+    }
+
+    /// Wrapper for jrk_recording_open().
+    explicit recording(const std::string & filename)
+    {
+      throw_if_needed(jrk_recording_open(filename.c_str(), &pointer));
+    }
+
+    /// Wrapper for jrk_recording_get_record_count().
+    uint64_t get_record_count() const noexcept
+    {
+      return jrk_recording_get_record_count(pointer);
+    }
+
+    /// Wrapper for jrk_recording_seek().
+    void seek(uint64_t record)
+    {
+      throw_if_needed(jrk_recording_seek(pointer, record));
+    }
+
+    /// Wrapper for jrk_recording_seek_up_time().
+    void seek_up_time(uint32_t up_time)
+    {
+      throw_if_needed(jrk_recording_seek_up_time(pointer, up_time));
+    }
+
+    /// Wrapper for jrk_recording_read_buffer().  Returns false if there are no
+    /// more records.
+    bool read_buffer(uint8_t * buffer)
+    {
+      bool done;
+      throw_if_needed(jrk_recording_read_buffer(pointer, buffer, &done));
+      return !done;
+    }
+
+    /// Wrapper for jrk_recording_read_variables().  Returns false if there are
+    /// no more records.
+    bool read_variables(variables & vars)
+    {
+      bool done;
+      throw_if_needed(jrk_recording_read_variables(pointer,
+        vars.get_pointer(), &done));
+      return !done;
+    }
+  };
+
   /// Represents an open handle that can be used to read and write data from a
   /// device.  Can also be in a null state where it does not represent a handle.
   class handle : public unique_pointer_wrapper<jrk_handle>
@@ -1554,6 +1856,16 @@ namespace jrk
       throw_if_needed(jrk_handle_open(device.get_pointer(), &pointer));
     }
 
+    /// Constructor that opens a handle to a jrk on the specified serial port.
+    /// See jrk_handle_open_serial().  The port must stay open for as long as
+    /// this handle is open.
+    handle(const serial_port & port, uint16_t device_number, uint32_t flags,
+      uint8_t product = 0, uint16_t firmware_version = 0)
+    {
+      throw_if_needed(jrk_handle_open_serial(port.get_pointer(),
+          device_number, flags, product, firmware_version, &pointer));
+    }
+
     /// Closes the handle and puts this object into the null state.
     void close() noexcept
     {
@@ -1618,6 +1930,37 @@ namespace jrk
       return variables(v);
     }
 
+    /// Wrapper for jrk_get_variables_masked().
+    variables get_variables_masked(uint64_t mask, uint16_t flags)
+    {
+      jrk_variables * v;
+      throw_if_needed(jrk_get_variables_masked(pointer, &v, mask, flags));
+      return variables(v);
+    }
+
+    /// Wrapper for jrk_get_variables_into().
+    ///
+    /// Refreshes the specified variables object in place.  If the object is
+    /// null, it is created first, so the only heap allocation happens the first
+    /// time you pass a given object to this function.
+    void get_variables(variables & vars, uint16_t flags)
+    {
+      if (!vars.is_present()) { vars = variables::create(); }
+      throw_if_needed(jrk_get_variables_into(
+          pointer, vars.get_pointer(), flags));
+    }
+
+    /// Wrapper for jrk_get_variables_masked_into().
+    ///
+    /// Like get_variables(variables &, uint16_t), this refreshes the specified
+    /// variables object in place, creating it first if it is null.
+    void get_variables_masked(variables & vars, uint64_t mask, uint16_t flags)
+    {
+      if (!vars.is_present()) { vars = variables::create(); }
+      throw_if_needed(jrk_get_variables_masked_into(
+          pointer, vars.get_pointer(), mask, flags));
+    }
+
     /// Wrapper for jrk_get_variable_segment().
     void get_variable_segment(size_t index, size_t length,
       uint8_t * output, uint16_t flags)
@@ -1634,12 +1977,58 @@ namespace jrk
       return settings(s);
     }
 
+    /// Wrapper for jrk_handle_is_alive().
+    bool is_alive() noexcept
+    {
+      return jrk_handle_is_alive(pointer);
+    }
+
+    /// Wrapper for jrk_handle_set_settings_cache_enabled().
+    void set_settings_cache_enabled(bool enabled) noexcept
+    {
+      jrk_handle_set_settings_cache_enabled(pointer, enabled);
+    }
+
+    /// Wrapper for jrk_handle_get_settings_generation().
+    uint32_t get_settings_generation() const noexcept
+    {
+      return jrk_handle_get_settings_generation(pointer);
+    }
+
     /// Wrapper for jrk_set_eeprom_settings().
     void set_eeprom_settings(const settings & settings)
     {
       throw_if_needed(jrk_set_eeprom_settings(pointer, settings.get_pointer()));
     }
 
+    /// Wrapper for jrk_set_eeprom_settings_delta().  Returns the number of
+    /// bytes written.
+    size_t set_eeprom_settings_delta(const settings & settings)
+    {
+      size_t bytes_written;
+      throw_if_needed(jrk_set_eeprom_settings_delta(
+          pointer, settings.get_pointer(), &bytes_written));
+      return bytes_written;
+    }
+
+    /// The type of the progress callbacks that can be passed to
+    /// apply_eeprom_settings().
+    typedef std::function<void(uint32_t progress, uint32_t max_progress)>
+      progress_callback;
+
+    /// Wrapper for jrk_apply_eeprom_settings().  Returns the number of bytes
+    /// written.  The callback must not throw exceptions because it is called
+    /// from C code.
+    size_t apply_eeprom_settings(const settings & settings,
+      progress_callback callback = progress_callback())
+    {
+      size_t bytes_written;
+      throw_if_needed(jrk_apply_eeprom_settings(pointer,
+          settings.get_pointer(), callback ? call_progress_callback : NULL,
+          &callback, &bytes_written));
+      return bytes_written;
+    }
+
     /// Wrapper for jrk_get_ram_settings().
     settings get_ram_settings()
     {
@@ -1702,6 +2091,13 @@ namespace jrk
       data.resize(size);
     }
     /// \endcond
+
+  private:
+    static void call_progress_callback(void * user_data,
+      uint32_t progress, uint32_t max_progress)
+    {
+      (*(progress_callback *)user_data)(progress, max_progress);
+    }
   };
 
   /// Wrapper for jrk_get_recommended_encoded_hard_current_limits().
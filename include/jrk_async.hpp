@@ -0,0 +1,281 @@
+// Copyright (C) Pololu Corporation.  See www.pololu.com for details.
+
+/// \file jrk_async.hpp
+///
+/// This file provides a C++ class that performs I/O for a jrk handle on a
+/// dedicated thread so that the calling thread never has to wait for USB
+/// transfers to complete.  It is built on top of the C++ API in jrk.hpp.
+///
+/// Using this header requires your program to be linked with a threading
+/// library (e.g. -pthread).
+
+#pragma once
+
+#include "jrk.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+
+namespace jrk
+{
+  /// A fixed-capacity queue for passing objects from exactly one producer
+  /// thread to exactly one consumer thread without locking.
+  template <class T, size_t capacity>
+  class spsc_ring
+  {
+  public:
+    /// Adds an item to the queue.  Returns false if the queue is full, in
+    /// which case the item is not moved.  Should only be called from the
+    /// producer thread.
+    bool push(T && item)
+    {
+      size_t h = head.load(std::memory_order_relaxed);
+      size_t next = advance(h);
+      if (next == tail.load(std::memory_order_acquire))
+      {
+        return false;
+      }
+      slots[h] = std::move(item);
+      head.store(next, std::memory_order_release);
+      return true;
+    }
+
+    /// Removes the oldest item from the queue and moves it into the item
+    /// parameter.  Returns false if the queue is empty.  Should only be called
+    /// from the consumer thread.
+    bool pop(T & item)
+    {
+      size_t t = tail.load(std::memory_order_relaxed);
+      if (t == head.load(std::memory_order_acquire))
+      {
+        return false;
+      }
+      item = std::move(slots[t]);
+      tail.store(advance(t), std::memory_order_release);
+      return true;
+    }
+
+    /// Returns true if the queue is empty.  The answer might be out of date by
+    /// the time the caller looks at it if the other thread is active.
+    bool empty() const
+    {
+      return head.load(std::memory_order_acquire) ==
+        tail.load(std::memory_order_acquire);
+    }
+
+  private:
+    // One slot is always left empty so we can tell a full queue from an empty
+    // one.
+    static const size_t slot_count = capacity + 1;
+
+    static size_t advance(size_t index)
+    {
+      return index + 1 == slot_count ? 0 : index + 1;
+    }
+
+    T slots[slot_count];
+    std::atomic<size_t> head { 0 };
+    std::atomic<size_t> tail { 0 };
+  };
+
+  /// The result of an asynchronous request for the jrk's variables.
+  struct async_variables_result
+  {
+    /// The sequence number returned by async_handle::request_variables().
+    uint32_t sequence = 0;
+
+    /// The variables that were read, or a null object if there was an error.
+    jrk::variables variables;
+
+    /// The error that happened, or a null object if the read was successful.
+    jrk::error error;
+
+    /// The time when the transfer finished.
+    std::chrono::steady_clock::time_point time;
+
+    /// Returns true if the variables were read successfully.
+    bool success() const noexcept
+    {
+      return !error.is_present();
+    }
+  };
+
+  /// Owns a jrk::handle and does all I/O for it on a dedicated thread.
+  ///
+  /// Requests are queued and performed in order.  The jrk's USB interface only
+  /// processes one control transfer at a time, so queuing several requests
+  /// keeps the I/O thread busy and lets the caller get on with other work, but
+  /// it does not make any single request finish sooner.
+  ///
+  /// Results of variable reads are delivered either to a callback (which runs
+  /// on the I/O thread) or, if no callback was given, to a lock-free queue that
+  /// can be read by one consumer thread with try_get_variables().
+  class async_handle
+  {
+  public:
+    /// The type of the callbacks that can be passed to request_variables().
+    typedef std::function<void(async_variables_result &)> variables_callback;
+
+    /// The number of results that can be waiting in the queue read by
+    /// try_get_variables().  If the queue is full, new results are dropped and
+    /// counted by get_dropped_count().
+    static const size_t result_capacity = 64;
+
+    /// Takes ownership of the specified handle and starts the I/O thread.
+    explicit async_handle(jrk::handle && handle)
+      : handle(std::move(handle)),
+        thread(&async_handle::run, this)
+    {
+    }
+
+    /// Finishes any queued requests and stops the I/O thread.
+    ~async_handle() noexcept
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+      }
+      work_ready.notify_one();
+      thread.join();
+    }
+
+    async_handle(const async_handle &) = delete;
+    async_handle & operator=(const async_handle &) = delete;
+
+    /// Queues a "Get variables" request with the specified flags (see
+    /// jrk_get_variables()) and returns a sequence number that will be stored
+    /// in the result.
+    ///
+    /// If a callback is specified, it will be called on the I/O thread when the
+    /// request finishes.  Otherwise, the result will be put in a queue that you
+    /// can read with try_get_variables().
+    uint32_t request_variables(uint16_t flags,
+      variables_callback callback = variables_callback())
+    {
+      uint32_t sequence = ++last_sequence;
+      post([this, flags, sequence, callback](jrk::handle & h)
+      {
+        async_variables_result result;
+        result.sequence = sequence;
+        try
+        {
+          result.variables = h.get_variables(flags);
+        }
+        catch (const jrk::error & e)
+        {
+          result.error = e;
+        }
+        result.time = std::chrono::steady_clock::now();
+
+        if (callback)
+        {
+          callback(result);
+        }
+        else if (!results.push(std::move(result)))
+        {
+          dropped_count++;
+        }
+      });
+      return sequence;
+    }
+
+    /// Gets the oldest result from the queue of finished variable reads that
+    /// were requested without a callback.  Returns false if there are no
+    /// results.  Only one thread should call this.
+    bool try_get_variables(async_variables_result & result)
+    {
+      return results.pop(result);
+    }
+
+    /// Queues a job that will be run on the I/O thread with exclusive access to
+    /// the handle.  You can use this to send any command supported by
+    /// jrk::handle without blocking the calling thread.  Exceptions thrown by
+    /// the job are caught and ignored, so the job should catch any exceptions
+    /// it cares about.
+    void post(std::function<void(jrk::handle &)> job)
+    {
+      {
+        std::lock_guard<std::mutex> lock(mutex);
+        queue.push_back(std::move(job));
+      }
+      work_ready.notify_one();
+    }
+
+    /// Returns the number of jobs that are queued or running.
+    size_t get_pending_count()
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return queue.size() + (busy ? 1 : 0);
+    }
+
+    /// Blocks until all queued jobs have finished.
+    void wait_until_idle()
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      idle.wait(lock, [this] { return queue.empty() && !busy; });
+    }
+
+    /// Returns the number of results that were dropped because the result
+    /// queue was full.
+    uint32_t get_dropped_count() const noexcept
+    {
+      return dropped_count;
+    }
+
+  private:
+    void run()
+    {
+      std::unique_lock<std::mutex> lock(mutex);
+      while (true)
+      {
+        work_ready.wait(lock, [this] { return stopping || !queue.empty(); });
+        if (queue.empty())
+        {
+          // We are stopping and there is nothing left to do.
+          return;
+        }
+
+        std::function<void(jrk::handle &)> job = std::move(queue.front());
+        queue.pop_front();
+        busy = true;
+        lock.unlock();
+
+        try
+        {
+          job(handle);
+        }
+        catch (...)
+        {
+        }
+
+        lock.lock();
+        busy = false;
+        if (queue.empty())
+        {
+          idle.notify_all();
+        }
+      }
+    }
+
+    jrk::handle handle;
+
+    std::mutex mutex;
+    std::condition_variable work_ready;
+    std::condition_variable idle;
+    std::deque<std::function<void(jrk::handle &)>> queue;
+    bool stopping = false;
+    bool busy = false;
+
+    std::atomic<uint32_t> last_sequence { 0 };
+    std::atomic<uint32_t> dropped_count { 0 };
+    spsc_ring<async_variables_result, result_capacity> results;
+
+    // This is last so that the other members are initialized before the
+    // thread starts.
+    std::thread thread;
+  };
+}
@@ -0,0 +1,258 @@
+// Copyright (C) Pololu Corporation.  See www.pololu.com for details.
+
+/// \file jrk_batch.hpp
+///
+/// This file provides C++ functions and classes for sending a precisely timed
+/// sequence of motion commands to a jrk, such as a trajectory that is made of
+/// many "Set target" commands.  It is built on top of the C++ API in jrk.hpp.
+///
+/// Using this header requires your program to be linked with a threading
+/// library (e.g. -pthread).
+
+#pragma once
+
+#include "jrk.hpp"
+#include "jrk_schedule.hpp"
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace jrk
+{
+  /// The types of commands that can be part of a batch.
+  enum class batch_command_type
+  {
+    /// Calls jrk::handle::set_target() with the command's value.
+    set_target,
+
+    /// Calls jrk::handle::force_duty_cycle_target() with the command's value.
+    force_duty_cycle_target,
+
+    /// Calls jrk::handle::force_duty_cycle() with the command's value.
+    force_duty_cycle,
+
+    /// Calls jrk::handle::stop_motor().  The command's value is ignored.
+    stop_motor,
+  };
+
+  /// One command in a batch.
+  struct batch_command
+  {
+    batch_command_type type;
+
+    /// The target or duty cycle.
+    int16_t value;
+
+    /// The time between when the previous command was scheduled to be sent
+    /// and when this command should be sent.  For the first command, this is
+    /// measured from when the batch starts.
+    std::chrono::microseconds delay;
+  };
+
+  /// The outcome of one command in a batch.
+  struct batch_command_result
+  {
+    /// True if the command was sent.  It is false if the batch was cancelled
+    /// or stopped because of an error before this command's turn.
+    bool sent = false;
+
+    /// When the command was supposed to be sent.
+    std::chrono::steady_clock::time_point scheduled_time;
+
+    /// When we started and finished sending the command.
+    std::chrono::steady_clock::time_point start_time;
+    std::chrono::steady_clock::time_point end_time;
+
+    /// The error that happened, or a null object if the command succeeded or
+    /// was not sent.
+    jrk::error error;
+
+    /// Returns true if the command was sent successfully.
+    bool success() const noexcept
+    {
+      return sent && !error.is_present();
+    }
+
+    /// Returns how late the command was sent.
+    std::chrono::steady_clock::duration get_lateness() const noexcept
+    {
+      return start_time - scheduled_time;
+    }
+  };
+
+  /// Options for run_batch() and jrk::batch_runner.
+  struct batch_options
+  {
+    /// If true, the batch stops at the first command that fails.
+    bool stop_on_error = true;
+
+    /// If true, a "Stop motor" command is sent if the batch is cancelled or
+    /// stopped because of an error.
+    bool stop_motor_on_abort = false;
+
+    /// How long to busy-wait before each command is due.  See
+    /// jrk::wait_for_deadline().
+    std::chrono::microseconds spin_time { 0 };
+  };
+
+  namespace internal
+  {
+    inline void send_batch_command(jrk::handle & handle,
+      const batch_command & command)
+    {
+      switch (command.type)
+      {
+      case batch_command_type::set_target:
+        handle.set_target(command.value);
+        break;
+      case batch_command_type::force_duty_cycle_target:
+        handle.force_duty_cycle_target(command.value);
+        break;
+      case batch_command_type::force_duty_cycle:
+        handle.force_duty_cycle(command.value);
+        break;
+      case batch_command_type::stop_motor:
+        handle.stop_motor();
+        break;
+      }
+    }
+  }
+
+  /// Sends the specified commands to the jrk on the calling thread, waiting
+  /// the specified delay before each one, and returns a result for each
+  /// command.
+  ///
+  /// Commands are scheduled on absolute deadlines computed from the start of
+  /// the batch, so the time it takes to send each command does not accumulate
+  /// into the schedule.  If a command is late, it is sent right away and the
+  /// lateness is recorded in its result.
+  ///
+  /// If cancel is not NULL, the batch stops as soon as another thread sets it
+  /// to true.
+  ///
+  /// You can call this from a job passed to jrk::async_handle::post() to run a
+  /// batch on an async_handle's I/O thread.
+  inline std::vector<batch_command_result> run_batch(jrk::handle & handle,
+    const std::vector<batch_command> & commands,
+    const batch_options & options = batch_options(),
+    const std::atomic<bool> * cancel = NULL)
+  {
+    typedef std::chrono::steady_clock clock;
+
+    std::vector<batch_command_result> results(commands.size());
+    bool aborted = false;
+
+    clock::time_point deadline = clock::now();
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+      deadline += commands[i].delay;
+      results[i].scheduled_time = deadline;
+
+      if (!wait_for_deadline(deadline, options.spin_time, cancel))
+      {
+        aborted = true;
+        break;
+      }
+
+      results[i].sent = true;
+      results[i].start_time = clock::now();
+      try
+      {
+        internal::send_batch_command(handle, commands[i]);
+      }
+      catch (const jrk::error & e)
+      {
+        results[i].error = e;
+      }
+      results[i].end_time = clock::now();
+
+      if (results[i].error.is_present() && options.stop_on_error)
+      {
+        aborted = true;
+        break;
+      }
+    }
+
+    if (aborted && options.stop_motor_on_abort)
+    {
+      try
+      {
+        handle.stop_motor();
+      }
+      catch (const jrk::error &)
+      {
+      }
+    }
+
+    return results;
+  }
+
+  /// Runs a batch of commands with run_batch() on a dedicated thread.
+  ///
+  /// The handle is borrowed, not owned: it must stay open until the batch is
+  /// done, and no other thread should use it in the meantime.
+  class batch_runner
+  {
+  public:
+    /// Starts sending the specified commands.
+    batch_runner(jrk::handle & handle, std::vector<batch_command> commands,
+      const batch_options & options = batch_options())
+      : handle(handle),
+        commands(std::move(commands)),
+        options(options),
+        thread(&batch_runner::run, this)
+    {
+    }
+
+    /// Cancels the batch if it is still running and waits for the thread to
+    /// stop.
+    ~batch_runner() noexcept
+    {
+      cancel();
+      if (thread.joinable()) { thread.join(); }
+    }
+
+    batch_runner(const batch_runner &) = delete;
+    batch_runner & operator=(const batch_runner &) = delete;
+
+    /// Asks the thread to stop before sending any more commands.
+    void cancel() noexcept
+    {
+      cancelled = true;
+    }
+
+    /// Returns true if the batch has finished, been cancelled, or stopped
+    /// because of an error.
+    bool is_done() const noexcept
+    {
+      return done;
+    }
+
+    /// Waits for the batch to finish and returns the result for each command.
+    /// Only one thread should call this.
+    const std::vector<batch_command_result> & wait()
+    {
+      if (thread.joinable()) { thread.join(); }
+      return results;
+    }
+
+  private:
+    void run()
+    {
+      results = run_batch(handle, commands, options, &cancelled);
+      done = true;
+    }
+
+    jrk::handle & handle;
+    const std::vector<batch_command> commands;
+    const batch_options options;
+    std::vector<batch_command_result> results;
+    std::atomic<bool> cancelled { false };
+    std::atomic<bool> done { false };
+
+    // This is last so that the other members are initialized before the
+    // thread starts.
+    std::thread thread;
+  };
+}
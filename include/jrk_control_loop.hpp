@@ -0,0 +1,462 @@
+// Copyright (C) Pololu Corporation.  See www.pololu.com for details.
+
+/// \file jrk_control_loop.hpp
+///
+/// This file provides a C++ class for running a control loop on the computer
+/// that reads variables from a jrk and sends it a new target or duty cycle at
+/// a fixed rate, along with a simple PID controller to use in the loop.  It is
+/// built on top of the C++ API in jrk.hpp.
+///
+/// Using this header requires your program to be linked with a threading
+/// library (e.g. -pthread).
+
+#pragma once
+
+#include "jrk.hpp"
+#include "jrk_schedule.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace jrk
+{
+  /// The command that jrk::control_loop sends after each tick.
+  enum class control_output
+  {
+    /// Calls jrk::handle::set_target().  The output is limited to 0 to 4095.
+    target,
+
+    /// Calls jrk::handle::force_duty_cycle_target().  The output is limited to
+    /// -600 to 600.
+    force_duty_cycle_target,
+
+    /// Calls jrk::handle::force_duty_cycle().  The output is limited to -600
+    /// to 600.
+    force_duty_cycle,
+  };
+
+  /// Information about one tick of a jrk::control_loop that is passed to its
+  /// control function.
+  struct control_tick
+  {
+    /// The number of ticks before this one.
+    uint64_t index;
+
+    /// The time since the previous tick's variables were read, or zero for the
+    /// first tick.  Use this instead of the loop's period in a derivative or
+    /// integral term so that late ticks are handled correctly.
+    std::chrono::microseconds dt;
+
+    /// The value most recently passed to jrk::control_loop::set_setpoint().
+    int32_t setpoint;
+  };
+
+  /// A function that jrk::control_loop calls on each tick with the variables
+  /// it just read.  It returns the target or duty cycle to send.  It runs on
+  /// the loop's thread, so it should be quick and must not throw exceptions.
+  typedef std::function<int32_t(const jrk::variables &, const control_tick &)>
+    control_function;
+
+  /// The gains for jrk::pid_control().
+  struct pid_gains
+  {
+    /// The output is proportional * error + integral * (sum of error * dt) +
+    /// derivative * (change in error / dt), where dt is in seconds and the
+    /// error is the setpoint minus the scaled feedback.
+    double proportional = 0;
+    double integral = 0;
+    double derivative = 0;
+
+    /// The integral term is kept between -integral_limit and integral_limit
+    /// so that it does not grow without bound while the output is saturated.
+    double integral_limit = 600;
+  };
+
+  /// Returns a control function that runs a PID controller on the jrk's
+  /// scaled feedback variable, trying to make it equal the loop's setpoint.
+  /// Remember to select JRK_VAR_SCALED_FEEDBACK in the loop's variable mask.
+  inline control_function pid_control(const pid_gains & gains)
+  {
+    double integral_term = 0;
+    double last_error = 0;
+    return [=](const jrk::variables & vars, const control_tick & tick) mutable
+    {
+      double error = (double)tick.setpoint - vars.get_scaled_feedback();
+      double dt = tick.dt.count() / 1e6;
+
+      double derivative_term = 0;
+      if (dt > 0)
+      {
+        integral_term += gains.integral * error * dt;
+        integral_term = std::max(-gains.integral_limit,
+          std::min(gains.integral_limit, integral_term));
+        derivative_term = gains.derivative * (error - last_error) / dt;
+      }
+      last_error = error;
+
+      double output = gains.proportional * error + integral_term +
+        derivative_term;
+      output = std::max<double>(INT32_MIN, std::min<double>(INT32_MAX, output));
+      return (int32_t)(output < 0 ? output - 0.5 : output + 0.5);
+    };
+  }
+
+  /// Options for jrk::control_loop.
+  struct control_loop_options
+  {
+    /// The time between the starts of two consecutive ticks.  Zero means run
+    /// the ticks back to back as fast as possible.
+    std::chrono::microseconds period { 10000 };
+
+    /// The variables to read on each tick.  See jrk_get_variables_masked().
+    /// Reading fewer variables makes each tick faster.
+    uint64_t mask = 1ULL << JRK_VAR_SCALED_FEEDBACK;
+
+    /// The flags to pass when reading variables.  See jrk_get_variables().
+    uint16_t flags = 0;
+
+    /// The command to send with the output of the control function.
+    control_output output = control_output::force_duty_cycle;
+
+    /// How long to busy-wait before each tick is due.  See
+    /// jrk::wait_for_deadline().
+    std::chrono::microseconds spin_time { 0 };
+
+    /// If true, the loop's thread asks for the SCHED_FIFO real-time scheduling
+    /// policy, so other programs cannot delay it.  This only works on Linux,
+    /// and usually requires root privileges or the CAP_SYS_NICE capability;
+    /// see jrk::control_loop_stats::realtime to find out if it worked.
+    bool realtime = false;
+
+    /// The SCHED_FIFO priority to use if realtime is true.
+    int realtime_priority = 50;
+
+    /// If true, the loop stops at the first error.  Otherwise, it counts the
+    /// error and tries again on the next tick.
+    bool stop_on_error = true;
+
+    /// If true, a "Stop motor" command is sent when the loop stops.
+    bool stop_motor_on_exit = true;
+
+    /// The width of each bucket in the histograms in jrk::control_loop_stats.
+    std::chrono::microseconds histogram_bucket_width { 50 };
+
+    /// The number of buckets in each histogram.  Times too long for the last
+    /// bucket are counted in it.
+    size_t histogram_bucket_count = 200;
+  };
+
+  /// A histogram of durations, used by jrk::control_loop_stats.
+  struct control_histogram
+  {
+    /// The width of each bucket.
+    std::chrono::microseconds bucket_width { 1 };
+
+    /// The number of durations in each bucket.  Bucket i holds the durations
+    /// from i * bucket_width up to (i + 1) * bucket_width, except that the
+    /// last bucket also holds everything longer.
+    std::vector<uint64_t> counts;
+
+    /// The number of durations recorded.
+    uint64_t total = 0;
+
+    /// The sum of the durations recorded, for computing the mean.
+    std::chrono::microseconds sum { 0 };
+
+    /// The longest duration recorded.
+    std::chrono::microseconds max { 0 };
+
+    /// Adds a duration.  Negative durations are counted as zero.
+    void add(std::chrono::microseconds duration)
+    {
+      if (duration.count() < 0) { duration = std::chrono::microseconds(0); }
+      size_t bucket = duration.count() / bucket_width.count();
+      counts[std::min(bucket, counts.size() - 1)]++;
+      total++;
+      sum += duration;
+      max = std::max(max, duration);
+    }
+
+    /// Returns the mean of the durations, or zero if there are none.
+    std::chrono::microseconds mean() const
+    {
+      if (total == 0) { return std::chrono::microseconds(0); }
+      return sum / (int64_t)total;
+    }
+
+    /// Returns the upper edge of the bucket that holds the specified fraction
+    /// (between 0 and 1) of the durations, so percentile(0.99) is at least as
+    /// long as 99% of the durations.
+    std::chrono::microseconds percentile(double fraction) const
+    {
+      uint64_t needed = (uint64_t)(fraction * total + 0.5);
+      uint64_t seen = 0;
+      for (size_t i = 0; i < counts.size(); i++)
+      {
+        seen += counts[i];
+        if (seen >= needed && seen != 0)
+        {
+          return std::min(max, bucket_width * (int64_t)(i + 1));
+        }
+      }
+      return max;
+    }
+  };
+
+  /// Statistics about how well a jrk::control_loop is keeping to its schedule.
+  struct control_loop_stats
+  {
+    /// The number of ticks that have finished.
+    uint64_t ticks = 0;
+
+    /// The number of ticks that had an error.
+    uint64_t errors = 0;
+
+    /// The number of ticks that were skipped because the previous tick ran
+    /// past their deadlines.
+    uint64_t missed_deadlines = 0;
+
+    /// True if the loop's thread got the SCHED_FIFO scheduling policy.
+    bool realtime = false;
+
+    /// For each tick, how long after its deadline the thread woke up.  This
+    /// measures the operating system's scheduling jitter.
+    control_histogram wake_jitter;
+
+    /// For each tick, the time from its deadline until the command was sent,
+    /// which includes reading the variables and running the control function.
+    /// This is the delay between when the loop was supposed to sample the jrk
+    /// and when its response took effect.
+    control_histogram latency;
+  };
+
+  /// Runs a control loop on a dedicated thread.  On each tick, it reads the
+  /// selected variables from the jrk, passes them to a control function such
+  /// as the one returned by jrk::pid_control(), and sends the function's
+  /// output to the jrk.
+  ///
+  /// Ticks are scheduled with a jrk::periodic_schedule, so a tick that runs
+  /// past the next deadline makes the loop skip the deadlines it missed.
+  ///
+  /// The handle is borrowed in the same way as for jrk::batch_runner.
+  ///
+  /// The loop's thread never waits for a lock held by another thread, so
+  /// reading the statistics cannot delay a tick.  The loop publishes a copy of
+  /// its statistics after each tick unless a reader is holding the lock at that
+  /// moment, so get_stats() can be a tick behind while the loop is running.
+  class control_loop
+  {
+  public:
+    /// Starts the loop.
+    control_loop(jrk::handle & handle, control_function function,
+      const control_loop_options & options = control_loop_options())
+      : handle(handle),
+        function(std::move(function)),
+        options(options)
+    {
+      stats.wake_jitter.bucket_width = std::max(
+        options.histogram_bucket_width, std::chrono::microseconds(1));
+      stats.wake_jitter.counts.resize(
+        std::max<size_t>(options.histogram_bucket_count, 1));
+      stats.latency = stats.wake_jitter;
+      published_stats = stats;
+      thread = std::thread(&control_loop::run, this);
+    }
+
+    /// Stops the loop and waits for the thread to finish.
+    ~control_loop() noexcept
+    {
+      stop();
+    }
+
+    control_loop(const control_loop &) = delete;
+    control_loop & operator=(const control_loop &) = delete;
+
+    /// Changes the setpoint passed to the control function.  This can be
+    /// called from any thread.
+    void set_setpoint(int32_t setpoint) noexcept
+    {
+      this->setpoint = setpoint;
+    }
+
+    /// Stops the loop and waits for the thread to finish.  Only one thread
+    /// should call this.
+    void stop() noexcept
+    {
+      stopping = true;
+      if (thread.joinable()) { thread.join(); }
+    }
+
+    /// Returns true if the loop has stopped, either because stop() was called
+    /// or because of an error.
+    bool is_done() const noexcept
+    {
+      return done;
+    }
+
+    /// Returns a copy of the loop's statistics so far.  This can be called
+    /// from any thread.  The statistics are complete once the loop is done.
+    control_loop_stats get_stats() const
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return published_stats;
+    }
+
+    /// Returns the most recent error, or a null object if there has not been
+    /// one.  This can be called from any thread.
+    jrk::error get_last_error() const
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      return published_error;
+    }
+
+  private:
+    typedef std::chrono::steady_clock clock;
+
+    static std::chrono::microseconds to_us(clock::duration d)
+    {
+      return std::chrono::duration_cast<std::chrono::microseconds>(d);
+    }
+
+    bool set_realtime()
+    {
+#ifdef __linux__
+      sched_param param = {};
+      param.sched_priority = options.realtime_priority;
+      return pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+#else
+      return false;
+#endif
+    }
+
+    void send(int32_t output)
+    {
+      switch (options.output)
+      {
+      case control_output::target:
+        handle.set_target(std::max(0, std::min(4095, output)));
+        break;
+      case control_output::force_duty_cycle_target:
+        handle.force_duty_cycle_target(std::max(-600, std::min(600, output)));
+        break;
+      case control_output::force_duty_cycle:
+        handle.force_duty_cycle(std::max(-600, std::min(600, output)));
+        break;
+      }
+    }
+
+    // Copies the statistics and the last error to where the other threads
+    // read them.  If block is false and a reader holds the lock, this does
+    // nothing and the next call catches up.
+    void publish(bool block)
+    {
+      std::unique_lock<std::mutex> lock(mutex, std::defer_lock);
+      if (block) { lock.lock(); }
+      else if (!lock.try_lock()) { return; }
+
+      // Copying into vectors of the same size does not allocate memory.
+      published_stats = stats;
+      if (error_changed)
+      {
+        published_error = last_error;
+        error_changed = false;
+      }
+    }
+
+    void run()
+    {
+      if (options.realtime) { stats.realtime = set_realtime(); }
+
+      jrk::variables vars = jrk::variables::create();
+      control_tick tick = {};
+      clock::time_point last_read_time;
+      periodic_schedule schedule(options.period);
+
+      while (wait_for_deadline(schedule.get_deadline(), options.spin_time,
+          &stopping))
+      {
+        clock::time_point wake_time = clock::now();
+
+        jrk::error error;
+        try
+        {
+          handle.get_variables_masked(vars, options.mask, options.flags);
+          clock::time_point read_time = clock::now();
+          tick.dt = tick.index == 0 ? std::chrono::microseconds(0) :
+            to_us(read_time - last_read_time);
+          last_read_time = read_time;
+          tick.setpoint = setpoint;
+
+          send(function(vars, tick));
+        }
+        catch (const jrk::error & e)
+        {
+          error = e;
+        }
+        clock::time_point end_time = clock::now();
+        tick.index++;
+
+        const clock::time_point tick_deadline = schedule.get_deadline();
+        stats.missed_deadlines += schedule.advance(end_time);
+        stats.ticks++;
+        stats.wake_jitter.add(to_us(wake_time - tick_deadline));
+        if (error.is_present())
+        {
+          stats.errors++;
+          last_error = error;
+          error_changed = true;
+        }
+        else
+        {
+          stats.latency.add(to_us(end_time - tick_deadline));
+        }
+        publish(false);
+
+        if (error.is_present() && options.stop_on_error) { break; }
+      }
+      publish(true);
+
+      if (options.stop_motor_on_exit)
+      {
+        try
+        {
+          handle.stop_motor();
+        }
+        catch (const jrk::error &)
+        {
+        }
+      }
+
+      done = true;
+    }
+
+    jrk::handle & handle;
+    control_function function;
+    const control_loop_options options;
+
+    std::atomic<int32_t> setpoint { 0 };
+    std::atomic<bool> stopping { false };
+    std::atomic<bool> done { false };
+
+    // Only the loop's thread uses these.
+    control_loop_stats stats;
+    jrk::error last_error;
+    bool error_changed = false;
+
+    // The copies that the other threads read, protected by the mutex.
+    mutable std::mutex mutex;
+    control_loop_stats published_stats;
+    jrk::error published_error;
+
+    std::thread thread;
+  };
+}
@@ -0,0 +1,265 @@
+// Copyright (C) Pololu Corporation.  See www.pololu.com for details.
+
+/// \file jrk_history.hpp
+///
+/// This file provides a C++ class that keeps a fixed-size history of the
+/// variables read from a jrk, which one thread can add to while any number of
+/// other threads read from it without locking.  It is built on top of the C++
+/// API in jrk.hpp.
+
+#pragma once
+
+#include "jrk.hpp"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace jrk
+{
+  /// One set of variables stored in a jrk::history.
+  struct history_sample
+  {
+    /// The position of this sample in the history: the first sample added to
+    /// the history has index 0, the next one has index 1, and so on.
+    uint64_t index = 0;
+
+    /// The variables, in the same format as the buffer passed to
+    /// jrk::history::push().
+    uint8_t buffer[JRK_VARIABLES_SIZE] = { 0 };
+
+    /// Returns the up_time variable of the sample.
+    uint32_t get_up_time() const noexcept
+    {
+      return buffer[JRK_VAR_UP_TIME + 0] |
+        (uint32_t)buffer[JRK_VAR_UP_TIME + 1] << 8 |
+        (uint32_t)buffer[JRK_VAR_UP_TIME + 2] << 16 |
+        (uint32_t)buffer[JRK_VAR_UP_TIME + 3] << 24;
+    }
+
+    /// Decodes the sample into a variables object so you can use its getters.
+    /// Creates the object if it is null.
+    void decode(jrk::variables & vars) const
+    {
+      if (!vars.is_present()) { vars = jrk::variables::create(); }
+      vars.read_from_buffer(buffer);
+    }
+  };
+
+  /// A fixed-capacity ring of the most recent sets of variables read from a
+  /// jrk.  One thread, the writer, adds samples with push(), and once the
+  /// history is full each new sample replaces the oldest one.  Any number of
+  /// other threads can read samples at the same time.
+  ///
+  /// This lets several consumers, such as a graph and a logger, share one
+  /// stream of variables instead of each keeping its own copy or reading the
+  /// device separately.  jrk::poller can fill a history for each device (see
+  /// poller_options::history_capacity).
+  ///
+  /// Neither side ever takes a lock or waits for the other.  push() takes
+  /// constant time no matter how many readers there are.  Readers check that a
+  /// sample was not overwritten while they were copying it, and samples that
+  /// were overwritten are skipped instead of being copied again, so a reader
+  /// that falls more than capacity samples behind loses the oldest ones
+  /// instead of slowing down the writer.  Every reading function finishes in a
+  /// bounded number of steps.
+  ///
+  /// The time-range functions assume that the up_time variable increases from
+  /// each sample to the next, which is true unless the jrk resets.
+  class history
+  {
+  public:
+    /// Creates an empty history that can hold the specified number of
+    /// samples, which must be at least 1.
+    explicit history(size_t capacity)
+      : capacity(capacity ? capacity : 1),
+        slots(new slot[capacity ? capacity : 1])
+    {
+    }
+
+    history(const history &) = delete;
+    history & operator=(const history &) = delete;
+
+    /// Returns the maximum number of samples the history can hold.
+    size_t get_capacity() const noexcept
+    {
+      return capacity;
+    }
+
+    /// Adds a sample.  The buffer must be JRK_VARIABLES_SIZE bytes long and
+    /// have the same layout as the jrk's variables, like the buffers filled by
+    /// jrk::handle::get_variable_segment().  Only one thread should call this.
+    void push(const uint8_t * buffer) noexcept
+    {
+      uint64_t index = count.load(std::memory_order_relaxed);
+      slot & s = slots[index % capacity];
+
+      // An odd sequence number tells readers that the slot is being written.
+      s.sequence.store(2 * index + 1, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+
+      for (size_t i = 0; i < word_count; i++)
+      {
+        uint32_t word = 0;
+        for (size_t j = 0; j < 4 && 4 * i + j < JRK_VARIABLES_SIZE; j++)
+        {
+          word |= (uint32_t)buffer[4 * i + j] << (8 * j);
+        }
+        s.words[i].store(word, std::memory_order_relaxed);
+      }
+
+      s.sequence.store(2 * index + 2, std::memory_order_release);
+      count.store(index + 1, std::memory_order_release);
+    }
+
+    /// Returns the number of samples that have ever been added, which is also
+    /// the index that the next sample will have.
+    uint64_t get_count() const noexcept
+    {
+      return count.load(std::memory_order_acquire);
+    }
+
+    /// Copies the sample with the specified index.  Returns false if that
+    /// sample has not been added yet or has been overwritten.
+    bool get(uint64_t index, history_sample & sample) const noexcept
+    {
+      const slot & s = slots[index % capacity];
+      uint64_t sequence = s.sequence.load(std::memory_order_acquire);
+      if (sequence != 2 * index + 2) { return false; }
+
+      uint32_t words[word_count];
+      for (size_t i = 0; i < word_count; i++)
+      {
+        words[i] = s.words[i].load(std::memory_order_relaxed);
+      }
+
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s.sequence.load(std::memory_order_relaxed) != sequence)
+      {
+        return false;
+      }
+
+      sample.index = index;
+      for (size_t i = 0; i < JRK_VARIABLES_SIZE; i++)
+      {
+        sample.buffer[i] = (uint8_t)(words[i / 4] >> (8 * (i % 4)));
+      }
+      return true;
+    }
+
+    /// Copies the most recent sample.  Returns false if the history is empty,
+    /// or if the writer overwrote the latest sample each time this function
+    /// tried to copy it, which can only happen when the capacity is very small
+    /// and the writer is adding samples very quickly.
+    bool get_latest(history_sample & sample) const noexcept
+    {
+      for (size_t attempt = 0; attempt < latest_attempts; attempt++)
+      {
+        uint64_t c = get_count();
+        if (c == 0) { return false; }
+        if (get(c - 1, sample)) { return true; }
+        // The writer lapped us while we were copying; try the new latest.
+      }
+      return false;
+    }
+
+    /// Copies every sample that is still available, starting at the specified
+    /// index, into the samples vector, replacing its previous contents.
+    /// Returns the index to pass next time to get only the samples added
+    /// after these.  This is the usual way for a consumer to keep up with the
+    /// history: samples that were overwritten before it got to them are
+    /// skipped.
+    ///
+    /// Reusing the same vector each time avoids allocating memory once it has
+    /// grown to the capacity of the history.
+    uint64_t get_since(uint64_t first,
+      std::vector<history_sample> & samples) const
+    {
+      samples.clear();
+      uint64_t end = get_count();
+      for (uint64_t i = std::max(first, oldest_index(end)); i < end; i++)
+      {
+        samples.emplace_back();
+        if (!get(i, samples.back())) { samples.pop_back(); }
+      }
+      return end;
+    }
+
+    /// Copies every sample whose up_time variable is greater than or equal to
+    /// begin_up_time and less than end_up_time into the samples vector,
+    /// replacing its previous contents.  The first sample is found with a
+    /// binary search, so this is fast even for a large history.
+    void get_range(uint32_t begin_up_time, uint32_t end_up_time,
+      std::vector<history_sample> & samples) const
+    {
+      samples.clear();
+
+      uint64_t end = get_count();
+      uint64_t low = oldest_index(end);
+      uint64_t high = end;
+      while (low < high)
+      {
+        uint64_t mid = low + (high - low) / 2;
+
+        // A sample that was overwritten was older than everything still in
+        // the history, so treat it as being before the range.
+        uint32_t up_time;
+        if (!get_up_time(mid, up_time) || up_time < begin_up_time)
+        {
+          low = mid + 1;
+        }
+        else
+        {
+          high = mid;
+        }
+      }
+
+      history_sample sample;
+      for (uint64_t i = low; i < end; i++)
+      {
+        if (!get(i, sample)) { continue; }
+        if (sample.get_up_time() >= end_up_time) { break; }
+        samples.push_back(sample);
+      }
+    }
+
+  private:
+    static const size_t word_count = (JRK_VARIABLES_SIZE + 3) / 4;
+
+    // The number of times get_latest() tries before giving up, so that a
+    // reader never waits indefinitely for the writer.
+    static const size_t latest_attempts = 4;
+
+    struct slot
+    {
+      // Twice the index of the sample plus 2, or 0 if nothing has been
+      // written to this slot.  Odd while the sample is being written.
+      std::atomic<uint64_t> sequence { 0 };
+
+      // The buffer, stored in atomic words so that readers can copy it while
+      // the writer is overwriting it without a data race.
+      std::atomic<uint32_t> words[word_count];
+    };
+
+    uint64_t oldest_index(uint64_t end) const noexcept
+    {
+      return end > capacity ? end - capacity : 0;
+    }
+
+    bool get_up_time(uint64_t index, uint32_t & up_time) const noexcept
+    {
+      static_assert(JRK_VAR_UP_TIME % 4 == 0,
+        "up_time is expected to be in a single word");
+      const slot & s = slots[index % capacity];
+      uint64_t sequence = s.sequence.load(std::memory_order_acquire);
+      if (sequence != 2 * index + 2) { return false; }
+      up_time = s.words[JRK_VAR_UP_TIME / 4].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return s.sequence.load(std::memory_order_relaxed) == sequence;
+    }
+
+    const size_t capacity;
+    std::unique_ptr<slot[]> slots;
+    std::atomic<uint64_t> count { 0 };
+  };
+}
@@ -0,0 +1,331 @@
+// Copyright (C) Pololu Corporation.  See www.pololu.com for details.
+
+/// \file jrk_poller.hpp
+///
+/// This file provides a C++ class that opens many jrks and reads variables from
+/// all of them concurrently on a pool of worker threads.  It is built on top of
+/// the C++ API in jrk.hpp.
+///
+/// Using this header requires your program to be linked with a threading
+/// library (e.g. -pthread).
+
+#pragma once
+
+#include "jrk.hpp"
+#include "jrk_history.hpp"
+#include "jrk_schedule.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+namespace jrk
+{
+  /// Options for jrk::poller.
+  struct poller_options
+  {
+    /// The number of worker threads.  Each device is assigned to one worker,
+    /// and each worker polls its devices one at a time.  Zero means one worker
+    /// per device, which lets transfers to every device overlap.
+    size_t worker_count = 0;
+
+    /// The time between the starts of two consecutive polls of the same
+    /// device.  Zero means poll as fast as possible.
+    std::chrono::microseconds period { 0 };
+
+    /// The variables to read.  See jrk_get_variables_masked().
+    uint64_t mask = JRK_VARIABLES_MASK_ALL;
+
+    /// The flags to pass when reading variables.  See jrk_get_variables().
+    uint16_t flags = 0;
+
+    /// If a device cannot be opened, or it gets closed because of an error,
+    /// the poller waits this long before trying to open it again.
+    std::chrono::milliseconds reopen_interval { 1000 };
+
+    /// If this is not zero, the poller keeps a jrk::history of this many
+    /// samples for each device, which you can get with
+    /// jrk::poller::get_history().  Every poll then reads all of the
+    /// variables, so the mask is ignored.
+    size_t history_capacity = 0;
+  };
+
+  /// The latest information that jrk::poller has about one device.
+  struct poller_snapshot
+  {
+    /// A number that increases by one every time the poller tries to read
+    /// variables from the device.  It is zero if the device has not been
+    /// polled yet.
+    uint32_t sequence = 0;
+
+    /// The variables from the most recent successful read, or a null object if
+    /// there has not been a successful read yet.
+    jrk::variables variables;
+
+    /// The error from the most recent poll, or a null object if it was
+    /// successful.
+    jrk::error error;
+
+    /// The time when the most recent poll finished.
+    std::chrono::steady_clock::time_point time;
+
+    /// Returns true if the most recent poll was successful.
+    bool success() const noexcept
+    {
+      return sequence != 0 && !error.is_present();
+    }
+  };
+
+  /// Opens a list of jrks and continuously reads their variables on a pool of
+  /// worker threads.
+  ///
+  /// Each device is owned by exactly one worker, so a device never has more
+  /// than one transfer in progress, but transfers to different devices
+  /// happen in parallel.  When the devices are spread across several USB host
+  /// controllers, the total number of polls per second grows with the number
+  /// of controllers instead of being limited by the round-trip time of a
+  /// single thread.
+  ///
+  /// Devices are identified by their index in the list passed to the
+  /// constructor.  The latest results are published as a poller_snapshot that
+  /// any thread can read with get_snapshot().
+  class poller
+  {
+  public:
+    /// Starts polling the specified devices, which would usually come from
+    /// jrk::list_connected_devices().  The devices are opened by the worker
+    /// threads, so this constructor does not throw if a device cannot be
+    /// opened; the error is reported in the device's snapshot instead.
+    explicit poller(const std::vector<jrk::device> & devices,
+      const poller_options & options = poller_options())
+      : options(options)
+    {
+      for (const jrk::device & device : devices)
+      {
+        slots.emplace_back(new slot(device, options.history_capacity));
+      }
+
+      size_t worker_count = options.worker_count;
+      if (worker_count == 0 || worker_count > slots.size())
+      {
+        worker_count = slots.size();
+      }
+
+      try
+      {
+        for (size_t i = 0; i < worker_count; i++)
+        {
+          workers.emplace_back(&poller::run, this, i, worker_count);
+        }
+      }
+      catch (...)
+      {
+        stop();
+        throw;
+      }
+    }
+
+    /// Stops the worker threads and closes all the devices.
+    ~poller() noexcept
+    {
+      stop();
+    }
+
+    poller(const poller &) = delete;
+    poller & operator=(const poller &) = delete;
+
+    /// Returns the number of devices being polled.
+    size_t get_device_count() const noexcept
+    {
+      return slots.size();
+    }
+
+    /// Returns the device with the specified index.
+    const jrk::device & get_device(size_t index) const
+    {
+      return slots.at(index)->device;
+    }
+
+    /// Returns the sequence number of the latest snapshot for the specified
+    /// device.  This is cheaper than get_snapshot(), so you can use it to check
+    /// whether there is anything new.
+    uint32_t get_sequence(size_t index) const
+    {
+      return slots.at(index)->sequence;
+    }
+
+    /// Copies the latest snapshot for the specified device.
+    poller_snapshot get_snapshot(size_t index) const
+    {
+      const slot & s = *slots.at(index);
+      std::lock_guard<std::mutex> lock(s.mutex);
+      return s.latest;
+    }
+
+    /// Returns the history of the specified device, or NULL if
+    /// poller_options::history_capacity is zero.  The history is filled by
+    /// the poller's worker thread and can be read from any thread.
+    const jrk::history * get_history(size_t index) const
+    {
+      return slots.at(index)->history.get();
+    }
+
+  private:
+    struct slot
+    {
+      slot(const jrk::device & device, size_t history_capacity)
+        : device(device),
+          history(history_capacity ? new jrk::history(history_capacity) : NULL)
+      {
+      }
+
+      jrk::device device;
+      const std::unique_ptr<jrk::history> history;
+
+      // Only used by the worker that owns this device.
+      jrk::handle handle;
+      jrk::variables scratch;
+      std::chrono::steady_clock::time_point next_open_time;
+
+      // Protects latest.
+      mutable std::mutex mutex;
+      poller_snapshot latest;
+
+      std::atomic<uint32_t> sequence { 0 };
+    };
+
+    typedef std::chrono::steady_clock clock;
+
+    void stop() noexcept
+    {
+      {
+        std::lock_guard<std::mutex> lock(stop_mutex);
+        stopping = true;
+      }
+      stop_requested.notify_all();
+      for (std::thread & worker : workers)
+      {
+        worker.join();
+      }
+      workers.clear();
+    }
+
+    // Waits until the specified time or until stop() is called.  Returns true
+    // if we are stopping.
+    bool wait_until(clock::time_point time)
+    {
+      std::unique_lock<std::mutex> lock(stop_mutex);
+      return stop_requested.wait_until(lock, time,
+        [this] { return stopping.load(); });
+    }
+
+    // Polls one device and publishes the result.  Returns false if it did
+    // nothing because the device is waiting to be reopened.
+    bool poll(slot & s)
+    {
+      jrk::error error;
+
+      if (!s.handle.is_present())
+      {
+        if (clock::now() < s.next_open_time) { return false; }
+        try
+        {
+          s.handle = jrk::handle(s.device);
+        }
+        catch (const jrk::error & e)
+        {
+          error = e;
+        }
+      }
+
+      if (s.handle.is_present())
+      {
+        try
+        {
+          if (s.history)
+          {
+            uint8_t buffer[JRK_VARIABLES_SIZE];
+            s.handle.get_variable_segment(0, sizeof(buffer), buffer,
+              options.flags);
+            if (!s.scratch.is_present()) { s.scratch = variables::create(); }
+            s.scratch.read_from_buffer(buffer);
+            s.history->push(buffer);
+          }
+          else
+          {
+            s.handle.get_variables_masked(s.scratch, options.mask,
+              options.flags);
+          }
+        }
+        catch (const jrk::error & e)
+        {
+          error = e;
+        }
+      }
+
+      if (error.is_present())
+      {
+        // The device was probably disconnected, so close it and try opening
+        // it again later.
+        s.handle.close();
+        s.next_open_time = clock::now() + options.reopen_interval;
+      }
+
+      std::lock_guard<std::mutex> lock(s.mutex);
+      if (!error.is_present())
+      {
+        // Swap instead of copying so that a steady-state poll does not
+        // allocate.  The old variables get overwritten by the next poll.
+        std::swap(s.scratch, s.latest.variables);
+      }
+      s.latest.error = std::move(error);
+      s.latest.time = clock::now();
+      s.latest.sequence++;
+      s.sequence = s.latest.sequence;
+      return true;
+    }
+
+    void run(size_t first, size_t stride)
+    {
+      // How long to sleep when none of our devices are open.
+      const std::chrono::milliseconds idle_wait(10);
+
+      periodic_schedule schedule(options.period);
+      while (!stopping)
+      {
+        bool did_poll = false;
+        for (size_t i = first; i < slots.size(); i += stride)
+        {
+          did_poll |= poll(*slots[i]);
+        }
+
+        if (!did_poll)
+        {
+          // All of our devices are waiting to be reopened.
+          if (wait_until(clock::now() + idle_wait)) { return; }
+          schedule.restart();
+          continue;
+        }
+
+        if (options.period == clock::duration::zero()) { continue; }
+
+        schedule.advance();
+        if (wait_until(schedule.get_deadline())) { return; }
+      }
+    }
+
+    const poller_options options;
+
+    std::vector<std::unique_ptr<slot>> slots;
+
+    std::mutex stop_mutex;
+    std::condition_variable stop_requested;
+    std::atomic<bool> stopping { false };
+
+    // This is last so that the other members are initialized before the
+    // threads start.
+    std::vector<std::thread> workers;
+  };
+}
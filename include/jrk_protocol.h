@@ -40,6 +40,10 @@
 #define JRK_CMD_GET_VARIABLE_SERIAL_MASK 0xC0
 #define JRK_CMD_SET_TARGET_SERIAL_MASK 0xE0
 
+#define JRK_SERIAL_POLOLU_PROTOCOL_START 0xAA
+#define JRK_MAX_SERIAL_RESPONSE_SIZE 15
+#define JRK_MAX_SERIAL_SET_RAM_SETTINGS_SIZE 7
+
 #define JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_HALTING 0
 #define JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_OCCURRED 1
 #define JRK_GET_VARIABLES_FLAG_CLEAR_CURRENT_CHOPPING_OCCURRENCE_COUNT 2
@@ -0,0 +1,118 @@
+// Copyright (C) Pololu Corporation.  See www.pololu.com for details.
+
+/// \file jrk_schedule.hpp
+///
+/// This file provides C++ helpers for doing something at precise times, such as
+/// reading variables from a jrk at a fixed rate.  They are used by the classes
+/// in jrk_batch.hpp, jrk_control_loop.hpp, and jrk_poller.hpp.
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+namespace jrk
+{
+  /// Keeps track of the deadlines of something that repeats with a fixed
+  /// period.
+  ///
+  /// Deadlines are computed from the first one, so the time each repetition
+  /// takes does not accumulate into the schedule.  If a repetition runs so long
+  /// that the next deadline has passed, the schedule skips the deadlines that
+  /// were missed instead of making the caller run several repetitions back to
+  /// back to catch up.
+  class periodic_schedule
+  {
+  public:
+    typedef std::chrono::steady_clock clock;
+
+    /// Creates a schedule whose first deadline is the specified time.  A
+    /// period of zero means that every deadline is the time when advance() is
+    /// called.
+    explicit periodic_schedule(clock::duration period,
+      clock::time_point start = clock::now()) noexcept
+      : period(period), deadline(start)
+    {
+    }
+
+    /// Returns the current deadline.
+    clock::time_point get_deadline() const noexcept
+    {
+      return deadline;
+    }
+
+    /// Makes the specified time the current deadline and computes later
+    /// deadlines from it.
+    void restart(clock::time_point start = clock::now()) noexcept
+    {
+      deadline = start;
+    }
+
+    /// Moves on to the next deadline that is not before the specified time,
+    /// and returns the number of deadlines that were skipped because they had
+    /// already passed.
+    uint64_t advance(clock::time_point now = clock::now()) noexcept
+    {
+      if (period == clock::duration::zero())
+      {
+        deadline = now;
+        return 0;
+      }
+
+      deadline += period;
+      if (now <= deadline) { return 0; }
+      uint64_t missed = (now - deadline) / period + 1;
+      deadline += missed * period;
+      return missed;
+    }
+
+  private:
+    clock::duration period;
+    clock::time_point deadline;
+  };
+
+  /// Waits until the specified time.
+  ///
+  /// To wake up on time, the thread sleeps until spin_time before the deadline
+  /// and then busy-waits for the rest of the time.  A spin time of zero
+  /// disables busy-waiting, which saves CPU time but lets the operating
+  /// system's scheduling latency delay the wake-up.
+  ///
+  /// If cancel is not NULL, the wait ends early as soon as another thread sets
+  /// it to true.  The thread wakes up every 10 ms while sleeping to check it.
+  /// Returns false if the wait was cancelled.
+  inline bool wait_for_deadline(std::chrono::steady_clock::time_point deadline,
+    std::chrono::steady_clock::duration spin_time,
+    const std::atomic<bool> * cancel = NULL)
+  {
+    typedef std::chrono::steady_clock clock;
+
+    // How often to check for cancellation while sleeping.
+    const clock::duration cancel_check_interval = std::chrono::milliseconds(10);
+
+    clock::time_point wake_time = deadline - spin_time;
+    while (true)
+    {
+      if (cancel != NULL && *cancel) { return false; }
+      clock::time_point now = clock::now();
+      if (now >= wake_time) { break; }
+      if (cancel == NULL)
+      {
+        std::this_thread::sleep_until(wake_time);
+      }
+      else
+      {
+        std::this_thread::sleep_until(
+          std::min(wake_time, now + cancel_check_interval));
+      }
+    }
+    while (clock::now() < deadline)
+    {
+      if (cancel != NULL && *cancel) { return false; }
+    }
+    return !(cancel != NULL && *cancel);
+  }
+}
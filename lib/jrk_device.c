@@ -2,6 +2,12 @@
 
 #include "jrk_internal.h"
 
+// Bits for jrk_device::unfetched.
+#define DEVICE_SERIAL_NUMBER (1 << 0)
+#define DEVICE_OS_ID (1 << 1)
+#define DEVICE_FIRMWARE_VERSION (1 << 2)
+#define DEVICE_ALL_PROPERTIES 7
+
 struct jrk_device
 {
   libusbp_device * usb_device;
@@ -10,9 +16,157 @@ struct jrk_device
   char * os_id;
   uint16_t firmware_version;
   uint32_t product;
+
+  // The properties above that have not been fetched from the USB device yet.
+  // This is only non-zero for devices from jrk_list_connected_devices_lazy().
+  uint8_t unfetched;
+
+  // Non-NULL for simulated devices, which have no USB device or interface.
+  jrk_simulator * simulator;
 };
 
-jrk_error * jrk_list_connected_devices(
+// Gets the product code for a USB device.  Sets it to 0 if the device is not
+// a jrk.  This only looks at the device descriptor, which the operating system
+// has already read, so it is much faster than getting the serial number.
+static jrk_error * get_product_code(libusbp_device * usb_device,
+  uint32_t * product_code)
+{
+  *product_code = 0;
+
+  // Check the USB vendor ID.
+  uint16_t vendor_id;
+  jrk_error * error = jrk_usb_error(
+    libusbp_device_get_vendor_id(usb_device, &vendor_id));
+  if (error != NULL) { return error; }
+  if (vendor_id != JRK_USB_VENDOR_ID) { return NULL; }
+
+  // Check the USB product ID.
+  uint16_t product_id;
+  error = jrk_usb_error(
+    libusbp_device_get_product_id(usb_device, &product_id));
+  if (error != NULL) { return error; }
+
+  switch (product_id)
+  {
+  case JRK_USB_PRODUCT_ID_UMC04A_30V:
+    *product_code = JRK_PRODUCT_UMC04A_30V;
+    break;
+  case JRK_USB_PRODUCT_ID_UMC04A_40V:
+    *product_code = JRK_PRODUCT_UMC04A_40V;
+    break;
+  case JRK_USB_PRODUCT_ID_UMC05A_30V:
+    *product_code = JRK_PRODUCT_UMC05A_30V;
+    break;
+  case JRK_USB_PRODUCT_ID_UMC05A_40V:
+    *product_code = JRK_PRODUCT_UMC05A_40V;
+    break;
+  case JRK_USB_PRODUCT_ID_UMC06A:
+    *product_code = JRK_PRODUCT_UMC06A;
+    break;
+  }
+  return NULL;
+}
+
+// Fetches the specified properties of a USB device that have not been
+// fetched yet.
+static jrk_error * device_fetch(jrk_device * device, uint8_t properties)
+{
+  jrk_error * error = NULL;
+  properties &= device->unfetched;
+
+  if (error == NULL && (properties & DEVICE_SERIAL_NUMBER))
+  {
+    error = jrk_usb_error(libusbp_device_get_serial_number(
+        device->usb_device, &device->serial_number));
+    if (error == NULL) { device->unfetched &= ~DEVICE_SERIAL_NUMBER; }
+  }
+
+  if (error == NULL && (properties & DEVICE_OS_ID))
+  {
+    error = jrk_usb_error(libusbp_device_get_os_id(
+        device->usb_device, &device->os_id));
+    if (error == NULL) { device->unfetched &= ~DEVICE_OS_ID; }
+  }
+
+  if (error == NULL && (properties & DEVICE_FIRMWARE_VERSION))
+  {
+    error = jrk_usb_error(libusbp_device_get_revision(
+        device->usb_device, &device->firmware_version));
+    if (error == NULL) { device->unfetched &= ~DEVICE_FIRMWARE_VERSION; }
+  }
+
+  return error;
+}
+
+// Fetches a property for one of the getters below.  The getters cannot report
+// errors, so if this fails, the property keeps its empty value.
+static void device_fetch_for_getter(const jrk_device * device,
+  uint8_t property)
+{
+  if (device->unfetched & property)
+  {
+    jrk_error_free(device_fetch((jrk_device *)device, property));
+  }
+}
+
+// Creates a jrk_device for a USB device, taking ownership of the USB device,
+// and fetches the specified properties.  If the device's generic interface is
+// not ready yet, which is normal for a device that was just connected, sets
+// the output pointer to NULL and returns no error.
+static jrk_error * device_create_usb(libusbp_device * usb_device,
+  uint32_t product_code, uint8_t properties, jrk_device ** device)
+{
+  *device = NULL;
+
+  // Get the USB interface.
+  libusbp_generic_interface * usb_interface = NULL;
+  {
+    uint8_t interface_number = 0;
+    bool composite = true;
+    libusbp_error * usb_error = libusbp_generic_interface_create(
+      usb_device, interface_number, composite, &usb_interface);
+    if (usb_error)
+    {
+      libusbp_device_free(usb_device);
+      if (libusbp_error_has_code(usb_error, LIBUSBP_ERROR_NOT_READY))
+      {
+        // An error occurred that is normal if the interface is simply
+        // not ready to use yet.  Silently ignore this device.
+        libusbp_error_free(usb_error);
+        return NULL;
+      }
+      return jrk_usb_error(usb_error);
+    }
+  }
+
+  // Allocate the new device.
+  jrk_device * new_device = calloc(1, sizeof(jrk_device));
+  if (new_device == NULL)
+  {
+    libusbp_generic_interface_free(usb_interface);
+    libusbp_device_free(usb_device);
+    return &jrk_error_no_memory;
+  }
+
+  new_device->usb_device = usb_device;
+  new_device->usb_interface = usb_interface;
+  new_device->product = product_code;
+  new_device->firmware_version = 0xFFFF;
+  new_device->unfetched = DEVICE_ALL_PROPERTIES;
+
+  jrk_error * error = device_fetch(new_device, properties);
+  if (error != NULL)
+  {
+    jrk_device_free(new_device);
+    return error;
+  }
+
+  *device = new_device;
+  return NULL;
+}
+
+static jrk_error * list_connected_devices(
+  uint8_t properties,
   jrk_device *** device_list,
   size_t * device_count)
 {
@@ -35,14 +189,14 @@ jrk_error * jrk_list_connected_devices(
         &usb_device_list, &usb_device_count));
   }
 
-  jrk_device ** jrk_device_list = NULL;
-  size_t jrk_device_count = 0;
+  // Find out which USB devices are jrks.  Move the other ones to the end of
+  // the list so we can free them later along with the rest.
+  uint32_t * product_codes = NULL;
+  size_t candidate_count = 0;
   if (error == NULL)
   {
-    // Allocate enough memory for the case where every USB device is
-    // relevant, without forgetting the NULL terminator.
-    jrk_device_list = calloc(usb_device_count + 1, sizeof(jrk_device *));
-    if (jrk_device_list == NULL)
+    product_codes = malloc((usb_device_count + 1) * sizeof(uint32_t));
+    if (product_codes == NULL)
     {
       error = &jrk_error_no_memory;
     }
@@ -50,95 +204,49 @@ jrk_error * jrk_list_connected_devices(
 
   for (size_t i = 0; error == NULL && i < usb_device_count; i++)
   {
-    libusbp_device * usb_device = usb_device_list[i];
-
-    // Check the USB vendor ID.
-    uint16_t vendor_id;
-    error = jrk_usb_error(libusbp_device_get_vendor_id(usb_device, &vendor_id));
-    if (error) { break; }
-    if (vendor_id != JRK_USB_VENDOR_ID) { continue; }
-
-    // Check the USB product ID.
-    uint16_t product_id;
-    error = jrk_usb_error(libusbp_device_get_product_id(usb_device, &product_id));
-    if (error) { break; }
-
     uint32_t product_code;
-    switch (product_id)
+    error = get_product_code(usb_device_list[i], &product_code);
+    if (error == NULL && product_code != 0)
     {
-    case JRK_USB_PRODUCT_ID_UMC04A_30V:
-      product_code = JRK_PRODUCT_UMC04A_30V;
-      break;
-    case JRK_USB_PRODUCT_ID_UMC04A_40V:
-      product_code = JRK_PRODUCT_UMC04A_40V;
-      break;
-    case JRK_USB_PRODUCT_ID_UMC05A_30V:
-      product_code = JRK_PRODUCT_UMC05A_30V;
-      break;
-    case JRK_USB_PRODUCT_ID_UMC05A_40V:
-      product_code = JRK_PRODUCT_UMC05A_40V;
-      break;
-    case JRK_USB_PRODUCT_ID_UMC06A:
-      product_code = JRK_PRODUCT_UMC06A;
-      break;
-    default:
-      // Unrecognized product.
-      continue;
-    }
-
-    // Get the USB interface.
-    libusbp_generic_interface * usb_interface = NULL;
-    {
-      uint8_t interface_number = 0;
-      bool composite = true;
-      libusbp_error * usb_error = libusbp_generic_interface_create(
-        usb_device, interface_number, composite, &usb_interface);
-      if (usb_error)
-      {
-        if (libusbp_error_has_code(usb_error, LIBUSBP_ERROR_NOT_READY))
-        {
-          // An error occurred that is normal if the interface is simply
-          // not ready to use yet.  Silently ignore this device.
-          continue;
-        }
-        error = jrk_usb_error(usb_error);
-        break;
-      }
+      libusbp_device * usb_device = usb_device_list[i];
+      usb_device_list[i] = usb_device_list[candidate_count];
+      usb_device_list[candidate_count] = usb_device;
+      product_codes[candidate_count++] = product_code;
     }
+  }
 
-    // Allocate the new device.
-    jrk_device * new_device = calloc(1, sizeof(jrk_device));
-    if (new_device == NULL)
+  jrk_device ** jrk_device_list = NULL;
+  size_t jrk_device_count = 0;
+  if (error == NULL)
+  {
+    // Allocate enough memory for the case where every jrk is ready, without
+    // forgetting the simulated devices and the NULL terminator.
+    jrk_device_list = calloc(candidate_count + jrk_simulated_device_count() + 1,
+      sizeof(jrk_device *));
+    if (jrk_device_list == NULL)
     {
       error = &jrk_error_no_memory;
-      break;
     }
-    jrk_device_list[jrk_device_count++] = new_device;
+  }
 
+  for (size_t i = 0; error == NULL && i < candidate_count; i++)
+  {
     // Move the usb_device out of the list into the new jrk_device.
-    new_device->usb_device = usb_device;
+    libusbp_device * usb_device = usb_device_list[i];
     usb_device_list[i] = NULL;
 
-    // Store the USB interface.  Must do this here so that it will get freed
-    // if any of the calls below fail.
-    new_device->usb_interface = usb_interface;
-
-    // Get the serial number.
-    error = jrk_usb_error(libusbp_device_get_serial_number(
-        usb_device, &new_device->serial_number));
-    if (error) { break; }
-
-    // Get the OS ID.
-    error = jrk_usb_error(libusbp_device_get_os_id(
-        usb_device, &new_device->os_id));
-    if (error) { break; }
-
-    // Get the firmware version.
-    error = jrk_usb_error(libusbp_device_get_revision(
-        usb_device, &new_device->firmware_version));
-    if (error) { break; }
+    error = device_create_usb(usb_device, product_codes[i], properties,
+      &jrk_device_list[jrk_device_count]);
+    if (error == NULL && jrk_device_list[jrk_device_count] != NULL)
+    {
+      jrk_device_count++;
+    }
+  }
 
-    new_device->product = product_code;
+  for (size_t i = 0; error == NULL && i < jrk_simulated_device_count(); i++)
+  {
+    error = jrk_simulated_device_create(i, &jrk_device_list[jrk_device_count]);
+    if (error == NULL) { jrk_device_count++; }
   }
 
   if (error == NULL)
@@ -157,6 +265,85 @@ jrk_error * jrk_list_connected_devices(
 
   jrk_list_free(jrk_device_list);
 
+  free(product_codes);
+
+  for (size_t i = 0; i < usb_device_count; i++)
+  {
+    libusbp_device_free(usb_device_list[i]);
+  }
+
+  libusbp_list_free(usb_device_list);
+
+  return error;
+}
+
+jrk_error * jrk_list_connected_devices(
+  jrk_device *** device_list,
+  size_t * device_count)
+{
+  return list_connected_devices(DEVICE_ALL_PROPERTIES,
+    device_list, device_count);
+}
+
+jrk_error * jrk_list_connected_devices_lazy(
+  jrk_device *** device_list,
+  size_t * device_count)
+{
+  return list_connected_devices(0, device_list, device_count);
+}
+
+jrk_error * jrk_find_device_by_serial_number(const char * serial_number,
+  jrk_device ** device)
+{
+  if (device == NULL)
+  {
+    return jrk_error_create("Device output pointer is null.");
+  }
+
+  *device = NULL;
+
+  if (serial_number == NULL)
+  {
+    return jrk_error_create("Serial number is null.");
+  }
+
+  jrk_error * error = NULL;
+
+  libusbp_device ** usb_device_list = NULL;
+  size_t usb_device_count = 0;
+  if (error == NULL)
+  {
+    error = jrk_usb_error(libusbp_list_connected_devices(
+        &usb_device_list, &usb_device_count));
+  }
+
+  bool found = false;
+  for (size_t i = 0; error == NULL && !found && i < usb_device_count; i++)
+  {
+    uint32_t product_code;
+    error = get_product_code(usb_device_list[i], &product_code);
+    if (error != NULL || product_code == 0) { continue; }
+
+    // Only jrks get this far, so we never read the serial number string
+    // descriptor of any other device.
+    char * usb_serial_number = NULL;
+    error = jrk_usb_error(libusbp_device_get_serial_number(
+        usb_device_list[i], &usb_serial_number));
+    found = error == NULL && strcmp(usb_serial_number, serial_number) == 0;
+    libusbp_string_free(usb_serial_number);
+    if (!found) { continue; }
+
+    libusbp_device * usb_device = usb_device_list[i];
+    usb_device_list[i] = NULL;
+    error = device_create_usb(usb_device, product_code,
+      DEVICE_ALL_PROPERTIES, device);
+  }
+
+  if (error == NULL && !found)
+  {
+    error = jrk_simulated_device_find(serial_number, device);
+  }
+
   for (size_t i = 0; i < usb_device_count; i++)
   {
     libusbp_device_free(usb_device_list[i]);
@@ -210,9 +397,13 @@ jrk_error * jrk_device_copy(const jrk_device * source, jrk_device ** dest)
   {
     new_device->firmware_version = source->firmware_version;
     new_device->product = source->product;
+    new_device->unfetched = source->unfetched;
+    new_device->simulator = source->simulator;
   }
 
-  if (error == NULL)
+  // The serial number and OS ID can be NULL if they have not been fetched.
+
+  if (error == NULL && source->serial_number != NULL)
   {
     new_device->serial_number = strdup(source->serial_number);
     if (new_device->serial_number == NULL)
@@ -221,7 +412,7 @@ jrk_error * jrk_device_copy(const jrk_device * source, jrk_device ** dest)
     }
   }
 
-  if (error == NULL)
+  if (error == NULL && source->os_id != NULL)
   {
     new_device->os_id = strdup(source->os_id);
     if (new_device->os_id == NULL)
@@ -247,6 +438,7 @@ void jrk_device_free(jrk_device * device)
   if (device != NULL)
   {
     libusbp_generic_interface_free(device->usb_interface);
+    libusbp_device_free(device->usb_device);
     libusbp_string_free(device->os_id);
     libusbp_string_free(device->serial_number);
     free(device);
@@ -274,18 +466,21 @@ const char * jrk_device_get_short_name(const jrk_device * device)
 const char * jrk_device_get_serial_number(const jrk_device * device)
 {
   if (device == NULL) { return ""; }
-  return device->serial_number;
+  device_fetch_for_getter(device, DEVICE_SERIAL_NUMBER);
+  return device->serial_number ? device->serial_number : "";
 }
 
 const char * jrk_device_get_os_id(const jrk_device * device)
 {
   if (device == NULL) { return ""; }
-  return device->os_id;
+  device_fetch_for_getter(device, DEVICE_OS_ID);
+  return device->os_id ? device->os_id : "";
 }
 
 uint16_t jrk_device_get_firmware_version(const jrk_device * device)
 {
   if (device == NULL) { return 0xFFFF; }
+  device_fetch_for_getter(device, DEVICE_FIRMWARE_VERSION);
   return device->firmware_version;
 }
 
@@ -304,6 +499,11 @@ static jrk_error * jrk_device_get_port_name(const jrk_device * device,
     return jrk_error_create("Device pointer is null.");
   }
 
+  if (device->simulator != NULL)
+  {
+    return jrk_error_create("Simulated devices do not have serial ports.");
+  }
+
   jrk_error * error = NULL;
 
   // Get the serial port object.
@@ -357,3 +557,53 @@ jrk_device_get_generic_interface(const jrk_device * device)
   if (device == NULL) { return NULL; }
   return device->usb_interface;
 }
+
+jrk_error * jrk_device_create_simulated(jrk_simulator * simulator,
+  uint8_t product, uint16_t firmware_version, const char * serial_number,
+  const char * os_id, jrk_device ** device)
+{
+  assert(simulator != NULL);
+  assert(serial_number != NULL);
+  assert(os_id != NULL);
+  assert(device != NULL);
+
+  *device = NULL;
+
+  jrk_error * error = NULL;
+
+  jrk_device * new_device = calloc(1, sizeof(jrk_device));
+  if (new_device == NULL)
+  {
+    error = &jrk_error_no_memory;
+  }
+
+  if (error == NULL)
+  {
+    new_device->simulator = simulator;
+    new_device->product = product;
+    new_device->firmware_version = firmware_version;
+
+    new_device->serial_number = strdup(serial_number);
+    new_device->os_id = strdup(os_id);
+    if (new_device->serial_number == NULL || new_device->os_id == NULL)
+    {
+      error = &jrk_error_no_memory;
+    }
+  }
+
+  if (error == NULL)
+  {
+    *device = new_device;
+    new_device = NULL;
+  }
+
+  jrk_device_free(new_device);
+
+  return error;
+}
+
+jrk_simulator * jrk_device_get_simulator(const jrk_device * device)
+{
+  if (device == NULL) { return NULL; }
+  return device->simulator;
+}
@@ -0,0 +1,409 @@
+// Functions for keeping track of which jrks are connected without listing
+// every USB device over and over.
+//
+// On Linux, we listen for the uevents that the kernel sends when a USB device
+// is added or removed.  Events for devices that are not made by Pololu are
+// ignored without doing anything else.  A removal is handled by dropping the
+// device with the matching OS ID from the table.  An arrival is handled by
+// calling jrk_list_connected_devices(), since that is the only way to get a
+// jrk_device for the new device.  The kernel sends the event before the
+// device's interfaces are ready, so jrk_list_connected_devices() might not
+// return it yet; we keep trying for a little while.
+//
+// On other operating systems, or if we cannot listen for uevents, we call
+// jrk_list_connected_devices() about once per second, which is what programs
+// did before this existed.
+
+#include "jrk_internal.h"
+
+#ifdef __linux__
+#include <fcntl.h>
+#include <linux/netlink.h>
+#include <sys/socket.h>
+#endif
+
+// How often to list the devices if we cannot get notifications.
+#define WATCH_FALLBACK_INTERVAL_MS 1000
+
+// After an arrival event, how long to keep listing the devices until the new
+// device shows up, and how long to wait between attempts.
+#define WATCH_ARRIVAL_TIMEOUT_MS 2000
+#define WATCH_ARRIVAL_RETRY_MS 100
+
+struct jrk_device_watch
+{
+  // The devices that are connected, as a NULL-terminated list.
+  jrk_device ** devices;
+  size_t device_count;
+
+  // The netlink socket for uevents, or -1 if we are using the fallback.
+  int fd;
+
+  // The last time we listed the devices.
+  uint64_t last_list_time;
+
+  // If a Pololu device arrived and we have not seen a new jrk yet, this is the
+  // time when we give up waiting for it.  Otherwise, it is 0.
+  uint64_t arrival_deadline;
+};
+
+#ifdef __linux__
+
+static void watch_open_socket(jrk_device_watch * watch)
+{
+  watch->fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC,
+    NETLINK_KOBJECT_UEVENT);
+  if (watch->fd == -1) { return; }
+
+  struct sockaddr_nl address;
+  memset(&address, 0, sizeof(address));
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = 1;  // Kernel events.
+  if (bind(watch->fd, (struct sockaddr *)&address, sizeof(address)) == -1 ||
+    fcntl(watch->fd, F_SETFL, O_NONBLOCK) == -1)
+  {
+    close(watch->fd);
+    watch->fd = -1;
+  }
+}
+
+static void watch_close_socket(jrk_device_watch * watch)
+{
+  if (watch->fd != -1) { close(watch->fd); }
+}
+
+// Looks up a KEY=value field in a uevent message.
+static const char * uevent_get(const char * message, size_t length,
+  const char * key)
+{
+  size_t key_length = strlen(key);
+  const char * end = message + length;
+  for (const char * p = message; p < end; p += strlen(p) + 1)
+  {
+    if ((size_t)(end - p) > key_length && memcmp(p, key, key_length) == 0 &&
+      p[key_length] == '=')
+    {
+      return p + key_length + 1;
+    }
+  }
+  return NULL;
+}
+
+// Removes the device with the specified OS ID from the table and reports it.
+// Returns false if there is no such device.
+static bool watch_remove_os_id(jrk_device_watch * watch, const char * os_id,
+  jrk_device_watch_callback * callback, void * user_data)
+{
+  for (size_t i = 0; i < watch->device_count; i++)
+  {
+    jrk_device * device = watch->devices[i];
+    if (strcmp(jrk_device_get_os_id(device), os_id) != 0) { continue; }
+
+    if (callback) { callback(user_data, JRK_DEVICE_EVENT_REMOVED, device); }
+    jrk_device_free(device);
+    memmove(&watch->devices[i], &watch->devices[i + 1],
+      (watch->device_count - i) * sizeof(jrk_device *));
+    watch->device_count--;
+    return true;
+  }
+  return false;
+}
+
+// Reads all the pending uevents.  Returns true if we need to list the
+// devices.
+static bool watch_read_events(jrk_device_watch * watch,
+  jrk_device_watch_callback * callback, void * user_data, bool * changed)
+{
+  bool need_list = false;
+
+  while (true)
+  {
+    char message[4096];
+    ssize_t length = recv(watch->fd, message, sizeof(message) - 1, 0);
+    if (length < 0)
+    {
+      if (errno == EINTR) { continue; }
+
+      // If the socket's buffer overflowed, we missed some events.
+      if (errno == ENOBUFS) { need_list = true; continue; }
+
+      break;
+    }
+    message[length] = 0;
+
+    const char * subsystem = uevent_get(message, length, "SUBSYSTEM");
+    const char * devtype = uevent_get(message, length, "DEVTYPE");
+    const char * action = uevent_get(message, length, "ACTION");
+    const char * devpath = uevent_get(message, length, "DEVPATH");
+    const char * product = uevent_get(message, length, "PRODUCT");
+    if (subsystem == NULL || strcmp(subsystem, "usb") != 0 ||
+      devtype == NULL || strcmp(devtype, "usb_device") != 0 ||
+      action == NULL || devpath == NULL || product == NULL)
+    {
+      continue;
+    }
+
+    // PRODUCT is the vendor ID, product ID, and revision in hex.
+    if (strtoul(product, NULL, 16) != JRK_USB_VENDOR_ID) { continue; }
+
+    if (strcmp(action, "add") == 0)
+    {
+      watch->arrival_deadline = jrk_time_ms() + WATCH_ARRIVAL_TIMEOUT_MS;
+      need_list = true;
+    }
+    else if (strcmp(action, "remove") == 0)
+    {
+      // libusbp uses the sysfs path as the OS ID.
+      jrk_string os_id;
+      jrk_string_setup(&os_id);
+      jrk_sprintf(&os_id, "/sys%s", devpath);
+      if (os_id.data == NULL ||
+        !watch_remove_os_id(watch, os_id.data, callback, user_data))
+      {
+        // This was not one of our devices, or it was but the OS ID is not what
+        // we expected.  Listing the devices is cheap enough in the rare case
+        // where another Pololu device is removed.
+        need_list = true;
+      }
+      else
+      {
+        *changed = true;
+      }
+      free(os_id.data);
+    }
+  }
+
+  return need_list;
+}
+
+#else
+
+static void watch_open_socket(jrk_device_watch * watch)
+{
+  watch->fd = -1;
+}
+
+static void watch_close_socket(jrk_device_watch * watch)
+{
+  (void)watch;
+}
+
+static bool watch_read_events(jrk_device_watch * watch,
+  jrk_device_watch_callback * callback, void * user_data, bool * changed)
+{
+  (void)watch;
+  (void)callback;
+  (void)user_data;
+  (void)changed;
+  return false;
+}
+
+#endif
+
+static bool list_has_os_id(jrk_device ** list, size_t count,
+  const char * os_id)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    if (strcmp(jrk_device_get_os_id(list[i]), os_id) == 0) { return true; }
+  }
+  return false;
+}
+
+static void free_device_list(jrk_device ** list, size_t count)
+{
+  for (size_t i = 0; i < count; i++)
+  {
+    jrk_device_free(list[i]);
+  }
+  jrk_list_free(list);
+}
+
+// Lists the devices, reports the differences from the table, and replaces the
+// table.
+static jrk_error * watch_list(jrk_device_watch * watch,
+  jrk_device_watch_callback * callback, void * user_data, bool * changed)
+{
+  jrk_device ** list;
+  size_t count;
+  jrk_error * error = jrk_list_connected_devices(&list, &count);
+  if (error != NULL) { return error; }
+  watch->last_list_time = jrk_time_ms();
+
+  for (size_t i = 0; i < watch->device_count; i++)
+  {
+    const jrk_device * device = watch->devices[i];
+    if (!list_has_os_id(list, count, jrk_device_get_os_id(device)))
+    {
+      if (callback) { callback(user_data, JRK_DEVICE_EVENT_REMOVED, device); }
+      *changed = true;
+    }
+  }
+
+  bool arrived = false;
+  for (size_t i = 0; i < count; i++)
+  {
+    const jrk_device * device = list[i];
+    if (!list_has_os_id(watch->devices, watch->device_count,
+      jrk_device_get_os_id(device)))
+    {
+      if (callback) { callback(user_data, JRK_DEVICE_EVENT_ARRIVED, device); }
+      *changed = true;
+      arrived = true;
+    }
+  }
+
+  if (arrived) { watch->arrival_deadline = 0; }
+
+  free_device_list(watch->devices, watch->device_count);
+  watch->devices = list;
+  watch->device_count = count;
+  return NULL;
+}
+
+jrk_error * jrk_device_watch_create(jrk_device_watch ** watch)
+{
+  if (watch == NULL)
+  {
+    return jrk_error_create("Device watch output pointer is null.");
+  }
+
+  *watch = NULL;
+
+  jrk_error * error = NULL;
+
+  jrk_device_watch * new_watch = NULL;
+  if (error == NULL)
+  {
+    new_watch = (jrk_device_watch *)calloc(1, sizeof(jrk_device_watch));
+    if (new_watch == NULL) { error = &jrk_error_no_memory; }
+  }
+
+  if (error == NULL)
+  {
+    // Start listening before listing the devices so that we do not miss a
+    // device that is added in between.
+    watch_open_socket(new_watch);
+
+    bool changed;
+    error = watch_list(new_watch, NULL, NULL, &changed);
+  }
+
+  if (error == NULL)
+  {
+    *watch = new_watch;
+    new_watch = NULL;
+  }
+
+  jrk_device_watch_free(new_watch);
+
+  return error;
+}
+
+void jrk_device_watch_free(jrk_device_watch * watch)
+{
+  if (watch != NULL)
+  {
+    watch_close_socket(watch);
+    free_device_list(watch->devices, watch->device_count);
+    free(watch);
+  }
+}
+
+bool jrk_device_watch_has_notifications(const jrk_device_watch * watch)
+{
+  return watch != NULL && watch->fd != -1;
+}
+
+jrk_error * jrk_device_watch_update(jrk_device_watch * watch,
+  jrk_device_watch_callback * callback, void * user_data, bool * changed)
+{
+  bool dummy_changed;
+  if (changed == NULL) { changed = &dummy_changed; }
+  *changed = false;
+
+  if (watch == NULL)
+  {
+    return jrk_error_create("Device watch is null.");
+  }
+
+  bool need_list;
+  uint64_t now = jrk_time_ms();
+  if (watch->fd == -1)
+  {
+    need_list = now - watch->last_list_time >= WATCH_FALLBACK_INTERVAL_MS;
+  }
+  else
+  {
+    need_list = watch_read_events(watch, callback, user_data, changed);
+
+    if (watch->arrival_deadline != 0)
+    {
+      if (now >= watch->arrival_deadline)
+      {
+        watch->arrival_deadline = 0;
+      }
+      else if (now - watch->last_list_time >= WATCH_ARRIVAL_RETRY_MS)
+      {
+        need_list = true;
+      }
+    }
+  }
+
+  jrk_error * error = NULL;
+  if (need_list)
+  {
+    error = watch_list(watch, callback, user_data, changed);
+  }
+
+  if (error != NULL)
+  {
+    error = jrk_error_add(error,
+      "There was an error updating the list of devices.");
+  }
+
+  return error;
+}
+
+jrk_error * jrk_device_watch_get_devices(const jrk_device_watch * watch,
+  jrk_device *** device_list, size_t * device_count)
+{
+  if (device_count) { *device_count = 0; }
+
+  if (device_list == NULL)
+  {
+    return jrk_error_create("Device list output pointer is null.");
+  }
+
+  *device_list = NULL;
+
+  if (watch == NULL)
+  {
+    return jrk_error_create("Device watch is null.");
+  }
+
+  jrk_error * error = NULL;
+
+  jrk_device ** list = (jrk_device **)calloc(watch->device_count + 1,
+    sizeof(jrk_device *));
+  if (list == NULL) { error = &jrk_error_no_memory; }
+
+  size_t count = 0;
+  for (; error == NULL && count < watch->device_count; count++)
+  {
+    error = jrk_device_copy(watch->devices[count], &list[count]);
+    if (error != NULL) { break; }
+  }
+
+  if (error == NULL)
+  {
+    *device_list = list;
+    if (device_count) { *device_count = count; }
+    list = NULL;
+    count = 0;
+  }
+
+  free_device_list(list, count);
+
+  return error;
+}
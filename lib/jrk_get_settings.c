@@ -410,6 +410,30 @@ static void write_buffer_to_settings(const uint8_t * buf, jrk_settings * setting
   }
 }
 
+jrk_error * jrk_get_eeprom_settings_buffer(jrk_handle * handle, uint8_t * buf)
+{
+  assert(handle != NULL);
+  assert(buf != NULL);
+
+  jrk_error * error = NULL;
+
+  // Read all the settings from the device into the buffer.
+  memset(buf, 0, JRK_SETTINGS_SIZE);
+  size_t index = 1;
+  while (index < JRK_SETTINGS_SIZE && error == NULL)
+  {
+    size_t length = JRK_MAX_USB_RESPONSE_SIZE;
+    if (index + length > JRK_SETTINGS_SIZE)
+    {
+      length = JRK_SETTINGS_SIZE - index;
+    }
+    error = jrk_get_eeprom_setting_segment(handle, index, length, buf + index);
+    index += length;
+  }
+
+  return error;
+}
+
 jrk_error * jrk_get_eeprom_settings(jrk_handle * handle, jrk_settings ** settings)
 {
   if (settings == NULL)
@@ -424,7 +448,10 @@ jrk_error * jrk_get_eeprom_settings(jrk_handle * handle, jrk_settings ** setting
     return jrk_error_create("Handle is null.");
   }
 
-  jrk_error * error = NULL;
+  // Return a copy of the cached settings if the cache is enabled and holds
+  // them.
+  jrk_error * error = jrk_handle_copy_cached_settings(handle, false, settings);
+  if (error != NULL || *settings != NULL) { return error; }
 
   // Allocate the new settings object.
   jrk_settings * new_settings = NULL;
@@ -436,11 +463,10 @@ jrk_error * jrk_get_eeprom_settings(jrk_handle * handle, jrk_settings ** setting
   // Specify what product these settings are for.
   if (error == NULL)
   {
-    const jrk_device * device = jrk_handle_get_device(handle);
-    uint32_t product = jrk_device_get_product(device);
-    uint16_t firmware_version = jrk_device_get_firmware_version(device);
-    jrk_settings_set_product(new_settings, product);
-    jrk_settings_set_firmware_version(new_settings, firmware_version);
+    jrk_settings_set_product(new_settings,
+      jrk_handle_get_product(handle));
+    jrk_settings_set_firmware_version(new_settings,
+      jrk_handle_get_firmware_version(handle));
   }
 
   // Set the context here because any error from jrk_get_setting_segment will
@@ -455,24 +481,14 @@ jrk_error * jrk_get_eeprom_settings(jrk_handle * handle, jrk_settings ** setting
   uint8_t buf[JRK_SETTINGS_SIZE];
   if (error == NULL)
   {
-    memset(buf, 0, sizeof(buf));
-    size_t index = 1;
-    while (index < sizeof(buf) && error == NULL)
-    {
-      size_t length = JRK_MAX_USB_RESPONSE_SIZE;
-      if (index + length > sizeof(buf))
-      {
-        length = sizeof(buf) - index;
-      }
-      error = jrk_get_eeprom_setting_segment(handle, index, length, buf + index);
-      index += length;
-    }
+    error = jrk_get_eeprom_settings_buffer(handle, buf);
   }
 
   // Pass the new settings to the caller.
   if (error == NULL)
   {
     write_buffer_to_settings(buf, new_settings);
+    jrk_handle_cache_settings(handle, false, new_settings);
     *settings = new_settings;
     new_settings = NULL;
   }
@@ -496,7 +512,10 @@ jrk_error * jrk_get_ram_settings(jrk_handle * handle, jrk_settings ** settings)
     return jrk_error_create("Handle is null.");
   }
 
-  jrk_error * error = NULL;
+  // Return a copy of the cached settings if the cache is enabled and holds
+  // them.
+  jrk_error * error = jrk_handle_copy_cached_settings(handle, true, settings);
+  if (error != NULL || *settings != NULL) { return error; }
 
   // Allocate the new settings object.
   jrk_settings * new_settings = NULL;
@@ -508,11 +527,10 @@ jrk_error * jrk_get_ram_settings(jrk_handle * handle, jrk_settings ** settings)
   // Specify what product these settings are for.
   if (error == NULL)
   {
-    const jrk_device * device = jrk_handle_get_device(handle);
-    uint32_t product = jrk_device_get_product(device);
-    uint16_t firmware_version = jrk_device_get_firmware_version(device);
-    jrk_settings_set_product(new_settings, product);
-    jrk_settings_set_firmware_version(new_settings, firmware_version);
+    jrk_settings_set_product(new_settings,
+      jrk_handle_get_product(handle));
+    jrk_settings_set_firmware_version(new_settings,
+      jrk_handle_get_firmware_version(handle));
   }
 
   // Set the context here because any error from jrk_get_setting_segment will
@@ -546,6 +564,7 @@ jrk_error * jrk_get_ram_settings(jrk_handle * handle, jrk_settings ** settings)
   if (error == NULL)
   {
     write_buffer_to_settings(buf, new_settings);
+    jrk_handle_cache_settings(handle, true, new_settings);
     *settings = new_settings;
     new_settings = NULL;
   }
@@ -1,14 +1,133 @@
-// Functions for communicating with jrks over USB.
+// Functions for communicating with jrks over USB or a serial port.
 
 #include "jrk_internal.h"
 
 struct jrk_handle
 {
+  // Exactly one of usb_handle, serial_port, and simulator is non-NULL.
   libusbp_generic_handle * usb_handle;
+  jrk_serial_port * serial_port;
+  jrk_simulator * simulator;
+  uint16_t serial_device_number;
+  uint32_t serial_flags;
+
+  // NULL for serial handles.
   jrk_device * device;
+
+  // For serial handles, the product and firmware version that the caller told
+  // us about, or 0 if they are unknown.
+  uint8_t serial_product;
+  uint16_t serial_firmware_version;
+
   char * cached_firmware_version_string;
+
+  // See jrk_handle_set_settings_cache_enabled().
+  bool settings_cache_enabled;
+  jrk_settings * cached_eeprom_settings;
+  jrk_settings * cached_ram_settings;
+  uint32_t settings_generation;
+
+  // See jrk_handle_is_alive().  True once a transfer fails because the device
+  // was disconnected.
+  bool disconnected;
+
+  // The USB device's address on its bus when the handle was opened, or -1 if
+  // we cannot check it.  The operating system gives a device a new address
+  // every time it is plugged in.
+  int usb_address;
 };
 
+#ifdef __linux__
+
+// Reads the address of a USB device from sysfs.  The OS ID of a USB device on
+// Linux is its sysfs directory.  Returns -1 if the device is not there.
+static int read_usb_address(const char * os_id)
+{
+  jrk_string path;
+  jrk_string_setup(&path);
+  jrk_sprintf(&path, "%s/devnum", os_id);
+  if (path.data == NULL) { return -1; }
+
+  FILE * file = fopen(path.data, "r");
+  free(path.data);
+  if (file == NULL) { return -1; }
+
+  int address;
+  if (fscanf(file, "%d", &address) != 1) { address = -1; }
+  fclose(file);
+  return address;
+}
+
+#else
+
+static int read_usb_address(const char * os_id)
+{
+  (void)os_id;
+  return -1;
+}
+
+#endif
+
+// Returns true if the specified request might change the settings stored in
+// the device's EEPROM or RAM.
+static bool request_changes_settings(uint8_t request_type, uint8_t request)
+{
+  if (request_type & 0x80) { return false; }
+
+  switch (request)
+  {
+  case JRK_CMD_SET_EEPROM_SETTING:
+  case JRK_CMD_SET_RAM_SETTINGS:
+  case JRK_CMD_REINITIALIZE:
+  case JRK_CMD_START_BOOTLOADER:
+    return true;
+  default:
+    return false;
+  }
+}
+
+// Every command goes through this function.  For USB handles, it performs a
+// USB control transfer.  For serial handles, it sends the equivalent serial
+// commands.  For simulated devices, it passes the transfer to the simulator.
+static jrk_error * jrk_handle_control_transfer(jrk_handle * handle,
+  uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+  uint8_t * buffer, size_t length, size_t * transferred)
+{
+  assert(handle != NULL);
+
+  // Invalidate the settings cache even if the request fails, because the
+  // device might have acted on it anyway.
+  if (request_changes_settings(request_type, request))
+  {
+    jrk_handle_invalidate_settings(handle);
+  }
+
+  jrk_error * error;
+  if (handle->serial_port != NULL)
+  {
+    error = jrk_serial_control_transfer(handle->serial_port,
+      handle->serial_device_number, handle->serial_flags,
+      request_type, request, value, index, buffer, length, transferred);
+  }
+  else if (handle->simulator != NULL)
+  {
+    error = jrk_simulator_control_transfer(handle->simulator,
+      request_type, request, value, index, buffer, length, transferred);
+  }
+  else
+  {
+    error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
+      request_type, request, value, index, buffer, length, transferred));
+  }
+
+  if (jrk_error_has_code(error, JRK_ERROR_DEVICE_DISCONNECTED))
+  {
+    handle->disconnected = true;
+  }
+
+  return error;
+}
+
 jrk_error * jrk_handle_open(const jrk_device * device, jrk_handle ** handle)
 {
   if (handle == NULL)
@@ -52,8 +171,13 @@ jrk_error * jrk_handle_open(const jrk_device * device, jrk_handle ** handle)
     error = jrk_device_copy(device, &new_handle->device);
   }
 
-
   if (error == NULL)
+  {
+    new_handle->simulator = jrk_device_get_simulator(device);
+    new_handle->usb_address = -1;
+  }
+
+  if (error == NULL && new_handle->simulator == NULL)
   {
     const libusbp_generic_interface * usb_interface =
       jrk_device_get_generic_interface(device);
@@ -61,7 +185,7 @@ jrk_error * jrk_handle_open(const jrk_device * device, jrk_handle ** handle)
         usb_interface, &new_handle->usb_handle));
   }
 
-  if (error == NULL)
+  if (error == NULL && new_handle->simulator == NULL)
   {
     // Set a timeout for all control transfers to prevent the program from
     // hanging indefinitely.  Want it to be at least 1500 ms because that is how
@@ -71,6 +195,12 @@ jrk_error * jrk_handle_open(const jrk_device * device, jrk_handle ** handle)
         new_handle->usb_handle, 0, 1600));
   }
 
+  if (error == NULL && new_handle->simulator == NULL)
+  {
+    new_handle->usb_address =
+      read_usb_address(jrk_device_get_os_id(device));
+  }
+
   if (error == NULL)
   {
     // Success.  Pass the handle to the caller.
@@ -83,6 +213,47 @@ jrk_error * jrk_handle_open(const jrk_device * device, jrk_handle ** handle)
   return error;
 }
 
+jrk_error * jrk_handle_open_serial(jrk_serial_port * port,
+  uint16_t device_number, uint32_t flags,
+  uint8_t product, uint16_t firmware_version, jrk_handle ** handle)
+{
+  if (handle == NULL)
+  {
+    return jrk_error_create("Handle output pointer is null.");
+  }
+
+  *handle = NULL;
+
+  if (port == NULL)
+  {
+    return jrk_error_create("Serial port is null.");
+  }
+
+  uint16_t device_number_max =
+    (flags & (1 << JRK_SERIAL_FLAG_14BIT_DEVICE_NUMBER)) ? 0x3FFF : 0x7F;
+  if (device_number > device_number_max)
+  {
+    return jrk_error_create("Device number is too large: %u.",
+      (unsigned int)device_number);
+  }
+
+  jrk_handle * new_handle = calloc(1, sizeof(jrk_handle));
+  if (new_handle == NULL)
+  {
+    return &jrk_error_no_memory;
+  }
+
+  new_handle->serial_port = port;
+  new_handle->serial_device_number = device_number;
+  new_handle->serial_flags = flags;
+  new_handle->serial_product = product;
+  new_handle->serial_firmware_version = firmware_version;
+  new_handle->usb_address = -1;
+  *handle = new_handle;
+
+  return NULL;
+}
+
 void jrk_handle_close(jrk_handle * handle)
 {
   if (handle != NULL)
@@ -90,19 +261,51 @@ void jrk_handle_close(jrk_handle * handle)
     libusbp_generic_handle_close(handle->usb_handle);
     jrk_device_free(handle->device);
     free(handle->cached_firmware_version_string);
+    jrk_settings_free(handle->cached_eeprom_settings);
+    jrk_settings_free(handle->cached_ram_settings);
     free(handle);
   }
 }
 
+bool jrk_handle_is_alive(jrk_handle * handle)
+{
+  if (handle == NULL || handle->disconnected) { return false; }
+
+  if (handle->usb_address != -1 &&
+    read_usb_address(jrk_device_get_os_id(handle->device)) !=
+      handle->usb_address)
+  {
+    handle->disconnected = true;
+    return false;
+  }
+
+  return true;
+}
+
 const jrk_device * jrk_handle_get_device(const jrk_handle * handle)
 {
   if (handle == NULL) { return NULL; }
   return handle->device;
 }
 
+uint8_t jrk_handle_get_product(const jrk_handle * handle)
+{
+  assert(handle != NULL);
+  if (handle->device == NULL) { return handle->serial_product; }
+  return jrk_device_get_product(handle->device);
+}
+
+uint16_t jrk_handle_get_firmware_version(const jrk_handle * handle)
+{
+  assert(handle != NULL);
+  if (handle->device == NULL) { return handle->serial_firmware_version; }
+  return jrk_device_get_firmware_version(handle->device);
+}
+
 const char * jrk_get_firmware_version_string(jrk_handle * handle)
 {
-  if (handle == NULL) { return ""; }
+  // Serial handles do not know what device they are talking to.
+  if (handle == NULL || handle->device == NULL) { return ""; }
 
   if (handle->cached_firmware_version_string != NULL)
   {
@@ -136,15 +339,16 @@ const char * jrk_get_firmware_version_string(jrk_handle * handle)
   // Get the firmware modification string from the device.
   size_t transferred = 0;
   uint8_t buffer[256];
-  libusbp_error * usb_error = libusbp_control_transfer(handle->usb_handle,
+  jrk_error * error = jrk_handle_control_transfer(handle,
     0x80, USB_REQUEST_GET_DESCRIPTOR,
     (USB_DESCRIPTOR_TYPE_STRING << 8) | JRK_FIRMWARE_MODIFICATION_STRING_INDEX,
     0,
     buffer, sizeof(buffer), &transferred);
-  if (usb_error)
+  if (error != NULL)
   {
     // Let's make this be a non-fatal error because it's not so important.
     // Just add a question mark so we can tell if something is wrong.
+    jrk_error_free(error);
     new_string[index++] = '0';
   }
 
@@ -167,13 +371,61 @@ const char * jrk_get_firmware_version_string(jrk_handle * handle)
   return new_string;
 }
 
+void jrk_handle_set_settings_cache_enabled(jrk_handle * handle, bool enabled)
+{
+  if (handle == NULL) { return; }
+  if (!enabled) { jrk_handle_invalidate_settings(handle); }
+  handle->settings_cache_enabled = enabled;
+}
+
+uint32_t jrk_handle_get_settings_generation(const jrk_handle * handle)
+{
+  if (handle == NULL) { return 0; }
+  return handle->settings_generation;
+}
+
+void jrk_handle_invalidate_settings(jrk_handle * handle)
+{
+  assert(handle != NULL);
+  jrk_settings_free(handle->cached_eeprom_settings);
+  jrk_settings_free(handle->cached_ram_settings);
+  handle->cached_eeprom_settings = NULL;
+  handle->cached_ram_settings = NULL;
+  handle->settings_generation++;
+}
+
+jrk_error * jrk_handle_copy_cached_settings(jrk_handle * handle, bool ram,
+  jrk_settings ** settings)
+{
+  assert(handle != NULL);
+  assert(settings != NULL);
+  *settings = NULL;
+  return jrk_settings_copy(ram ? handle->cached_ram_settings :
+    handle->cached_eeprom_settings, settings);
+}
+
+void jrk_handle_cache_settings(jrk_handle * handle, bool ram,
+  const jrk_settings * settings)
+{
+  assert(handle != NULL);
+  if (!handle->settings_cache_enabled) { return; }
+
+  jrk_settings ** cached = ram ? &handle->cached_ram_settings :
+    &handle->cached_eeprom_settings;
+  jrk_settings_free(*cached);
+  *cached = NULL;
+
+  // If this fails, we just don't cache anything.
+  jrk_error_free(jrk_settings_copy(settings, cached));
+}
+
 jrk_error * jrk_set_eeprom_setting_byte(jrk_handle * handle,
   uint8_t address, uint8_t byte)
 {
   assert(handle != NULL);
 
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
-    0x40, JRK_CMD_SET_EEPROM_SETTING, byte, address, NULL, 0, NULL));
+  jrk_error * error = jrk_handle_control_transfer(handle,
+    0x40, JRK_CMD_SET_EEPROM_SETTING, byte, address, NULL, 0, NULL);
 
   if (error != NULL)
   {
@@ -198,8 +450,8 @@ jrk_error * jrk_set_target(jrk_handle * handle, uint16_t target)
     target = 4095;
   }
 
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
-    0x40, JRK_CMD_SET_TARGET_USB, target, 0, NULL, 0, NULL));
+  jrk_error * error = jrk_handle_control_transfer(handle,
+    0x40, JRK_CMD_SET_TARGET_USB, target, 0, NULL, 0, NULL);
 
   if (error != NULL)
   {
@@ -217,8 +469,8 @@ jrk_error * jrk_stop_motor(jrk_handle * handle)
     return jrk_error_create("Handle is null.");
   }
 
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
-    0x40, JRK_CMD_STOP_MOTOR_USB, 0, 0, NULL, 0, NULL));
+  jrk_error * error = jrk_handle_control_transfer(handle,
+    0x40, JRK_CMD_STOP_MOTOR_USB, 0, 0, NULL, 0, NULL);
 
   if (error != NULL)
   {
@@ -299,8 +551,8 @@ jrk_error * jrk_force_duty_cycle_target(jrk_handle * handle, int16_t duty_cycle)
   if (duty_cycle > 600) { duty_cycle = 600; }
   if (duty_cycle < -600) { duty_cycle = -600; }
 
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
-    0x40, JRK_CMD_FORCE_DUTY_CYCLE_TARGET, duty_cycle, 0, NULL, 0, NULL));
+  jrk_error * error = jrk_handle_control_transfer(handle,
+    0x40, JRK_CMD_FORCE_DUTY_CYCLE_TARGET, duty_cycle, 0, NULL, 0, NULL);
 
   if (error != NULL)
   {
@@ -321,8 +573,8 @@ jrk_error * jrk_force_duty_cycle(jrk_handle * handle, int16_t duty_cycle)
   if (duty_cycle > 600) { duty_cycle = 600; }
   if (duty_cycle < -600) { duty_cycle = -600; }
 
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
-    0x40, JRK_CMD_FORCE_DUTY_CYCLE, duty_cycle, 0, NULL, 0, NULL));
+  jrk_error * error = jrk_handle_control_transfer(handle,
+    0x40, JRK_CMD_FORCE_DUTY_CYCLE, duty_cycle, 0, NULL, 0, NULL);
 
   if (error != NULL)
   {
@@ -364,8 +616,8 @@ jrk_error * jrk_get_eeprom_setting_segment(jrk_handle * handle,
   }
 
   size_t transferred;
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
-    0xC0, JRK_CMD_GET_EEPROM_SETTINGS, 0, index, output, length, &transferred));
+  jrk_error * error = jrk_handle_control_transfer(handle,
+    0xC0, JRK_CMD_GET_EEPROM_SETTINGS, 0, index, output, length, &transferred);
   if (error != NULL)
   {
     error = jrk_error_add(error, "There was an error reading settings.");
@@ -415,9 +667,9 @@ jrk_error * jrk_get_ram_setting_segment(jrk_handle * handle,
   }
 
   size_t transferred;
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
+  jrk_error * error = jrk_handle_control_transfer(handle,
     0xC0, JRK_CMD_GET_RAM_SETTINGS, 0, index,
-    output, length, &transferred));
+    output, length, &transferred);
   if (error != NULL)
   {
     error = jrk_error_add(error, "There was an error reading RAM settings.");
@@ -467,9 +719,9 @@ jrk_error * jrk_set_ram_setting_segment(jrk_handle * handle,
   }
 
   size_t transferred;
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
+  jrk_error * error = jrk_handle_control_transfer(handle,
     0x40, JRK_CMD_SET_RAM_SETTINGS, 0, index,
-    (uint8_t *)input, length, &transferred));
+    (uint8_t *)input, length, &transferred);
   if (error != NULL)
   {
     error = jrk_error_add(error, "There was an error settings RAM settings.");
@@ -517,8 +769,8 @@ jrk_error * jrk_get_variable_segment(jrk_handle * handle,
   }
 
   size_t transferred;
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
-    0xC0, JRK_CMD_GET_VARIABLES, flags, index, output, length, &transferred));
+  jrk_error * error = jrk_handle_control_transfer(handle,
+    0xC0, JRK_CMD_GET_VARIABLES, flags, index, output, length, &transferred);
   if (error != NULL)
   {
     error = jrk_error_add(error, "There was an error reading variables.");
@@ -587,6 +839,10 @@ jrk_error * jrk_restore_defaults(jrk_handle * handle)
     }
   }
 
+  // The device changed its settings after the "Reinitialize" request that
+  // invalidated the cache, so anything cached since then is stale.
+  jrk_handle_invalidate_settings(handle);
+
   if (error != NULL)
   {
     error = jrk_error_add(error,
@@ -603,8 +859,8 @@ jrk_error * jrk_reinitialize_core(jrk_handle * handle, uint16_t flags)
     return jrk_error_create("Handle is null.");
   }
 
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
-    0x40, JRK_CMD_REINITIALIZE, flags, 0, NULL, 0, NULL));
+  jrk_error * error = jrk_handle_control_transfer(handle,
+    0x40, JRK_CMD_REINITIALIZE, flags, 0, NULL, 0, NULL);
 
   if (error != NULL)
   {
@@ -633,8 +889,8 @@ jrk_error * jrk_start_bootloader(jrk_handle * handle)
     return jrk_error_create("Handle is null.");
   }
 
-  jrk_error * error = jrk_usb_error(libusbp_control_transfer(handle->usb_handle,
-    0x40, JRK_CMD_START_BOOTLOADER, 0, 0, NULL, 0, NULL));
+  jrk_error * error = jrk_handle_control_transfer(handle,
+    0x40, JRK_CMD_START_BOOTLOADER, 0, 0, NULL, 0, NULL);
 
   if (error != NULL)
   {
@@ -663,12 +919,12 @@ jrk_error * jrk_get_debug_data(jrk_handle * handle, uint8_t * data, size_t * siz
   }
 
   size_t transferred;
-  libusbp_error * usb_error = libusbp_control_transfer(handle->usb_handle,
+  jrk_error * error = jrk_handle_control_transfer(handle,
     0xC0, JRK_CMD_GET_DEBUG_DATA, 0, 0, data, *size, &transferred);
-  if (usb_error)
+  if (error != NULL)
   {
     *size = 0;
-    return jrk_usb_error(usb_error);
+    return error;
   }
 
   *size = transferred;
@@ -79,20 +79,103 @@ void jrk_settings_set_product_specific_defaults(jrk_settings *);
 uint32_t jrk_baud_rate_from_brg(uint16_t brg);
 uint16_t jrk_baud_rate_to_brg(uint32_t baud_rate);
 
+// Writes the settings to a buffer that is JRK_SETTINGS_SIZE bytes long, in the
+// same format the jrk uses to store them.
+void jrk_write_settings_to_buffer(const jrk_settings *, uint8_t * buf);
+
+// Internal jrk_variables functions.
+
+// Returns the size in bytes of the variable that starts at the specified
+// offset, or 0 if no variable starts there.
+uint8_t jrk_variable_size(size_t offset);
+
 // Internal jrk_device functions.
 
 const libusbp_generic_interface *
 jrk_device_get_generic_interface(const jrk_device * device);
 
+// Creates a device object that refers to a simulated jrk.
+jrk_error * jrk_device_create_simulated(jrk_simulator * simulator,
+  uint8_t product, uint16_t firmware_version, const char * serial_number,
+  const char * os_id, jrk_device ** device);
+
+// Returns the simulator for a simulated device, or NULL for a real one.
+jrk_simulator * jrk_device_get_simulator(const jrk_device * device);
+
 
 // Internal jrk_handle functions.
 
+// Returns the product and firmware version of the device the handle is
+// connected to.  For serial handles, these come from jrk_handle_open_serial()
+// and can be 0 if the caller did not know them.
+uint8_t jrk_handle_get_product(const jrk_handle * handle);
+uint16_t jrk_handle_get_firmware_version(const jrk_handle * handle);
+
 jrk_error * jrk_set_eeprom_setting_byte(jrk_handle * handle,
   uint8_t address, uint8_t byte);
 
 jrk_error * jrk_get_eeprom_setting_segment(jrk_handle * handle,
   size_t index, size_t length, uint8_t * output);
 
+// Reads all of the EEPROM settings into a buffer that is JRK_SETTINGS_SIZE
+// bytes long.  Byte 0 is not read and will be zero.
+jrk_error * jrk_get_eeprom_settings_buffer(jrk_handle * handle, uint8_t * buf);
+
+// If the handle's settings cache is enabled and holds the EEPROM settings (or
+// the RAM settings if ram is true), writes a copy of them to the output
+// pointer.  Otherwise, writes NULL.
+jrk_error * jrk_handle_copy_cached_settings(jrk_handle * handle, bool ram,
+  jrk_settings ** settings);
+
+// Stores a copy of settings that were just read from the device in the
+// handle's settings cache, if the cache is enabled.
+void jrk_handle_cache_settings(jrk_handle * handle, bool ram,
+  const jrk_settings * settings);
+
+// Discards the cached settings and increments the settings generation.
+void jrk_handle_invalidate_settings(jrk_handle * handle);
+
+
+// Internal jrk_serial_port functions.
+
+// Performs the serial commands that are equivalent to the specified USB control
+// transfer.  Returns an error if there is no equivalent.
+jrk_error * jrk_serial_control_transfer(jrk_serial_port * port,
+  uint16_t device_number, uint32_t flags,
+  uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+  uint8_t * buffer, size_t length, size_t * transferred);
+
+
+// Internal time functions.
+
+// Returns the number of milliseconds since an arbitrary point in the past,
+// from a clock that is not affected by changes to the system time.
+uint64_t jrk_time_ms(void);
+
+
+// Internal jrk_simulator functions.
+
+// Performs a USB control transfer on a simulated jrk.
+jrk_error * jrk_simulator_control_transfer(jrk_simulator * simulator,
+  uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+  uint8_t * buffer, size_t length, size_t * transferred);
+
+// Returns the number of simulated jrks requested by the JRK2_SIMULATED_DEVICES
+// environment variable.  The variable is only read once, the first time this
+// or jrk_simulated_device_create() is called, and all of the simulators are
+// created then.  They live until the program exits.  These functions are
+// thread-safe.
+size_t jrk_simulated_device_count(void);
+
+// Gets a device object for one of the simulated jrks requested by the
+// JRK2_SIMULATED_DEVICES environment variable.
+jrk_error * jrk_simulated_device_create(size_t index, jrk_device ** device);
+
+// Gets a device object for the simulated jrk with the specified serial number,
+// or sets the output pointer to NULL if there is no such simulated jrk.
+jrk_error * jrk_simulated_device_find(const char * serial_number,
+  jrk_device ** device);
+
 
 // Error creation functions.
 
@@ -136,3 +219,11 @@ static inline void write_int16_t(uint8_t * p, uint16_t value)
 {
   write_uint16_t(p, value);
 }
+
+static inline void write_uint32_t(uint8_t * p, uint32_t value)
+{
+  p[0] = value & 0xFF;
+  p[1] = value >> 8 & 0xFF;
+  p[2] = value >> 16 & 0xFF;
+  p[3] = value >> 24 & 0xFF;
+}
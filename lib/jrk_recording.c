@@ -0,0 +1,1049 @@
+// Functions for recording a stream of variables read from a jrk to a compact
+// binary file and for reading it back.
+//
+// File format (all integers are little-endian):
+//
+// The file starts with a 16-byte header: the magic bytes "JRK2REC\0", the
+// format version (uint32, currently 1), and the size of each record (uint32,
+// currently JRK_VARIABLES_SIZE).
+//
+// The header is followed by blocks of records.  Each block starts with a
+// 20-byte header: the encoding of the block (uint8, one of the BLOCK_ENCODING_*
+// macros), three reserved bytes, the number of records (uint32), the size of
+// the stored payload (uint32), and the up_time variable of the first and last
+// record (uint32 each).  The decoded payload is the first record of the block,
+// followed by each later record stored as the difference between it and the
+// previous record.  The difference is computed variable by variable, modulo
+// 2^(8 * size), so it has the same layout as the record.  Most variables
+// change slowly or not at all from one sample to the next, so the decoded
+// payload is mostly zeros, and compressed blocks store it with runs of zeros
+// collapsed (see compress_payload()).
+//
+// After the last block there is an index with a 24-byte entry for each block:
+// the file offset of the block (uint64), the number of records before the
+// block (uint64), and the up_time of the first and last record in the block
+// (uint32 each).  The index is followed by a 16-byte trailer: the file offset
+// of the index (uint64), the number of blocks (uint32), and the magic bytes
+// "JIDX".
+//
+// The index and trailer are written by jrk_recorder_finish().  If a program
+// stops before calling it, the reader rebuilds the index by scanning the
+// blocks, ignoring a partial block at the end of the file.
+
+#include "jrk_internal.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+#define RECORDING_VERSION 1
+#define RECORDING_HEADER_SIZE 16
+#define BLOCK_HEADER_SIZE 20
+#define INDEX_ENTRY_SIZE 24
+#define TRAILER_SIZE 16
+
+#define RECORD_SIZE JRK_VARIABLES_SIZE
+
+// The maximum number of records in a block.  Smaller blocks make seeking
+// faster, while larger blocks have less overhead.
+#define RECORDS_PER_BLOCK 256
+
+#define BLOCK_ENCODING_RAW 0
+#define BLOCK_ENCODING_ZERO_RUNS 1
+
+static const uint8_t recording_magic[8] = "JRK2REC";
+static const uint8_t trailer_magic[4] = { 'J', 'I', 'D', 'X' };
+
+typedef struct recording_index_entry
+{
+  uint64_t offset;
+  uint64_t first_record;
+  uint32_t record_count;
+  uint32_t first_up_time;
+  uint32_t last_up_time;
+} recording_index_entry;
+
+static inline uint64_t read_uint64_t(const uint8_t * p)
+{
+  return read_uint32_t(p) + ((uint64_t)read_uint32_t(p + 4) << 32);
+}
+
+static inline void write_uint64_t(uint8_t * p, uint64_t value)
+{
+  write_uint32_t(p, (uint32_t)value);
+  write_uint32_t(p + 4, (uint32_t)(value >> 32));
+}
+
+// Computes a record minus the previous record (if subtract is true), or a
+// difference plus the previous record (if subtract is false), one variable at
+// a time.  Bytes that are not part of any variable are treated as one-byte
+// variables.
+static void apply_delta(uint8_t * output, const uint8_t * a,
+  const uint8_t * b, bool subtract)
+{
+  size_t field_end = 0;
+  unsigned int carry = 0;
+  for (size_t i = 0; i < RECORD_SIZE; i++)
+  {
+    if (i >= field_end)
+    {
+      size_t size = jrk_variable_size(i);
+      field_end = i + (size ? size : 1);
+      carry = 0;
+    }
+
+    // The variables are little-endian, so this is long addition or
+    // subtraction starting from the least significant byte.
+    unsigned int result;
+    if (subtract)
+    {
+      result = a[i] - b[i] - carry;
+      carry = result >> 8 & 1;
+    }
+    else
+    {
+      result = a[i] + b[i] + carry;
+      carry = result >> 8;
+    }
+    output[i] = (uint8_t)result;
+  }
+}
+
+// Compresses a payload by collapsing runs of zeros.  The output is a sequence
+// of chunks that each start with a control byte.  A control byte of N below
+// 0x80 means that N + 1 literal bytes follow.  A control byte of 0x80 + N
+// means N + 1 zero bytes.  The output buffer must have room for
+// compressed_payload_capacity(length) bytes.
+static size_t compress_payload(const uint8_t * input, size_t length,
+  uint8_t * output)
+{
+  size_t out = 0;
+  size_t i = 0;
+  while (i < length)
+  {
+    size_t run = 0;
+    while (i + run < length && run < 128 && input[i + run] == 0) { run++; }
+    if (run > 0)
+    {
+      output[out++] = (uint8_t)(0x80 + run - 1);
+      i += run;
+      continue;
+    }
+
+    // Copy literal bytes up to the next pair of zeros, since a single zero
+    // costs less as a literal than as a run.
+    size_t literal = 0;
+    while (i + literal < length && literal < 128 &&
+      !(input[i + literal] == 0 &&
+        (i + literal + 1 == length || input[i + literal + 1] == 0)))
+    {
+      literal++;
+    }
+    output[out++] = (uint8_t)(literal - 1);
+    memcpy(output + out, input + i, literal);
+    out += literal;
+    i += literal;
+  }
+  return out;
+}
+
+static size_t compressed_payload_capacity(size_t length)
+{
+  return length + length / 128 + 1;
+}
+
+// Reverses compress_payload().  Returns false if the input is corrupt or does
+// not decompress to exactly the specified length.
+static bool decompress_payload(const uint8_t * input, size_t input_length,
+  uint8_t * output, size_t length)
+{
+  size_t in = 0;
+  size_t out = 0;
+  while (in < input_length)
+  {
+    uint8_t control = input[in++];
+    size_t count = (control & 0x7F) + 1;
+    if (count > length - out) { return false; }
+    if (control & 0x80)
+    {
+      memset(output + out, 0, count);
+    }
+    else
+    {
+      if (count > input_length - in) { return false; }
+      memcpy(output + out, input + in, count);
+      in += count;
+    }
+    out += count;
+  }
+  return out == length;
+}
+
+
+// jrk_recorder ////////////////////////////////////////////////////////////////
+
+struct jrk_recorder
+{
+  FILE * file;
+  uint32_t flags;
+
+  // The file offset where the next block will be written.
+  uint64_t offset;
+
+  // The total number of records written, including the current block.
+  uint64_t record_count;
+
+  // The block being built, which is written when it is full or when the
+  // recording is flushed.
+  uint8_t block[RECORDS_PER_BLOCK * RECORD_SIZE];
+  uint32_t block_record_count;
+  uint32_t block_first_up_time;
+  uint32_t block_last_up_time;
+  uint8_t previous[RECORD_SIZE];
+
+  // A buffer for the block header and the compressed payload.
+  uint8_t output[BLOCK_HEADER_SIZE +
+    RECORDS_PER_BLOCK * RECORD_SIZE + RECORDS_PER_BLOCK * RECORD_SIZE / 128 + 1];
+
+  recording_index_entry * index;
+  size_t index_count;
+  size_t index_capacity;
+
+  // True after a write fails or the recording is finished, since the file
+  // would not be valid if we kept writing to it.
+  bool stopped;
+};
+
+static jrk_error * recorder_write(jrk_recorder * recorder,
+  const uint8_t * data, size_t length)
+{
+  if (fwrite(data, 1, length, recorder->file) != length)
+  {
+    recorder->stopped = true;
+    return jrk_error_create("Failed to write to the recording: %s.",
+      strerror(errno));
+  }
+  recorder->offset += length;
+  return NULL;
+}
+
+static jrk_error * recorder_write_block(jrk_recorder * recorder)
+{
+  if (recorder->block_record_count == 0) { return NULL; }
+
+  if (recorder->index_count == recorder->index_capacity)
+  {
+    size_t capacity = recorder->index_capacity ? recorder->index_capacity * 2 : 64;
+    recording_index_entry * index = (recording_index_entry *)realloc(
+      recorder->index, capacity * sizeof(recording_index_entry));
+    if (index == NULL) { return &jrk_error_no_memory; }
+    recorder->index = index;
+    recorder->index_capacity = capacity;
+  }
+
+  size_t length = recorder->block_record_count * RECORD_SIZE;
+  uint8_t encoding = BLOCK_ENCODING_RAW;
+  size_t stored_length = length;
+  if (recorder->flags & JRK_RECORDER_FLAG_COMPRESS)
+  {
+    size_t compressed_length = compress_payload(recorder->block, length,
+      recorder->output + BLOCK_HEADER_SIZE);
+    if (compressed_length < length)
+    {
+      encoding = BLOCK_ENCODING_ZERO_RUNS;
+      stored_length = compressed_length;
+    }
+  }
+  if (encoding == BLOCK_ENCODING_RAW)
+  {
+    memcpy(recorder->output + BLOCK_HEADER_SIZE, recorder->block, length);
+  }
+
+  uint8_t * header = recorder->output;
+  memset(header, 0, BLOCK_HEADER_SIZE);
+  header[0] = encoding;
+  write_uint32_t(header + 4, recorder->block_record_count);
+  write_uint32_t(header + 8, (uint32_t)stored_length);
+  write_uint32_t(header + 12, recorder->block_first_up_time);
+  write_uint32_t(header + 16, recorder->block_last_up_time);
+
+  recording_index_entry * entry = &recorder->index[recorder->index_count];
+  entry->offset = recorder->offset;
+  entry->first_record = recorder->record_count - recorder->block_record_count;
+  entry->record_count = recorder->block_record_count;
+  entry->first_up_time = recorder->block_first_up_time;
+  entry->last_up_time = recorder->block_last_up_time;
+
+  jrk_error * error = recorder_write(recorder, recorder->output,
+    BLOCK_HEADER_SIZE + stored_length);
+  if (error == NULL)
+  {
+    recorder->index_count++;
+    recorder->block_record_count = 0;
+  }
+  return error;
+}
+
+jrk_error * jrk_recorder_create(const char * filename, uint32_t flags,
+  jrk_recorder ** recorder)
+{
+  if (recorder == NULL)
+  {
+    return jrk_error_create("Recorder output pointer is null.");
+  }
+
+  *recorder = NULL;
+
+  if (filename == NULL)
+  {
+    return jrk_error_create("Filename is null.");
+  }
+
+  jrk_error * error = NULL;
+
+  jrk_recorder * new_recorder = NULL;
+  if (error == NULL)
+  {
+    new_recorder = (jrk_recorder *)calloc(1, sizeof(jrk_recorder));
+    if (new_recorder == NULL) { error = &jrk_error_no_memory; }
+  }
+
+  if (error == NULL)
+  {
+    new_recorder->flags = flags;
+    new_recorder->file = fopen(filename, "wb");
+    if (new_recorder->file == NULL)
+    {
+      error = jrk_error_create("%s", strerror(errno));
+    }
+  }
+
+  if (error == NULL)
+  {
+    uint8_t header[RECORDING_HEADER_SIZE];
+    memcpy(header, recording_magic, 8);
+    write_uint32_t(header + 8, RECORDING_VERSION);
+    write_uint32_t(header + 12, RECORD_SIZE);
+    error = recorder_write(new_recorder, header, sizeof(header));
+  }
+
+  if (error == NULL)
+  {
+    *recorder = new_recorder;
+    new_recorder = NULL;
+  }
+
+  jrk_recorder_free(new_recorder);
+
+  if (error != NULL)
+  {
+    error = jrk_error_add(error,
+      "There was an error creating the recording %s.", filename);
+  }
+
+  return error;
+}
+
+jrk_error * jrk_recorder_write(jrk_recorder * recorder, const uint8_t * buffer)
+{
+  if (recorder == NULL)
+  {
+    return jrk_error_create("Recorder is null.");
+  }
+
+  if (buffer == NULL)
+  {
+    return jrk_error_create("Buffer is null.");
+  }
+
+  if (recorder->stopped)
+  {
+    return jrk_error_create("The recording has been stopped.");
+  }
+
+  uint32_t up_time = read_uint32_t(buffer + JRK_VAR_UP_TIME);
+  uint8_t * record = recorder->block +
+    recorder->block_record_count * RECORD_SIZE;
+  if (recorder->block_record_count == 0)
+  {
+    memcpy(record, buffer, RECORD_SIZE);
+    recorder->block_first_up_time = up_time;
+  }
+  else
+  {
+    apply_delta(record, buffer, recorder->previous, true);
+  }
+  memcpy(recorder->previous, buffer, RECORD_SIZE);
+  recorder->block_last_up_time = up_time;
+  recorder->block_record_count++;
+  recorder->record_count++;
+
+  if (recorder->block_record_count == RECORDS_PER_BLOCK)
+  {
+    return recorder_write_block(recorder);
+  }
+  return NULL;
+}
+
+jrk_error * jrk_recorder_flush(jrk_recorder * recorder)
+{
+  if (recorder == NULL)
+  {
+    return jrk_error_create("Recorder is null.");
+  }
+
+  if (recorder->stopped)
+  {
+    return jrk_error_create("The recording has been stopped.");
+  }
+
+  jrk_error * error = recorder_write_block(recorder);
+
+  if (error == NULL && fflush(recorder->file) != 0)
+  {
+    recorder->stopped = true;
+    error = jrk_error_create("Failed to write to the recording: %s.",
+      strerror(errno));
+  }
+
+  return error;
+}
+
+jrk_error * jrk_recorder_finish(jrk_recorder * recorder)
+{
+  if (recorder == NULL)
+  {
+    return jrk_error_create("Recorder is null.");
+  }
+
+  if (recorder->stopped)
+  {
+    return jrk_error_create("The recording has been stopped.");
+  }
+
+  jrk_error * error = recorder_write_block(recorder);
+
+  uint64_t index_offset = recorder->offset;
+  for (size_t i = 0; error == NULL && i < recorder->index_count; i++)
+  {
+    const recording_index_entry * entry = &recorder->index[i];
+    uint8_t buf[INDEX_ENTRY_SIZE];
+    write_uint64_t(buf + 0, entry->offset);
+    write_uint64_t(buf + 8, entry->first_record);
+    write_uint32_t(buf + 16, entry->first_up_time);
+    write_uint32_t(buf + 20, entry->last_up_time);
+    error = recorder_write(recorder, buf, sizeof(buf));
+  }
+
+  if (error == NULL)
+  {
+    uint8_t trailer[TRAILER_SIZE];
+    write_uint64_t(trailer + 0, index_offset);
+    write_uint32_t(trailer + 8, (uint32_t)recorder->index_count);
+    memcpy(trailer + 12, trailer_magic, 4);
+    error = recorder_write(recorder, trailer, sizeof(trailer));
+  }
+
+  if (error == NULL)
+  {
+    recorder->stopped = true;
+    int result = fclose(recorder->file);
+    recorder->file = NULL;
+    if (result != 0)
+    {
+      error = jrk_error_create("Failed to write to the recording: %s.",
+        strerror(errno));
+    }
+  }
+
+  if (error != NULL)
+  {
+    error = jrk_error_add(error, "There was an error finishing the recording.");
+  }
+
+  return error;
+}
+
+void jrk_recorder_free(jrk_recorder * recorder)
+{
+  if (recorder != NULL)
+  {
+    // Try to save the records in the current block, which is better than
+    // nothing even though the recording will not have an index.
+    if (!recorder->stopped)
+    {
+      jrk_error_free(recorder_write_block(recorder));
+    }
+    if (recorder->file != NULL)
+    {
+      fclose(recorder->file);
+    }
+    free(recorder->index);
+    free(recorder);
+  }
+}
+
+
+// jrk_recording ///////////////////////////////////////////////////////////////
+
+struct jrk_recording
+{
+  // The contents of the file, mapped into memory.
+  const uint8_t * data;
+  size_t size;
+#ifdef _WIN32
+  HANDLE mapping;
+#endif
+
+  recording_index_entry * index;
+  size_t block_count;
+  uint64_t record_count;
+
+  // The block that the next record comes from, or block_count if we are at
+  // the end of the recording.
+  size_t block;
+
+  // The number of records from the current block that have been read.
+  uint32_t block_record;
+
+  // The decoded payload of the current block.  It points into the mapped file
+  // for uncompressed blocks, or to the scratch buffer for compressed blocks.
+  const uint8_t * payload;
+
+  uint8_t scratch[RECORDS_PER_BLOCK * RECORD_SIZE];
+
+  // The last record that was read.
+  uint8_t current[RECORD_SIZE];
+};
+
+static jrk_error * recording_corrupt(void)
+{
+  return jrk_error_create("The recording is corrupt.");
+}
+
+// Checks the header of the block at the specified offset.  Writes the record
+// count and total size of the block (including the header) to the output
+// pointers and returns true if the block is valid and entirely in the file.
+static bool recording_check_block(const jrk_recording * recording,
+  uint64_t offset, uint32_t * record_count, size_t * size)
+{
+  if (offset > recording->size ||
+    recording->size - offset < BLOCK_HEADER_SIZE)
+  {
+    return false;
+  }
+
+  const uint8_t * header = recording->data + offset;
+  uint8_t encoding = header[0];
+  uint32_t count = read_uint32_t(header + 4);
+  uint32_t stored_length = read_uint32_t(header + 8);
+
+  if (count == 0 || count > RECORDS_PER_BLOCK) { return false; }
+  if (encoding == BLOCK_ENCODING_RAW)
+  {
+    if (stored_length != count * RECORD_SIZE) { return false; }
+  }
+  else if (encoding == BLOCK_ENCODING_ZERO_RUNS)
+  {
+    if (stored_length > compressed_payload_capacity(count * RECORD_SIZE))
+    {
+      return false;
+    }
+  }
+  else
+  {
+    return false;
+  }
+
+  if (recording->size - offset - BLOCK_HEADER_SIZE < stored_length)
+  {
+    return false;
+  }
+
+  *record_count = count;
+  *size = BLOCK_HEADER_SIZE + stored_length;
+  return true;
+}
+
+static jrk_error * recording_add_index_entry(jrk_recording * recording,
+  size_t * capacity, uint64_t offset, uint64_t first_record)
+{
+  if (recording->block_count == *capacity)
+  {
+    size_t new_capacity = *capacity ? *capacity * 2 : 64;
+    recording_index_entry * index = (recording_index_entry *)realloc(
+      recording->index, new_capacity * sizeof(recording_index_entry));
+    if (index == NULL) { return &jrk_error_no_memory; }
+    recording->index = index;
+    *capacity = new_capacity;
+  }
+
+  uint32_t record_count;
+  size_t size;
+  if (!recording_check_block(recording, offset, &record_count, &size))
+  {
+    return recording_corrupt();
+  }
+
+  const uint8_t * header = recording->data + offset;
+  recording_index_entry * entry = &recording->index[recording->block_count++];
+  entry->offset = offset;
+  entry->first_record = first_record;
+  entry->record_count = record_count;
+  entry->first_up_time = read_uint32_t(header + 12);
+  entry->last_up_time = read_uint32_t(header + 16);
+  recording->record_count = first_record + record_count;
+  return NULL;
+}
+
+// Loads the index from the end of the file, or rebuilds it if the recording
+// was not finished.
+static jrk_error * recording_load_index(jrk_recording * recording)
+{
+  jrk_error * error = NULL;
+  size_t capacity = 0;
+
+  const uint8_t * trailer = NULL;
+  if (recording->size >= RECORDING_HEADER_SIZE + TRAILER_SIZE)
+  {
+    trailer = recording->data + recording->size - TRAILER_SIZE;
+  }
+
+  if (trailer != NULL && memcmp(trailer + 12, trailer_magic, 4) == 0)
+  {
+    uint64_t index_offset = read_uint64_t(trailer);
+    uint32_t block_count = read_uint32_t(trailer + 8);
+    if (index_offset < RECORDING_HEADER_SIZE ||
+      index_offset > recording->size - TRAILER_SIZE ||
+      (recording->size - TRAILER_SIZE - index_offset) !=
+        (uint64_t)block_count * INDEX_ENTRY_SIZE)
+    {
+      return recording_corrupt();
+    }
+
+    for (uint32_t i = 0; error == NULL && i < block_count; i++)
+    {
+      const uint8_t * entry = recording->data + index_offset +
+        i * INDEX_ENTRY_SIZE;
+      uint64_t first_record = read_uint64_t(entry + 8);
+      if (first_record != recording->record_count)
+      {
+        return recording_corrupt();
+      }
+      error = recording_add_index_entry(recording, &capacity,
+        read_uint64_t(entry), first_record);
+    }
+    return error;
+  }
+
+  uint64_t offset = RECORDING_HEADER_SIZE;
+  while (error == NULL)
+  {
+    uint32_t record_count;
+    size_t size;
+    if (!recording_check_block(recording, offset, &record_count, &size))
+    {
+      break;
+    }
+    error = recording_add_index_entry(recording, &capacity,
+      offset, recording->record_count);
+    offset += size;
+  }
+  return error;
+}
+
+static void recording_unmap(jrk_recording * recording)
+{
+  if (recording->data == NULL) { return; }
+#ifdef _WIN32
+  UnmapViewOfFile(recording->data);
+  CloseHandle(recording->mapping);
+#else
+  munmap((void *)recording->data, recording->size);
+#endif
+  recording->data = NULL;
+}
+
+static jrk_error * recording_map(jrk_recording * recording,
+  const char * filename)
+{
+#ifdef _WIN32
+  HANDLE file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, NULL,
+    OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+  if (file == INVALID_HANDLE_VALUE)
+  {
+    return jrk_error_create("Failed to open the file.  Windows error code 0x%lx.",
+      (unsigned long)GetLastError());
+  }
+
+  jrk_error * error = NULL;
+  LARGE_INTEGER size;
+  if (!GetFileSizeEx(file, &size))
+  {
+    error = jrk_error_create(
+      "Failed to get the file size.  Windows error code 0x%lx.",
+      (unsigned long)GetLastError());
+  }
+
+  if (error == NULL && (uint64_t)size.QuadPart < RECORDING_HEADER_SIZE)
+  {
+    error = jrk_error_create("The file is not a recording.");
+  }
+
+  if (error == NULL && (uint64_t)size.QuadPart > SIZE_MAX)
+  {
+    error = jrk_error_create("The file is too large.");
+  }
+
+  if (error == NULL)
+  {
+    recording->mapping = CreateFileMappingA(file, NULL, PAGE_READONLY,
+      0, 0, NULL);
+    if (recording->mapping == NULL)
+    {
+      error = jrk_error_create(
+        "Failed to map the file.  Windows error code 0x%lx.",
+        (unsigned long)GetLastError());
+    }
+  }
+
+  if (error == NULL)
+  {
+    recording->data = (const uint8_t *)MapViewOfFile(recording->mapping,
+      FILE_MAP_READ, 0, 0, 0);
+    if (recording->data == NULL)
+    {
+      error = jrk_error_create(
+        "Failed to map the file.  Windows error code 0x%lx.",
+        (unsigned long)GetLastError());
+      CloseHandle(recording->mapping);
+    }
+    else
+    {
+      recording->size = (size_t)size.QuadPart;
+    }
+  }
+
+  CloseHandle(file);
+  return error;
+#else
+  int fd = open(filename, O_RDONLY);
+  if (fd == -1)
+  {
+    return jrk_error_create("%s", strerror(errno));
+  }
+
+  jrk_error * error = NULL;
+  struct stat st;
+  if (fstat(fd, &st) == -1)
+  {
+    error = jrk_error_create("%s", strerror(errno));
+  }
+
+  if (error == NULL && (uint64_t)st.st_size < RECORDING_HEADER_SIZE)
+  {
+    error = jrk_error_create("The file is not a recording.");
+  }
+
+  if (error == NULL && (uint64_t)st.st_size > SIZE_MAX)
+  {
+    error = jrk_error_create("The file is too large.");
+  }
+
+  if (error == NULL)
+  {
+    void * data = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED)
+    {
+      error = jrk_error_create("Failed to map the file: %s.", strerror(errno));
+    }
+    else
+    {
+      recording->data = (const uint8_t *)data;
+      recording->size = (size_t)st.st_size;
+    }
+  }
+
+  close(fd);
+  return error;
+#endif
+}
+
+jrk_error * jrk_recording_open(const char * filename,
+  jrk_recording ** recording)
+{
+  if (recording == NULL)
+  {
+    return jrk_error_create("Recording output pointer is null.");
+  }
+
+  *recording = NULL;
+
+  if (filename == NULL)
+  {
+    return jrk_error_create("Filename is null.");
+  }
+
+  jrk_error * error = NULL;
+
+  jrk_recording * new_recording = NULL;
+  if (error == NULL)
+  {
+    new_recording = (jrk_recording *)calloc(1, sizeof(jrk_recording));
+    if (new_recording == NULL) { error = &jrk_error_no_memory; }
+  }
+
+  if (error == NULL)
+  {
+    error = recording_map(new_recording, filename);
+  }
+
+  if (error == NULL)
+  {
+    const uint8_t * header = new_recording->data;
+    if (memcmp(header, recording_magic, 8) != 0)
+    {
+      error = jrk_error_create("The file is not a recording.");
+    }
+    else if (read_uint32_t(header + 8) != RECORDING_VERSION ||
+      read_uint32_t(header + 12) != RECORD_SIZE)
+    {
+      error = jrk_error_create("The recording has an unsupported format.");
+    }
+  }
+
+  if (error == NULL)
+  {
+    error = recording_load_index(new_recording);
+  }
+
+  if (error == NULL)
+  {
+    error = jrk_recording_seek(new_recording, 0);
+  }
+
+  if (error == NULL)
+  {
+    *recording = new_recording;
+    new_recording = NULL;
+  }
+
+  jrk_recording_close(new_recording);
+
+  if (error != NULL)
+  {
+    error = jrk_error_add(error,
+      "There was an error opening the recording %s.", filename);
+  }
+
+  return error;
+}
+
+void jrk_recording_close(jrk_recording * recording)
+{
+  if (recording != NULL)
+  {
+    recording_unmap(recording);
+    free(recording->index);
+    free(recording);
+  }
+}
+
+uint64_t jrk_recording_get_record_count(const jrk_recording * recording)
+{
+  if (recording == NULL) { return 0; }
+  return recording->record_count;
+}
+
+// Makes the specified block current, decompressing it if needed.
+static jrk_error * recording_load_block(jrk_recording * recording,
+  size_t block)
+{
+  recording->block = block;
+  recording->block_record = 0;
+  recording->payload = NULL;
+  if (block >= recording->block_count) { return NULL; }
+
+  const recording_index_entry * entry = &recording->index[block];
+  const uint8_t * header = recording->data + entry->offset;
+  const uint8_t * stored = header + BLOCK_HEADER_SIZE;
+  if (header[0] == BLOCK_ENCODING_RAW)
+  {
+    recording->payload = stored;
+  }
+  else
+  {
+    if (!decompress_payload(stored, read_uint32_t(header + 8),
+      recording->scratch, entry->record_count * RECORD_SIZE))
+    {
+      recording->block = recording->block_count;
+      return recording_corrupt();
+    }
+    recording->payload = recording->scratch;
+  }
+  return NULL;
+}
+
+// Decodes the next record into recording->current, or sets *done to true if
+// we are at the end of the recording.
+static jrk_error * recording_next(jrk_recording * recording, bool * done)
+{
+  *done = false;
+
+  if (recording->block < recording->block_count &&
+    recording->block_record == recording->index[recording->block].record_count)
+  {
+    jrk_error * error = recording_load_block(recording, recording->block + 1);
+    if (error != NULL) { return error; }
+  }
+
+  if (recording->block >= recording->block_count)
+  {
+    *done = true;
+    return NULL;
+  }
+
+  const uint8_t * record = recording->payload +
+    recording->block_record * RECORD_SIZE;
+  if (recording->block_record == 0)
+  {
+    memcpy(recording->current, record, RECORD_SIZE);
+  }
+  else
+  {
+    apply_delta(recording->current, record, recording->current, false);
+  }
+  recording->block_record++;
+  return NULL;
+}
+
+jrk_error * jrk_recording_seek(jrk_recording * recording, uint64_t record)
+{
+  if (recording == NULL)
+  {
+    return jrk_error_create("Recording is null.");
+  }
+
+  // Find the last block that starts at or before the record.
+  size_t low = 0, high = recording->block_count;
+  while (high - low > 1)
+  {
+    size_t mid = low + (high - low) / 2;
+    if (recording->index[mid].first_record <= record) { low = mid; }
+    else { high = mid; }
+  }
+
+  if (record >= recording->record_count)
+  {
+    return recording_load_block(recording, recording->block_count);
+  }
+
+  jrk_error * error = recording_load_block(recording, low);
+
+  // Records are stored as differences from the previous one, so we have to
+  // decode the earlier records in the block.
+  uint64_t skip = record - recording->index[low].first_record;
+  for (uint64_t i = 0; error == NULL && i < skip; i++)
+  {
+    bool done;
+    error = recording_next(recording, &done);
+  }
+
+  return error;
+}
+
+jrk_error * jrk_recording_seek_up_time(jrk_recording * recording,
+  uint32_t up_time)
+{
+  if (recording == NULL)
+  {
+    return jrk_error_create("Recording is null.");
+  }
+
+  // Find the first block whose last record is at or after the time.
+  size_t low = 0, high = recording->block_count;
+  while (low < high)
+  {
+    size_t mid = low + (high - low) / 2;
+    if (recording->index[mid].last_up_time < up_time) { low = mid + 1; }
+    else { high = mid; }
+  }
+
+  if (low == recording->block_count)
+  {
+    return recording_load_block(recording, recording->block_count);
+  }
+
+  // Find the first record in the block at or after the time, and then go back
+  // one record so that it is the next one to be read.
+  uint64_t record = recording->index[low].first_record;
+  if (recording->index[low].first_up_time < up_time)
+  {
+    jrk_error * error = recording_load_block(recording, low);
+    while (error == NULL)
+    {
+      bool done;
+      error = recording_next(recording, &done);
+      if (error != NULL || done) { break; }
+      if (read_uint32_t(recording->current + JRK_VAR_UP_TIME) >= up_time)
+      {
+        break;
+      }
+      record++;
+    }
+    if (error != NULL) { return error; }
+  }
+
+  return jrk_recording_seek(recording, record);
+}
+
+jrk_error * jrk_recording_read_buffer(jrk_recording * recording,
+  uint8_t * buffer, bool * done)
+{
+  if (recording == NULL)
+  {
+    return jrk_error_create("Recording is null.");
+  }
+
+  if (done == NULL)
+  {
+    return jrk_error_create("Done output pointer is null.");
+  }
+
+  jrk_error * error = recording_next(recording, done);
+  if (error == NULL && !*done && buffer != NULL)
+  {
+    memcpy(buffer, recording->current, RECORD_SIZE);
+  }
+  return error;
+}
+
+jrk_error * jrk_recording_read_variables(jrk_recording * recording,
+  jrk_variables * variables, bool * done)
+{
+  if (recording == NULL)
+  {
+    return jrk_error_create("Recording is null.");
+  }
+
+  if (variables == NULL)
+  {
+    return jrk_error_create("Variables pointer is null.");
+  }
+
+  if (done == NULL)
+  {
+    return jrk_error_create("Done output pointer is null.");
+  }
+
+  jrk_error * error = recording_next(recording, done);
+  if (error == NULL && !*done)
+  {
+    jrk_variables_read_from_buffer(variables, recording->current);
+  }
+  return error;
+}
@@ -0,0 +1,645 @@
+// Functions for communicating with jrks over a serial port using the compact
+// protocol or the Pololu protocol.
+//
+// jrk_handle.c performs every command as a USB control transfer.  For handles
+// opened with jrk_handle_open_serial(), it passes those control transfers to
+// jrk_serial_control_transfer(), which translates them to the equivalent serial
+// commands.
+
+#include "jrk_internal.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#endif
+
+// How long to wait for the jrk to respond to a command that reads data.
+#define SERIAL_RESPONSE_TIMEOUT_MS 500
+
+struct jrk_serial_port
+{
+#ifdef _WIN32
+  HANDLE handle;
+#else
+  int fd;
+#endif
+};
+
+#ifdef _WIN32
+
+static jrk_error * serial_windows_error(const char * context)
+{
+  DWORD code = GetLastError();
+  jrk_error * error = jrk_error_create("Windows error code 0x%lx.",
+    (unsigned long)code);
+  if (code == ERROR_ACCESS_DENIED)
+  {
+    error = jrk_error_add_code(error, JRK_ERROR_ACCESS_DENIED);
+  }
+  return jrk_error_add(error, "%s", context);
+}
+
+static jrk_error * serial_port_open_core(jrk_serial_port * port,
+  const char * name, uint32_t baud_rate)
+{
+  // COM ports above COM9 can only be opened with this prefix, and it works
+  // for the other ports too.
+  jrk_string path;
+  jrk_string_setup(&path);
+  if (strncmp(name, "\\\\", 2) != 0) { jrk_sprintf(&path, "\\\\.\\"); }
+  jrk_sprintf(&path, "%s", name);
+  if (path.data == NULL) { return &jrk_error_no_memory; }
+
+  port->handle = CreateFileA(path.data, GENERIC_READ | GENERIC_WRITE, 0,
+    NULL, OPEN_EXISTING, 0, NULL);
+  free(path.data);
+  if (port->handle == INVALID_HANDLE_VALUE)
+  {
+    return serial_windows_error("Failed to open the serial port.");
+  }
+
+  DCB dcb = { 0 };
+  dcb.DCBlength = sizeof(dcb);
+  if (!GetCommState(port->handle, &dcb))
+  {
+    return serial_windows_error("Failed to get the serial port state.");
+  }
+  dcb.BaudRate = baud_rate;
+  dcb.ByteSize = 8;
+  dcb.Parity = NOPARITY;
+  dcb.StopBits = ONESTOPBIT;
+  dcb.fBinary = TRUE;
+  dcb.fParity = FALSE;
+  dcb.fOutxCtsFlow = FALSE;
+  dcb.fOutxDsrFlow = FALSE;
+  dcb.fDtrControl = DTR_CONTROL_ENABLE;
+  dcb.fDsrSensitivity = FALSE;
+  dcb.fOutX = FALSE;
+  dcb.fInX = FALSE;
+  dcb.fNull = FALSE;
+  dcb.fRtsControl = RTS_CONTROL_ENABLE;
+  dcb.fAbortOnError = FALSE;
+  if (!SetCommState(port->handle, &dcb))
+  {
+    return serial_windows_error("Failed to set the serial port state.");
+  }
+
+  COMMTIMEOUTS timeouts = { 0 };
+  timeouts.ReadTotalTimeoutConstant = SERIAL_RESPONSE_TIMEOUT_MS;
+  timeouts.WriteTotalTimeoutConstant = SERIAL_RESPONSE_TIMEOUT_MS;
+  if (!SetCommTimeouts(port->handle, &timeouts))
+  {
+    return serial_windows_error("Failed to set the serial port timeouts.");
+  }
+
+  return NULL;
+}
+
+static void serial_port_close_core(jrk_serial_port * port)
+{
+  if (port->handle != INVALID_HANDLE_VALUE)
+  {
+    CloseHandle(port->handle);
+  }
+}
+
+static jrk_error * serial_write(jrk_serial_port * port,
+  const uint8_t * data, size_t length)
+{
+  DWORD written = 0;
+  if (!WriteFile(port->handle, data, length, &written, NULL))
+  {
+    return serial_windows_error("Failed to write to the serial port.");
+  }
+  if (written != length)
+  {
+    return jrk_error_add_code(
+      jrk_error_create("Timeout while writing to the serial port."),
+      JRK_ERROR_TIMEOUT);
+  }
+  return NULL;
+}
+
+static jrk_error * serial_read(jrk_serial_port * port,
+  uint8_t * data, size_t length)
+{
+  size_t received = 0;
+  while (received < length)
+  {
+    DWORD count = 0;
+    if (!ReadFile(port->handle, data + received, length - received,
+        &count, NULL))
+    {
+      return serial_windows_error("Failed to read from the serial port.");
+    }
+    if (count == 0) { break; }
+    received += count;
+  }
+
+  if (received != length)
+  {
+    return jrk_error_add_code(jrk_error_create(
+      "Timeout while waiting for a response.  Expected %u bytes, got %u.",
+      (unsigned int)length, (unsigned int)received), JRK_ERROR_TIMEOUT);
+  }
+  return NULL;
+}
+
+static void serial_discard_input(jrk_serial_port * port)
+{
+  PurgeComm(port->handle, PURGE_RXCLEAR);
+}
+
+#else
+
+static jrk_error * serial_errno_error(const char * context)
+{
+  int code = errno;
+  jrk_error * error = jrk_error_create("%s", strerror(code));
+  if (code == EACCES || code == EBUSY)
+  {
+    error = jrk_error_add_code(error, JRK_ERROR_ACCESS_DENIED);
+  }
+  return jrk_error_add(error, "%s", context);
+}
+
+static bool serial_baud_rate_to_speed(uint32_t baud_rate, speed_t * speed)
+{
+  switch (baud_rate)
+  {
+  case 1200: *speed = B1200; return true;
+  case 2400: *speed = B2400; return true;
+  case 4800: *speed = B4800; return true;
+  case 9600: *speed = B9600; return true;
+  case 19200: *speed = B19200; return true;
+  case 38400: *speed = B38400; return true;
+  case 57600: *speed = B57600; return true;
+  case 115200: *speed = B115200; return true;
+#ifdef B230400
+  case 230400: *speed = B230400; return true;
+#endif
+#ifdef B460800
+  case 460800: *speed = B460800; return true;
+#endif
+#ifdef B921600
+  case 921600: *speed = B921600; return true;
+#endif
+  default: return false;
+  }
+}
+
+static jrk_error * serial_port_open_core(jrk_serial_port * port,
+  const char * name, uint32_t baud_rate)
+{
+  speed_t speed;
+  if (!serial_baud_rate_to_speed(baud_rate, &speed))
+  {
+    return jrk_error_create("Unsupported baud rate: %u.",
+      (unsigned int)baud_rate);
+  }
+
+  port->fd = open(name, O_RDWR | O_NOCTTY | O_CLOEXEC);
+  if (port->fd == -1)
+  {
+    return serial_errno_error("Failed to open the serial port.");
+  }
+
+  struct termios options;
+  if (tcgetattr(port->fd, &options))
+  {
+    return serial_errno_error("Failed to get the serial port settings.");
+  }
+
+  // Raw 8-N-1 with no flow control.  Reads return whatever data is available;
+  // serial_read() uses poll() to implement its timeout.
+  cfmakeraw(&options);
+  options.c_cflag &= ~CSTOPB;
+#ifdef CRTSCTS
+  options.c_cflag &= ~CRTSCTS;
+#endif
+  options.c_cflag |= CLOCAL | CREAD;
+  options.c_cc[VMIN] = 0;
+  options.c_cc[VTIME] = 0;
+  cfsetispeed(&options, speed);
+  cfsetospeed(&options, speed);
+
+  if (tcsetattr(port->fd, TCSANOW, &options))
+  {
+    return serial_errno_error("Failed to set the serial port settings.");
+  }
+
+  tcflush(port->fd, TCIOFLUSH);
+
+  return NULL;
+}
+
+static void serial_port_close_core(jrk_serial_port * port)
+{
+  if (port->fd != -1)
+  {
+    close(port->fd);
+  }
+}
+
+static jrk_error * serial_write(jrk_serial_port * port,
+  const uint8_t * data, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t result = write(port->fd, data, length);
+    if (result < 0)
+    {
+      if (errno == EINTR) { continue; }
+      return serial_errno_error("Failed to write to the serial port.");
+    }
+    data += result;
+    length -= result;
+  }
+  return NULL;
+}
+
+static jrk_error * serial_read(jrk_serial_port * port,
+  uint8_t * data, size_t length)
+{
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  size_t received = 0;
+  while (received < length)
+  {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    int64_t elapsed_ms = (int64_t)(now.tv_sec - start.tv_sec) * 1000 +
+      (now.tv_nsec - start.tv_nsec) / 1000000;
+    if (elapsed_ms >= SERIAL_RESPONSE_TIMEOUT_MS) { break; }
+
+    struct pollfd pfd = { port->fd, POLLIN, 0 };
+    int result = poll(&pfd, 1, SERIAL_RESPONSE_TIMEOUT_MS - elapsed_ms);
+    if (result < 0)
+    {
+      if (errno == EINTR) { continue; }
+      return serial_errno_error("Failed to wait for serial port data.");
+    }
+    if (result == 0) { break; }
+
+    ssize_t count = read(port->fd, data + received, length - received);
+    if (count < 0)
+    {
+      if (errno == EINTR || errno == EAGAIN) { continue; }
+      return serial_errno_error("Failed to read from the serial port.");
+    }
+    if (count == 0 && (pfd.revents & (POLLHUP | POLLERR)))
+    {
+      return jrk_error_add_code(
+        jrk_error_create("The serial port was disconnected."),
+        JRK_ERROR_DEVICE_DISCONNECTED);
+    }
+    received += count;
+  }
+
+  if (received != length)
+  {
+    return jrk_error_add_code(jrk_error_create(
+      "Timeout while waiting for a response.  Expected %u bytes, got %u.",
+      (unsigned int)length, (unsigned int)received), JRK_ERROR_TIMEOUT);
+  }
+  return NULL;
+}
+
+static void serial_discard_input(jrk_serial_port * port)
+{
+  tcflush(port->fd, TCIFLUSH);
+}
+
+#endif
+
+jrk_error * jrk_serial_port_open(const char * name, uint32_t baud_rate,
+  jrk_serial_port ** port)
+{
+  if (port == NULL)
+  {
+    return jrk_error_create("Serial port output pointer is null.");
+  }
+
+  *port = NULL;
+
+  if (name == NULL)
+  {
+    return jrk_error_create("Serial port name is null.");
+  }
+
+  jrk_error * error = NULL;
+
+  jrk_serial_port * new_port = NULL;
+  if (error == NULL)
+  {
+    new_port = (jrk_serial_port *)calloc(1, sizeof(jrk_serial_port));
+    if (new_port == NULL) { error = &jrk_error_no_memory; }
+  }
+
+  if (error == NULL)
+  {
+#ifdef _WIN32
+    new_port->handle = INVALID_HANDLE_VALUE;
+#else
+    new_port->fd = -1;
+#endif
+    error = serial_port_open_core(new_port, name, baud_rate);
+  }
+
+  if (error == NULL)
+  {
+    *port = new_port;
+    new_port = NULL;
+  }
+
+  jrk_serial_port_close(new_port);
+
+  if (error != NULL)
+  {
+    error = jrk_error_add(error,
+      "There was an error opening serial port %s.", name);
+  }
+
+  return error;
+}
+
+void jrk_serial_port_close(jrk_serial_port * port)
+{
+  if (port != NULL)
+  {
+    serial_port_close_core(port);
+    free(port);
+  }
+}
+
+// Computes the 7-bit CRC used by the jrk.  The result should be sent as an
+// extra byte after the command.
+static uint8_t serial_crc7(const uint8_t * message, size_t length)
+{
+  uint8_t crc = 0;
+  for (size_t i = 0; i < length; i++)
+  {
+    crc ^= message[i];
+    for (size_t j = 0; j < 8; j++)
+    {
+      if (crc & 1) { crc ^= 0x91; }
+      crc >>= 1;
+    }
+  }
+  return crc;
+}
+
+// Sends a command.  The data bytes must already be 7-bit values.  This adds the
+// Pololu protocol header and the CRC byte if they are enabled.
+static jrk_error * serial_send_command(jrk_serial_port * port,
+  uint16_t device_number, uint32_t flags, uint8_t command,
+  const uint8_t * data, size_t data_length)
+{
+  // Longest command: Pololu protocol with a 14-bit device number, a "Set RAM
+  // settings" command with a full data block, and a CRC byte.
+  uint8_t packet[4 + 2 + JRK_MAX_SERIAL_SET_RAM_SETTINGS_SIZE + 1 + 1];
+  assert(data_length <= 2 + JRK_MAX_SERIAL_SET_RAM_SETTINGS_SIZE + 1);
+
+  size_t length = 0;
+  if (flags & (1 << JRK_SERIAL_FLAG_POLOLU_PROTOCOL))
+  {
+    packet[length++] = JRK_SERIAL_POLOLU_PROTOCOL_START;
+    packet[length++] = device_number & 0x7F;
+    if (flags & (1 << JRK_SERIAL_FLAG_14BIT_DEVICE_NUMBER))
+    {
+      packet[length++] = device_number >> 7 & 0x7F;
+    }
+    packet[length++] = command & 0x7F;
+  }
+  else
+  {
+    packet[length++] = command;
+  }
+
+  memcpy(packet + length, data, data_length);
+  length += data_length;
+
+  if (flags & (1 << JRK_SERIAL_FLAG_CRC))
+  {
+    packet[length] = serial_crc7(packet, length);
+    length++;
+  }
+
+  return serial_write(port, packet, length);
+}
+
+// Sends a command that reads a block of data, like "Get variables", and reads
+// the response, splitting it into several commands if necessary.
+static jrk_error * serial_read_block(jrk_serial_port * port,
+  uint16_t device_number, uint32_t flags, uint8_t command,
+  size_t index, size_t length, uint8_t * output)
+{
+  jrk_error * error = NULL;
+  while (error == NULL && length > 0)
+  {
+    size_t chunk = length;
+    if (chunk > JRK_MAX_SERIAL_RESPONSE_SIZE)
+    {
+      chunk = JRK_MAX_SERIAL_RESPONSE_SIZE;
+    }
+
+    // Throw away anything left over from an earlier command that timed out so
+    // that it does not get mistaken for the response to this one.
+    serial_discard_input(port);
+
+    uint8_t data[2] = { index & 0x7F, chunk };
+    error = serial_send_command(port, device_number, flags, command, data, 2);
+
+    if (error == NULL)
+    {
+      error = serial_read(port, output, chunk);
+    }
+
+    index += chunk;
+    output += chunk;
+    length -= chunk;
+  }
+  return error;
+}
+
+// Sends a command that reads and clears a variable, and reads the response.
+static jrk_error * serial_read_and_clear(jrk_serial_port * port,
+  uint16_t device_number, uint32_t flags, uint8_t command,
+  size_t length, uint8_t * output)
+{
+  serial_discard_input(port);
+  jrk_error * error = serial_send_command(port, device_number, flags,
+    command, NULL, 0);
+  if (error == NULL)
+  {
+    error = serial_read(port, output, length);
+  }
+  return error;
+}
+
+// Implements the "Get variables" USB request, including its flags.  The serial
+// "Get variables" command cannot clear anything, so we read the variables and
+// then send a separate command for each thing that needs to be cleared.  Those
+// commands return the latest value before clearing it, which we put in the
+// output if it overlaps the segment that was read.
+static jrk_error * serial_get_variables(jrk_serial_port * port,
+  uint16_t device_number, uint32_t flags, uint16_t get_flags,
+  size_t index, size_t length, uint8_t * output)
+{
+  static const struct
+  {
+    uint8_t flag;
+    uint8_t command;
+    uint8_t offset;
+    uint8_t size;
+  } clear_commands[] = {
+    { JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_HALTING,
+      JRK_CMD_GET_ERROR_FLAGS_HALTING_SERIAL,
+      JRK_VAR_ERROR_FLAGS_HALTING, 2 },
+    { JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_OCCURRED,
+      JRK_CMD_GET_ERROR_FLAGS_OCCURRED_SERIAL,
+      JRK_VAR_ERROR_FLAGS_OCCURRED, 2 },
+    { JRK_GET_VARIABLES_FLAG_CLEAR_CURRENT_CHOPPING_OCCURRENCE_COUNT,
+      JRK_CMD_GET_CURRENT_CHOPPING_OCCURRENCE_COUNT,
+      JRK_VAR_CURRENT_CHOPPING_OCCURRENCE_COUNT, 1 },
+  };
+
+  jrk_error * error = serial_read_block(port, device_number, flags,
+    JRK_CMD_GET_VARIABLES, index, length, output);
+
+  for (size_t i = 0; i < sizeof(clear_commands) / sizeof(clear_commands[0]); i++)
+  {
+    if (error != NULL) { break; }
+    if (!(get_flags >> clear_commands[i].flag & 1)) { continue; }
+
+    uint8_t value[2];
+    error = serial_read_and_clear(port, device_number, flags,
+      clear_commands[i].command, clear_commands[i].size, value);
+
+    for (size_t j = 0; error == NULL && j < clear_commands[i].size; j++)
+    {
+      size_t offset = clear_commands[i].offset + j;
+      if (offset >= index && offset < index + length)
+      {
+        output[offset - index] = value[j];
+      }
+    }
+  }
+
+  return error;
+}
+
+// Implements the "Set RAM settings" USB request.  Each serial command can only
+// hold a few bytes, and the most significant bits of the bytes are sent
+// together in a separate byte at the end.
+static jrk_error * serial_set_ram_settings(jrk_serial_port * port,
+  uint16_t device_number, uint32_t flags,
+  size_t index, size_t length, const uint8_t * input)
+{
+  jrk_error * error = NULL;
+  while (error == NULL && length > 0)
+  {
+    size_t chunk = length;
+    if (chunk > JRK_MAX_SERIAL_SET_RAM_SETTINGS_SIZE)
+    {
+      chunk = JRK_MAX_SERIAL_SET_RAM_SETTINGS_SIZE;
+    }
+
+    uint8_t data[2 + JRK_MAX_SERIAL_SET_RAM_SETTINGS_SIZE + 1];
+    size_t data_length = 0;
+    data[data_length++] = index & 0x7F;
+    data[data_length++] = chunk;
+    uint8_t msbs = 0;
+    for (size_t i = 0; i < chunk; i++)
+    {
+      data[data_length++] = input[i] & 0x7F;
+      msbs |= (input[i] >> 7 & 1) << i;
+    }
+    data[data_length++] = msbs;
+
+    error = serial_send_command(port, device_number, flags,
+      JRK_CMD_SET_RAM_SETTINGS, data, data_length);
+
+    index += chunk;
+    input += chunk;
+    length -= chunk;
+  }
+  return error;
+}
+
+// Sends a command with a 14-bit two's complement argument, like "Force duty
+// cycle".
+static jrk_error * serial_send_command_14bit(jrk_serial_port * port,
+  uint16_t device_number, uint32_t flags, uint8_t command, uint16_t value)
+{
+  uint8_t data[2] = { value & 0x7F, value >> 7 & 0x7F };
+  return serial_send_command(port, device_number, flags, command, data, 2);
+}
+
+jrk_error * jrk_serial_control_transfer(jrk_serial_port * port,
+  uint16_t device_number, uint32_t flags,
+  uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+  uint8_t * buffer, size_t length, size_t * transferred)
+{
+  assert(port != NULL);
+
+  if (transferred != NULL) { *transferred = 0; }
+
+  if (index + length > 0x80)
+  {
+    // Offsets are sent as 7-bit values.
+    return jrk_error_create(
+      "The requested offset is too large for the serial protocol.");
+  }
+
+  jrk_error * error = NULL;
+
+  if (request_type == 0xC0 && request == JRK_CMD_GET_VARIABLES)
+  {
+    error = serial_get_variables(port, device_number, flags, value,
+      index, length, buffer);
+  }
+  else if (request_type == 0xC0 && (request == JRK_CMD_GET_EEPROM_SETTINGS ||
+      request == JRK_CMD_GET_RAM_SETTINGS))
+  {
+    error = serial_read_block(port, device_number, flags, request,
+      index, length, buffer);
+  }
+  else if (request_type == 0x40 && request == JRK_CMD_SET_RAM_SETTINGS)
+  {
+    error = serial_set_ram_settings(port, device_number, flags,
+      index, length, buffer);
+  }
+  else if (request_type == 0x40 && request == JRK_CMD_SET_TARGET_USB)
+  {
+    uint8_t command = JRK_CMD_SET_TARGET_SERIAL | (value & 0x1F);
+    uint8_t data[1] = { value >> 5 & 0x7F };
+    error = serial_send_command(port, device_number, flags, command, data, 1);
+  }
+  else if (request_type == 0x40 && request == JRK_CMD_STOP_MOTOR_USB)
+  {
+    error = serial_send_command(port, device_number, flags,
+      JRK_CMD_STOP_MOTOR_SERIAL, NULL, 0);
+  }
+  else if (request_type == 0x40 && (request == JRK_CMD_FORCE_DUTY_CYCLE_TARGET ||
+      request == JRK_CMD_FORCE_DUTY_CYCLE))
+  {
+    error = serial_send_command_14bit(port, device_number, flags,
+      request, value);
+  }
+  else
+  {
+    return jrk_error_create("This command is not supported over serial.");
+  }
+
+  if (error == NULL && transferred != NULL)
+  {
+    *transferred = length;
+  }
+
+  return error;
+}
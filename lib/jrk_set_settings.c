@@ -1,6 +1,6 @@
 #include "jrk_internal.h"
 
-static void jrk_write_settings_to_buffer(const jrk_settings * settings, uint8_t * buf)
+void jrk_write_settings_to_buffer(const jrk_settings * settings, uint8_t * buf)
 {
   assert(settings != NULL);
   assert(buf != NULL);
@@ -411,17 +411,17 @@ static void jrk_write_settings_to_buffer(const jrk_settings * settings, uint8_t
   }
 }
 
-jrk_error * jrk_set_eeprom_settings(jrk_handle * handle, const jrk_settings * settings)
+// Makes a fixed copy of the settings that is valid for the device the handle
+// is connected to, and encodes it into the buffer, which must be
+// JRK_SETTINGS_SIZE bytes long.  If the handle does not know what product it
+// is connected to (a serial handle opened without a product), the settings
+// keep their own product and firmware version.
+static jrk_error * jrk_settings_to_device_buffer(jrk_handle * handle,
+  const jrk_settings * settings, uint8_t * buf)
 {
-  if (handle == NULL)
-  {
-    return jrk_error_create("Handle is null.");
-  }
-
-  if (settings == NULL)
-  {
-    return jrk_error_create("Settings object is null.");
-  }
+  assert(handle != NULL);
+  assert(settings != NULL);
+  assert(buf != NULL);
 
   jrk_error * error = NULL;
 
@@ -440,29 +440,57 @@ jrk_error * jrk_set_eeprom_settings(jrk_handle * handle, const jrk_settings * se
   // on its own before calling this so there should be nothing to fix here.
   if (error == NULL)
   {
-    const jrk_device * device = jrk_handle_get_device(handle);
-    uint32_t product = jrk_device_get_product(device);
-    uint16_t firmware_version = jrk_device_get_firmware_version(device);
-    error = jrk_settings_fix_and_change_product(
-      fixed_settings, product, firmware_version, NULL);
+    uint32_t product = jrk_handle_get_product(handle);
+    uint16_t firmware_version = jrk_handle_get_firmware_version(handle);
+    if (product == 0)
+    {
+      error = jrk_settings_fix(fixed_settings, NULL);
+    }
+    else
+    {
+      error = jrk_settings_fix_and_change_product(
+        fixed_settings, product, firmware_version, NULL);
+    }
   }
 
   // Construct a buffer holding the bytes we want to write.
-  uint8_t buf[JRK_SETTINGS_SIZE];
-  memset(buf, 0, sizeof(buf));
+  memset(buf, 0, JRK_SETTINGS_SIZE);
   if (error == NULL)
   {
     jrk_write_settings_to_buffer(fixed_settings, buf);
   }
 
+  jrk_settings_free(fixed_settings);
+
+  return error;
+}
+
+jrk_error * jrk_set_eeprom_settings(jrk_handle * handle, const jrk_settings * settings)
+{
+  if (handle == NULL)
+  {
+    return jrk_error_create("Handle is null.");
+  }
+
+  if (settings == NULL)
+  {
+    return jrk_error_create("Settings object is null.");
+  }
+
+  jrk_error * error = NULL;
+
+  uint8_t buf[JRK_SETTINGS_SIZE];
+  if (error == NULL)
+  {
+    error = jrk_settings_to_device_buffer(handle, settings, buf);
+  }
+
   // Write the bytes to the device.
   for (uint8_t i = 1; i < sizeof(buf) && error == NULL; i++)
   {
     error = jrk_set_eeprom_setting_byte(handle, i, buf[i]);
   }
 
-  jrk_settings_free(fixed_settings);
-
   if (error != NULL)
   {
     error = jrk_error_add(error,
@@ -472,8 +500,91 @@ jrk_error * jrk_set_eeprom_settings(jrk_handle * handle, const jrk_settings * se
   return error;
 }
 
-jrk_error * jrk_set_ram_settings(jrk_handle * handle, const jrk_settings * settings)
+// Writes the bytes in buf, which is JRK_SETTINGS_SIZE bytes long, that are
+// different from what the EEPROM holds now.  If verify is true, it then reads
+// the EEPROM back and makes sure it matches.  The callback is optional and is
+// called after each request, as described for jrk_apply_eeprom_settings().
+static jrk_error * write_eeprom_settings_buffer_delta(jrk_handle * handle,
+  const uint8_t * buf, bool verify, jrk_progress_callback * callback,
+  void * user_data, size_t * bytes_written)
 {
+  // Read what is in the EEPROM now so we can skip the bytes that are
+  // already correct.
+  uint8_t old_buf[JRK_SETTINGS_SIZE];
+  jrk_error * error = jrk_get_eeprom_settings_buffer(handle, old_buf);
+  if (error != NULL) { return error; }
+
+  // Count the requests: the read we just did, one write per byte that is
+  // different, and the read for verification.
+  uint32_t progress = 1;
+  uint32_t max_progress = verify ? 2 : 1;
+  for (uint8_t i = 1; i < JRK_SETTINGS_SIZE; i++)
+  {
+    if (buf[i] != old_buf[i]) { max_progress++; }
+  }
+
+  if (callback != NULL)
+  {
+    callback(user_data, progress, max_progress);
+  }
+
+  // Write the bytes that are different to the device.
+  for (uint8_t i = 1; i < JRK_SETTINGS_SIZE && error == NULL; i++)
+  {
+    if (buf[i] == old_buf[i]) { continue; }
+
+    error = jrk_set_eeprom_setting_byte(handle, i, buf[i]);
+    if (error == NULL)
+    {
+      if (bytes_written != NULL) { (*bytes_written)++; }
+      if (callback != NULL) { callback(user_data, ++progress, max_progress); }
+    }
+  }
+
+  if (error != NULL || !verify) { return error; }
+
+  // Read the settings back and make sure they match.
+  uint8_t new_buf[JRK_SETTINGS_SIZE];
+  error = jrk_get_eeprom_settings_buffer(handle, new_buf);
+  if (error != NULL) { return error; }
+
+  size_t mismatch_count = 0;
+  uint8_t first_mismatch = 0;
+  for (uint8_t i = 1; i < JRK_SETTINGS_SIZE; i++)
+  {
+    if (buf[i] == new_buf[i]) { continue; }
+    if (mismatch_count == 0) { first_mismatch = i; }
+    mismatch_count++;
+  }
+
+  if (mismatch_count != 0)
+  {
+    error = jrk_error_create(
+      "Verification failed: %u setting bytes did not match after writing them, "
+      "starting at offset 0x%02x.",
+      (unsigned int)mismatch_count, first_mismatch);
+    return jrk_error_add_code(error, JRK_ERROR_VERIFY_FAILED);
+  }
+
+  if (callback != NULL)
+  {
+    callback(user_data, max_progress, max_progress);
+  }
+
+  return NULL;
+}
+
+// The code shared by jrk_set_eeprom_settings_delta() and
+// jrk_apply_eeprom_settings().
+static jrk_error * set_eeprom_settings_delta(jrk_handle * handle,
+  const jrk_settings * settings, bool verify,
+  jrk_progress_callback * callback, void * user_data, size_t * bytes_written)
+{
+  if (bytes_written != NULL)
+  {
+    *bytes_written = 0;
+  }
+
   if (handle == NULL)
   {
     return jrk_error_create("Handle is null.");
@@ -481,39 +592,60 @@ jrk_error * jrk_set_ram_settings(jrk_handle * handle, const jrk_settings * setti
 
   if (settings == NULL)
   {
-    return jrk_error_create("RAM settings object is null.");
+    return jrk_error_create("Settings object is null.");
   }
 
-  jrk_error * error = NULL;
-
-  jrk_settings * fixed_settings = NULL;
+  uint8_t buf[JRK_SETTINGS_SIZE];
+  jrk_error * error = jrk_settings_to_device_buffer(handle, settings, buf);
 
-  // Copy the settings so we can fix them without modifying the input ones,
-  // which would be surprising to the caller.
   if (error == NULL)
   {
-    error = jrk_settings_copy(settings, &fixed_settings);
+    error = write_eeprom_settings_buffer_delta(handle, buf, verify,
+      callback, user_data, bytes_written);
   }
 
-  // Fix the settings silently to make sure we don't apply invalid settings to
-  // the device.
-  // A good app call jrk_settings_fix or jrk_settings_fix_and_change_product
-  // on its own before calling this so there should be nothing to fix here.
-  if (error == NULL)
+  if (error != NULL)
+  {
+    error = jrk_error_add(error,
+      "There was an error applying settings to the device.");
+  }
+
+  return error;
+}
+
+jrk_error * jrk_set_eeprom_settings_delta(jrk_handle * handle,
+  const jrk_settings * settings, size_t * bytes_written)
+{
+  return set_eeprom_settings_delta(handle, settings, false,
+    NULL, NULL, bytes_written);
+}
+
+jrk_error * jrk_apply_eeprom_settings(jrk_handle * handle,
+  const jrk_settings * settings, jrk_progress_callback * callback,
+  void * user_data, size_t * bytes_written)
+{
+  return set_eeprom_settings_delta(handle, settings, true,
+    callback, user_data, bytes_written);
+}
+
+jrk_error * jrk_set_ram_settings(jrk_handle * handle, const jrk_settings * settings)
+{
+  if (handle == NULL)
   {
-    const jrk_device * device = jrk_handle_get_device(handle);
-    uint32_t product = jrk_device_get_product(device);
-    uint16_t firmware_version = jrk_device_get_firmware_version(device);
-    error = jrk_settings_fix_and_change_product(
-      fixed_settings, product, firmware_version, NULL);
+    return jrk_error_create("Handle is null.");
   }
 
-  // Construct a buffer holding the bytes we want to write.
+  if (settings == NULL)
+  {
+    return jrk_error_create("RAM settings object is null.");
+  }
+
+  jrk_error * error = NULL;
+
   uint8_t buf[JRK_SETTINGS_SIZE];
-  memset(buf, 0, sizeof(buf));
   if (error == NULL)
   {
-    jrk_write_settings_to_buffer(fixed_settings, buf);
+    error = jrk_settings_to_device_buffer(handle, settings, buf);
   }
 
   // Add context here because any error from
@@ -530,7 +662,5 @@ jrk_error * jrk_set_ram_settings(jrk_handle * handle, const jrk_settings * setti
       1, sizeof(buf) - 1, buf + 1);
   }
 
-  jrk_settings_free(fixed_settings);
-
   return error;
 }
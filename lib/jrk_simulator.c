@@ -0,0 +1,813 @@
+// A simulated jrk that runs inside this process and answers the same USB
+// control transfers as the real firmware.
+
+#include "jrk_internal.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+// The firmware version reported by simulated jrks.
+#define SIMULATOR_FIRMWARE_VERSION 0x0107
+
+// The speed of the simulated motor at a duty cycle of 600, in feedback units
+// per second.
+#define SIMULATOR_MOTOR_MAX_SPEED 4000.0
+
+// The time constant of the simulated motor's speed, in seconds.
+#define SIMULATOR_MOTOR_TIME_CONSTANT 0.05
+
+// The current drawn by the simulated motor at a duty cycle of 600, in mA.
+#define SIMULATOR_MOTOR_MAX_CURRENT 3000
+
+#define SIMULATOR_VIN_VOLTAGE 12000
+
+// When running in real time, never simulate more than this many PID periods
+// while handling one request.  If the program goes a long time without talking
+// to the simulator, the extra time is skipped.
+#define SIMULATOR_MAX_CATCH_UP_PERIODS 10000
+
+#ifdef _WIN32
+typedef SRWLOCK simulator_mutex;
+#else
+typedef pthread_mutex_t simulator_mutex;
+#endif
+
+struct jrk_simulator
+{
+  // Held while handling a request or changing how time passes, so that
+  // handles for the same simulator can be used from different threads, just
+  // like handles for a real jrk.
+  simulator_mutex mutex;
+  bool mutex_initialized;
+
+  uint8_t product;
+  char * serial_number;
+  char * os_id;
+
+  bool real_time;
+  uint64_t last_sync_time_ms;
+
+  uint8_t eeprom[JRK_SETTINGS_SIZE];
+  uint8_t ram[JRK_SETTINGS_SIZE];
+
+  // Time that has passed but has not been simulated yet because it is less
+  // than one PID period.
+  uint32_t pending_ms;
+
+  // Firmware state, in the units that the jrk reports.
+  uint16_t target;
+  uint16_t feedback;
+  uint16_t scaled_feedback;
+  int16_t integral;
+  int16_t duty_cycle_target;
+  int16_t duty_cycle;
+  int16_t last_duty_cycle;
+  int16_t previous_error;
+  uint16_t pid_period_count;
+  uint16_t error_flags_halting;
+  uint16_t error_flags_occurred;
+  uint8_t force_mode;
+  int16_t forced_duty_cycle;
+  uint16_t current;
+  uint32_t up_time;
+
+  // The state of the motor and the analog feedback potentiometer.
+  double position;
+  double speed;
+};
+
+static bool simulator_mutex_init(jrk_simulator * sim)
+{
+#ifdef _WIN32
+  InitializeSRWLock(&sim->mutex);
+  return true;
+#else
+  return pthread_mutex_init(&sim->mutex, NULL) == 0;
+#endif
+}
+
+static void simulator_mutex_destroy(jrk_simulator * sim)
+{
+#ifndef _WIN32
+  pthread_mutex_destroy(&sim->mutex);
+#else
+  (void)sim;
+#endif
+}
+
+static void simulator_lock(jrk_simulator * sim)
+{
+#ifdef _WIN32
+  AcquireSRWLockExclusive(&sim->mutex);
+#else
+  pthread_mutex_lock(&sim->mutex);
+#endif
+}
+
+static void simulator_unlock(jrk_simulator * sim)
+{
+#ifdef _WIN32
+  ReleaseSRWLockExclusive(&sim->mutex);
+#else
+  pthread_mutex_unlock(&sim->mutex);
+#endif
+}
+
+static int32_t clamp(int32_t value, int32_t min, int32_t max)
+{
+  if (value < min) { return min; }
+  if (value > max) { return max; }
+  return value;
+}
+
+static jrk_error * simulator_load_defaults(jrk_simulator * sim)
+{
+  jrk_error * error = NULL;
+
+  jrk_settings * settings = NULL;
+  if (error == NULL)
+  {
+    error = jrk_settings_create(&settings);
+  }
+
+  if (error == NULL)
+  {
+    jrk_settings_set_product(settings, sim->product);
+    jrk_settings_set_firmware_version(settings, SIMULATOR_FIRMWARE_VERSION);
+    jrk_settings_fill_with_defaults(settings);
+
+    // The firmware's defaults for these settings are not zero, but
+    // jrk_settings_fill_with_defaults() leaves them that way.
+    jrk_settings_set_serial_baud_rate(settings, 9600);
+    jrk_settings_set_max_duty_cycle_while_feedback_out_of_range(settings, 600);
+
+    memset(sim->eeprom, 0, sizeof(sim->eeprom));
+    jrk_write_settings_to_buffer(settings, sim->eeprom);
+  }
+
+  jrk_settings_free(settings);
+  return error;
+}
+
+// Does what the firmware does when it starts up or gets a "Reinitialize"
+// command.
+static jrk_error * simulator_reinitialize(jrk_simulator * sim, bool reset_errors)
+{
+  jrk_error * error = NULL;
+
+  if (sim->eeprom[JRK_SETTING_NOT_INITIALIZED])
+  {
+    error = simulator_load_defaults(sim);
+  }
+
+  if (error == NULL)
+  {
+    memcpy(sim->ram, sim->eeprom, JRK_SETTINGS_SIZE);
+    sim->integral = 0;
+    if (reset_errors)
+    {
+      sim->error_flags_halting = 1 << JRK_ERROR_AWAITING_COMMAND;
+    }
+  }
+
+  return error;
+}
+
+// Reads the analog feedback potentiometer and calculates feedback and scaled
+// feedback from it.
+static void simulator_update_feedback(jrk_simulator * sim)
+{
+  const uint8_t * ram = sim->ram;
+  uint8_t feedback_mode = ram[JRK_SETTING_FEEDBACK_MODE];
+
+  if (feedback_mode == JRK_FEEDBACK_MODE_NONE)
+  {
+    sim->feedback = 0;
+    sim->scaled_feedback = 0;
+    return;
+  }
+
+  if (feedback_mode == JRK_FEEDBACK_MODE_FREQUENCY)
+  {
+    // The feedback is proportional to the speed of the motor.
+    sim->feedback = clamp(2048 + (int32_t)(sim->speed / 2), 0, 4095);
+  }
+  else
+  {
+    sim->feedback = clamp((int32_t)sim->position, 0, 4095);
+  }
+
+  int32_t minimum = read_uint16_t(ram + JRK_SETTING_FEEDBACK_MINIMUM);
+  int32_t maximum = read_uint16_t(ram + JRK_SETTING_FEEDBACK_MAXIMUM);
+  int32_t scaled = 0;
+  if (maximum > minimum)
+  {
+    scaled = clamp(((int32_t)sim->feedback - minimum) * 4095 / (maximum - minimum),
+      0, 4095);
+  }
+  if (ram[JRK_SETTING_OPTIONS_BYTE2] >> JRK_OPTIONS_BYTE2_FEEDBACK_INVERT & 1)
+  {
+    scaled = 4095 - scaled;
+  }
+  sim->scaled_feedback = scaled;
+}
+
+// Runs the PID algorithm and returns the new duty cycle target.
+static int16_t simulator_run_pid(jrk_simulator * sim)
+{
+  const uint8_t * ram = sim->ram;
+
+  if (ram[JRK_SETTING_FEEDBACK_MODE] == JRK_FEEDBACK_MODE_NONE)
+  {
+    // In open-loop mode, the target determines the duty cycle target directly.
+    return clamp((int32_t)sim->target - 2048, -600, 600);
+  }
+
+  int32_t error = (int32_t)sim->scaled_feedback - sim->target;
+
+  int32_t integral_limit = read_uint16_t(ram + JRK_SETTING_INTEGRAL_LIMIT);
+  sim->integral = clamp(sim->integral + error, -integral_limit, integral_limit);
+
+  double p = (double)read_uint16_t(ram + JRK_SETTING_PROPORTIONAL_MULTIPLIER)
+    / (1 << ram[JRK_SETTING_PROPORTIONAL_EXPONENT]);
+  double i = (double)read_uint16_t(ram + JRK_SETTING_INTEGRAL_MULTIPLIER)
+    / (1 << ram[JRK_SETTING_INTEGRAL_EXPONENT]);
+  double d = (double)read_uint16_t(ram + JRK_SETTING_DERIVATIVE_MULTIPLIER)
+    / (1 << ram[JRK_SETTING_DERIVATIVE_EXPONENT]);
+
+  double output = -(p * error + i * sim->integral
+    + d * (error - sim->previous_error));
+  sim->previous_error = error;
+
+  return clamp((int32_t)output, -600, 600);
+}
+
+// Moves the duty cycle towards the duty cycle target, respecting the
+// acceleration, deceleration, and duty cycle limits.
+static int16_t simulator_limit_duty_cycle(const jrk_simulator * sim,
+  int16_t duty_cycle_target)
+{
+  const uint8_t * ram = sim->ram;
+
+  int32_t max_forward = read_uint16_t(ram + JRK_SETTING_MAX_DUTY_CYCLE_FORWARD);
+  int32_t max_reverse = read_uint16_t(ram + JRK_SETTING_MAX_DUTY_CYCLE_REVERSE);
+  int32_t target = clamp(duty_cycle_target, -max_reverse, max_forward);
+  int32_t current = sim->duty_cycle;
+
+  // Speeding up means moving away from zero.
+  bool speeding_up = (target > current && current >= 0) ||
+    (target < current && current <= 0);
+  uint16_t limit;
+  if (current > 0 || (current == 0 && target > 0))
+  {
+    limit = read_uint16_t(ram + (speeding_up ?
+      JRK_SETTING_MAX_ACCELERATION_FORWARD : JRK_SETTING_MAX_DECELERATION_FORWARD));
+  }
+  else
+  {
+    limit = read_uint16_t(ram + (speeding_up ?
+      JRK_SETTING_MAX_ACCELERATION_REVERSE : JRK_SETTING_MAX_DECELERATION_REVERSE));
+  }
+
+  return clamp(target, current - limit, current + limit);
+}
+
+// Simulates the motor for the specified number of seconds.
+static void simulator_update_motor(jrk_simulator * sim, double seconds)
+{
+  double duty_cycle = sim->duty_cycle;
+  if (sim->ram[JRK_SETTING_OPTIONS_BYTE2] >> JRK_OPTIONS_BYTE2_MOTOR_INVERT & 1)
+  {
+    duty_cycle = -duty_cycle;
+  }
+
+  double target_speed = duty_cycle / 600 * SIMULATOR_MOTOR_MAX_SPEED;
+  double fraction = seconds / SIMULATOR_MOTOR_TIME_CONSTANT;
+  if (fraction > 1) { fraction = 1; }
+  sim->speed += (target_speed - sim->speed) * fraction;
+  sim->position += sim->speed * seconds;
+
+  // The potentiometer has mechanical stops at both ends.
+  if (sim->position < 0) { sim->position = 0; sim->speed = 0; }
+  if (sim->position > 4095) { sim->position = 4095; sim->speed = 0; }
+
+  sim->current = abs(sim->duty_cycle) * SIMULATOR_MOTOR_MAX_CURRENT / 600;
+}
+
+// Simulates one PID period.
+static void simulator_run_period(jrk_simulator * sim, uint16_t pid_period)
+{
+  sim->last_duty_cycle = sim->duty_cycle;
+
+  simulator_update_feedback(sim);
+
+  int16_t duty_cycle_target = simulator_run_pid(sim);
+  if (sim->force_mode == JRK_FORCE_MODE_DUTY_CYCLE_TARGET)
+  {
+    duty_cycle_target = sim->forced_duty_cycle;
+  }
+  sim->duty_cycle_target = duty_cycle_target;
+
+  if (sim->error_flags_halting)
+  {
+    sim->duty_cycle = 0;
+    sim->integral = 0;
+  }
+  else if (sim->force_mode == JRK_FORCE_MODE_DUTY_CYCLE)
+  {
+    sim->duty_cycle = sim->forced_duty_cycle;
+  }
+  else
+  {
+    sim->duty_cycle = simulator_limit_duty_cycle(sim, duty_cycle_target);
+  }
+
+  sim->error_flags_occurred |= sim->error_flags_halting;
+
+  simulator_update_motor(sim, pid_period / 1000.0);
+
+  sim->pid_period_count++;
+  sim->up_time += pid_period;
+}
+
+// Simulates the time that has passed since the last time this was called.
+// Simulates the specified amount of time.  The caller must hold the mutex.
+static void simulator_advance(jrk_simulator * sim, uint32_t milliseconds)
+{
+  sim->pending_ms += milliseconds;
+  while (true)
+  {
+    // Read the PID period every time because it is a RAM setting.
+    uint16_t pid_period = read_uint16_t(sim->ram + JRK_SETTING_PID_PERIOD);
+    if (pid_period == 0) { pid_period = 1; }
+    if (sim->pending_ms < pid_period) { break; }
+    sim->pending_ms -= pid_period;
+    simulator_run_period(sim, pid_period);
+  }
+}
+
+static void simulator_sync(jrk_simulator * sim)
+{
+  if (!sim->real_time) { return; }
+
+  uint64_t now = jrk_time_ms();
+  uint64_t elapsed = now - sim->last_sync_time_ms;
+  sim->last_sync_time_ms = now;
+
+  uint16_t pid_period = read_uint16_t(sim->ram + JRK_SETTING_PID_PERIOD);
+  if (pid_period == 0) { pid_period = 1; }
+  if (elapsed > (uint64_t)pid_period * SIMULATOR_MAX_CATCH_UP_PERIODS)
+  {
+    sim->up_time += elapsed - pid_period * SIMULATOR_MAX_CATCH_UP_PERIODS;
+    elapsed = pid_period * SIMULATOR_MAX_CATCH_UP_PERIODS;
+  }
+  simulator_advance(sim, elapsed);
+}
+
+static void simulator_write_variables(const jrk_simulator * sim, uint8_t * buf)
+{
+  memset(buf, 0, JRK_VARIABLES_SIZE);
+  write_uint16_t(buf + JRK_VAR_INPUT, sim->target);
+  write_uint16_t(buf + JRK_VAR_TARGET, sim->target);
+  write_uint16_t(buf + JRK_VAR_FEEDBACK, sim->feedback);
+  write_uint16_t(buf + JRK_VAR_SCALED_FEEDBACK, sim->scaled_feedback);
+  write_int16_t(buf + JRK_VAR_INTEGRAL, sim->integral);
+  write_int16_t(buf + JRK_VAR_DUTY_CYCLE_TARGET, sim->duty_cycle_target);
+  write_int16_t(buf + JRK_VAR_DUTY_CYCLE, sim->duty_cycle);
+  buf[JRK_VAR_CURRENT_LOW_RES] = clamp(sim->current / 256, 0, 0xFF);
+  write_uint16_t(buf + JRK_VAR_PID_PERIOD_COUNT, sim->pid_period_count);
+  write_uint16_t(buf + JRK_VAR_ERROR_FLAGS_HALTING, sim->error_flags_halting);
+  write_uint16_t(buf + JRK_VAR_ERROR_FLAGS_OCCURRED, sim->error_flags_occurred);
+  buf[JRK_VAR_FLAG_BYTE1] = sim->force_mode;
+  write_uint16_t(buf + JRK_VAR_VIN_VOLTAGE, SIMULATOR_VIN_VOLTAGE);
+  write_uint16_t(buf + JRK_VAR_CURRENT, sim->current);
+  write_uint32_t(buf + JRK_VAR_UP_TIME, sim->up_time);
+  write_uint16_t(buf + JRK_VAR_ANALOG_READING_FBA,
+    clamp((int32_t)sim->position, 0, 4095) << 4);
+  write_uint16_t(buf + JRK_VAR_RAW_CURRENT, sim->current);
+  write_uint16_t(buf + JRK_VAR_ENCODED_HARD_CURRENT_LIMIT,
+    read_uint16_t(sim->ram + (sim->duty_cycle < 0 ?
+      JRK_SETTING_ENCODED_HARD_CURRENT_LIMIT_REVERSE :
+      JRK_SETTING_ENCODED_HARD_CURRENT_LIMIT_FORWARD)));
+  write_int16_t(buf + JRK_VAR_LAST_DUTY_CYCLE, sim->last_duty_cycle);
+}
+
+static jrk_error * simulator_check_range(size_t index, size_t length,
+  size_t size)
+{
+  if (index + length > size)
+  {
+    return jrk_error_create(
+      "The simulated jrk does not have data at offset %u with length %u.",
+      (unsigned int)index, (unsigned int)length);
+  }
+  return NULL;
+}
+
+static jrk_error * simulator_control_transfer_in(jrk_simulator * sim,
+  uint8_t request, uint16_t value, uint16_t index,
+  uint8_t * buffer, size_t length, size_t * transferred)
+{
+  jrk_error * error = NULL;
+
+  switch (request)
+  {
+  case JRK_CMD_GET_VARIABLES:
+    {
+      error = simulator_check_range(index, length, JRK_VARIABLES_SIZE);
+      if (error != NULL) { break; }
+
+      uint8_t vars[JRK_VARIABLES_SIZE];
+      simulator_write_variables(sim, vars);
+      memcpy(buffer, vars + index, length);
+      *transferred = length;
+
+      // The "Awaiting command" error can only be cleared by a command.
+      if (value >> JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_HALTING & 1)
+      {
+        sim->error_flags_halting &= 1 << JRK_ERROR_AWAITING_COMMAND;
+      }
+      if (value >> JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_OCCURRED & 1)
+      {
+        sim->error_flags_occurred = 0;
+      }
+      break;
+    }
+
+  case JRK_CMD_GET_EEPROM_SETTINGS:
+  case JRK_CMD_GET_RAM_SETTINGS:
+    {
+      error = simulator_check_range(index, length, JRK_SETTINGS_SIZE);
+      if (error != NULL) { break; }
+
+      const uint8_t * settings =
+        request == JRK_CMD_GET_RAM_SETTINGS ? sim->ram : sim->eeprom;
+      memcpy(buffer, settings + index, length);
+      *transferred = length;
+      break;
+    }
+
+  case JRK_CMD_GET_DEBUG_DATA:
+    *transferred = 0;
+    break;
+
+  case USB_REQUEST_GET_DESCRIPTOR:
+    {
+      if (value != ((USB_DESCRIPTOR_TYPE_STRING << 8) |
+          JRK_FIRMWARE_MODIFICATION_STRING_INDEX))
+      {
+        error = jrk_error_create(
+          "The simulated jrk does not have descriptor 0x%x.",
+          (unsigned int)value);
+        break;
+      }
+
+      // The firmware modification string is "-", meaning there is none.
+      const uint8_t descriptor[] = { 4, USB_DESCRIPTOR_TYPE_STRING, '-', 0 };
+      size_t size = length < sizeof(descriptor) ? length : sizeof(descriptor);
+      memcpy(buffer, descriptor, size);
+      *transferred = size;
+      break;
+    }
+
+  default:
+    error = jrk_error_create(
+      "The simulated jrk does not support request 0x%x.",
+      (unsigned int)request);
+    break;
+  }
+
+  return error;
+}
+
+static jrk_error * simulator_control_transfer_out(jrk_simulator * sim,
+  uint8_t request, uint16_t value, uint16_t index,
+  const uint8_t * buffer, size_t length)
+{
+  jrk_error * error = NULL;
+
+  switch (request)
+  {
+  case JRK_CMD_SET_RAM_SETTINGS:
+    error = simulator_check_range(index, length, JRK_SETTINGS_SIZE);
+    if (error != NULL) { break; }
+    memcpy(sim->ram + index, buffer, length);
+    break;
+
+  case JRK_CMD_SET_EEPROM_SETTING:
+    error = simulator_check_range(index, 1, JRK_SETTINGS_SIZE);
+    if (error != NULL) { break; }
+    sim->eeprom[index] = value;
+    break;
+
+  case JRK_CMD_REINITIALIZE:
+    error = simulator_reinitialize(sim,
+      !(value >> JRK_REINITIALIZE_FLAG_PRESERVE_ERRORS & 1));
+    break;
+
+  case JRK_CMD_SET_TARGET_USB:
+    sim->target = value > 4095 ? 4095 : value;
+    sim->force_mode = JRK_FORCE_MODE_NONE;
+    sim->error_flags_halting &= ~(1 << JRK_ERROR_AWAITING_COMMAND);
+    break;
+
+  case JRK_CMD_STOP_MOTOR_USB:
+    sim->force_mode = JRK_FORCE_MODE_NONE;
+    sim->error_flags_halting |= 1 << JRK_ERROR_AWAITING_COMMAND;
+    break;
+
+  case JRK_CMD_FORCE_DUTY_CYCLE_TARGET:
+  case JRK_CMD_FORCE_DUTY_CYCLE:
+    sim->forced_duty_cycle = clamp((int16_t)value, -600, 600);
+    sim->force_mode = request == JRK_CMD_FORCE_DUTY_CYCLE ?
+      JRK_FORCE_MODE_DUTY_CYCLE : JRK_FORCE_MODE_DUTY_CYCLE_TARGET;
+    sim->error_flags_halting &= ~(1 << JRK_ERROR_AWAITING_COMMAND);
+    break;
+
+  default:
+    error = jrk_error_create(
+      "The simulated jrk does not support request 0x%x.",
+      (unsigned int)request);
+    break;
+  }
+
+  return error;
+}
+
+jrk_error * jrk_simulator_control_transfer(jrk_simulator * sim,
+  uint8_t request_type, uint8_t request, uint16_t value, uint16_t index,
+  uint8_t * buffer, size_t length, size_t * transferred)
+{
+  assert(sim != NULL);
+
+  if (transferred != NULL) { *transferred = 0; }
+
+  if (length != 0 && buffer == NULL)
+  {
+    return jrk_error_create("Buffer is null.");
+  }
+
+  simulator_lock(sim);
+  simulator_sync(sim);
+
+  jrk_error * error;
+  if (request_type & 0x80)
+  {
+    size_t dummy_transferred;
+    if (transferred == NULL) { transferred = &dummy_transferred; }
+    error = simulator_control_transfer_in(sim, request, value, index,
+      buffer, length, transferred);
+  }
+  else
+  {
+    error = simulator_control_transfer_out(sim, request, value, index,
+      buffer, length);
+    if (error == NULL && transferred != NULL) { *transferred = length; }
+  }
+
+  simulator_unlock(sim);
+  return error;
+}
+
+jrk_error * jrk_simulator_create(uint8_t product, const char * serial_number,
+  jrk_simulator ** simulator)
+{
+  if (simulator == NULL)
+  {
+    return jrk_error_create("Simulator output pointer is null.");
+  }
+
+  *simulator = NULL;
+
+  if (serial_number == NULL)
+  {
+    return jrk_error_create("Serial number is null.");
+  }
+
+  if (jrk_look_up_product_name_short(product)[0] == 0)
+  {
+    return jrk_error_create("Invalid product code: %u.", (unsigned int)product);
+  }
+
+  jrk_error * error = NULL;
+
+  jrk_simulator * new_sim = calloc(1, sizeof(jrk_simulator));
+  if (new_sim == NULL)
+  {
+    error = &jrk_error_no_memory;
+  }
+
+  if (error == NULL)
+  {
+    new_sim->mutex_initialized = simulator_mutex_init(new_sim);
+    if (!new_sim->mutex_initialized)
+    {
+      error = jrk_error_create("Failed to initialize the simulator's mutex.");
+    }
+  }
+
+  if (error == NULL)
+  {
+    new_sim->product = product;
+    new_sim->real_time = true;
+    new_sim->last_sync_time_ms = jrk_time_ms();
+
+    // Start with the potentiometer in the middle of its range.
+    new_sim->position = 2048;
+
+    jrk_string os_id;
+    jrk_string_setup(&os_id);
+    jrk_sprintf(&os_id, "simulator:%s", serial_number);
+
+    new_sim->serial_number = strdup(serial_number);
+    new_sim->os_id = os_id.data;
+    if (new_sim->serial_number == NULL || new_sim->os_id == NULL)
+    {
+      error = &jrk_error_no_memory;
+    }
+  }
+
+  if (error == NULL)
+  {
+    error = simulator_load_defaults(new_sim);
+  }
+
+  if (error == NULL)
+  {
+    error = simulator_reinitialize(new_sim, true);
+  }
+
+  if (error == NULL)
+  {
+    simulator_update_feedback(new_sim);
+    *simulator = new_sim;
+    new_sim = NULL;
+  }
+
+  jrk_simulator_free(new_sim);
+
+  return error;
+}
+
+void jrk_simulator_free(jrk_simulator * sim)
+{
+  if (sim != NULL)
+  {
+    if (sim->mutex_initialized) { simulator_mutex_destroy(sim); }
+    free(sim->serial_number);
+    free(sim->os_id);
+    free(sim);
+  }
+}
+
+jrk_error * jrk_simulator_get_device(jrk_simulator * sim, jrk_device ** device)
+{
+  if (device == NULL)
+  {
+    return jrk_error_create("Device output pointer is null.");
+  }
+
+  *device = NULL;
+
+  if (sim == NULL)
+  {
+    return jrk_error_create("Simulator is null.");
+  }
+
+  return jrk_device_create_simulated(sim, sim->product,
+    SIMULATOR_FIRMWARE_VERSION, sim->serial_number, sim->os_id, device);
+}
+
+void jrk_simulator_set_real_time(jrk_simulator * sim, bool real_time)
+{
+  if (sim == NULL) { return; }
+
+  // Catch up before switching so that time spent in real-time mode counts.
+  simulator_lock(sim);
+  simulator_sync(sim);
+  sim->real_time = real_time;
+  sim->last_sync_time_ms = jrk_time_ms();
+  simulator_unlock(sim);
+}
+
+void jrk_simulator_advance(jrk_simulator * sim, uint32_t milliseconds)
+{
+  if (sim == NULL) { return; }
+
+  simulator_lock(sim);
+  simulator_advance(sim, milliseconds);
+  simulator_unlock(sim);
+}
+
+// The most simulated devices that JRK2_SIMULATED_DEVICES can request.
+#define SIMULATED_DEVICE_MAX 100
+
+// Simulated devices requested with the JRK2_SIMULATED_DEVICES environment
+// variable.  These are never freed because device objects returned by
+// jrk_list_connected_devices() might refer to them at any time.  Several
+// threads can list devices at the same time, so they are all created once, by
+// env_simulators_init(), and never change after that.
+static jrk_simulator * env_simulators[SIMULATED_DEVICE_MAX];
+static size_t env_simulator_count;
+
+static void simulated_device_serial_number(size_t index, char * buffer)
+{
+  snprintf(buffer, 16, "SIM%05u", (unsigned int)(index + 1));
+}
+
+static void env_simulators_init(void)
+{
+  const char * value = getenv("JRK2_SIMULATED_DEVICES");
+  if (value == NULL) { return; }
+
+  int64_t count;
+  if (jrk_string_to_i64(value, &count) || count < 0) { return; }
+  if (count > SIMULATED_DEVICE_MAX) { count = SIMULATED_DEVICE_MAX; }
+
+  // If we run out of memory, we just have fewer simulated devices.
+  for (size_t i = 0; i < (size_t)count; i++)
+  {
+    char serial_number[16];
+    simulated_device_serial_number(i, serial_number);
+    jrk_error * error = jrk_simulator_create(JRK_PRODUCT_UMC04A_30V,
+      serial_number, &env_simulators[i]);
+    if (error != NULL)
+    {
+      jrk_error_free(error);
+      break;
+    }
+    env_simulator_count++;
+  }
+}
+
+#ifdef _WIN32
+
+static BOOL CALLBACK env_simulators_init_once(PINIT_ONCE once,
+  PVOID parameter, PVOID * context)
+{
+  (void)once; (void)parameter; (void)context;
+  env_simulators_init();
+  return TRUE;
+}
+
+static void env_simulators_setup(void)
+{
+  static INIT_ONCE once = INIT_ONCE_STATIC_INIT;
+  InitOnceExecuteOnce(&once, env_simulators_init_once, NULL, NULL);
+}
+
+#else
+
+static void env_simulators_setup(void)
+{
+  static pthread_once_t once = PTHREAD_ONCE_INIT;
+  pthread_once(&once, env_simulators_init);
+}
+
+#endif
+
+size_t jrk_simulated_device_count(void)
+{
+  env_simulators_setup();
+  return env_simulator_count;
+}
+
+jrk_error * jrk_simulated_device_create(size_t index, jrk_device ** device)
+{
+  assert(device != NULL);
+
+  *device = NULL;
+
+  env_simulators_setup();
+
+  if (index >= env_simulator_count)
+  {
+    return jrk_error_create("There is no simulated device %u.",
+      (unsigned int)index);
+  }
+
+  return jrk_simulator_get_device(env_simulators[index], device);
+}
+
+jrk_error * jrk_simulated_device_find(const char * serial_number,
+  jrk_device ** device)
+{
+  assert(device != NULL);
+
+  *device = NULL;
+
+  size_t count = jrk_simulated_device_count();
+  for (size_t i = 0; i < count; i++)
+  {
+    char simulated_serial_number[16];
+    simulated_device_serial_number(i, simulated_serial_number);
+    if (strcmp(simulated_serial_number, serial_number) == 0)
+    {
+      return jrk_simulated_device_create(i, device);
+    }
+  }
+  return NULL;
+}
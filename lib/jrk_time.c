@@ -0,0 +1,19 @@
+// Functions for measuring time, which are used by the simulator and the device
+// watch.
+
+#include "jrk_internal.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+uint64_t jrk_time_ms(void)
+{
+#ifdef _WIN32
+  return GetTickCount64();
+#else
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t)now.tv_sec * 1000 + now.tv_nsec / 1000000;
+#endif
+}
@@ -112,41 +112,295 @@ void jrk_variables_free(jrk_variables * variables)
   free(variables);
 }
 
-static void write_buffer_to_variables(const uint8_t * buf, jrk_variables * vars)
+// The size in bytes of each variable, indexed by its offset in the variables
+// data structure.  Offsets where no variable starts have a size of 0.
+static const uint8_t variable_sizes[JRK_VARIABLES_SIZE] = {
+  [JRK_VAR_INPUT] = 2,
+  [JRK_VAR_TARGET] = 2,
+  [JRK_VAR_FEEDBACK] = 2,
+  [JRK_VAR_SCALED_FEEDBACK] = 2,
+  [JRK_VAR_INTEGRAL] = 2,
+  [JRK_VAR_DUTY_CYCLE_TARGET] = 2,
+  [JRK_VAR_DUTY_CYCLE] = 2,
+  [JRK_VAR_CURRENT_LOW_RES] = 1,
+  [JRK_VAR_PID_PERIOD_EXCEEDED] = 1,
+  [JRK_VAR_PID_PERIOD_COUNT] = 2,
+  [JRK_VAR_ERROR_FLAGS_HALTING] = 2,
+  [JRK_VAR_ERROR_FLAGS_OCCURRED] = 2,
+  [JRK_VAR_FLAG_BYTE1] = 1,
+  [JRK_VAR_VIN_VOLTAGE] = 2,
+  [JRK_VAR_CURRENT] = 2,
+  [JRK_VAR_DEVICE_RESET] = 1,
+  [JRK_VAR_UP_TIME] = 4,
+  [JRK_VAR_RC_PULSE_WIDTH] = 2,
+  [JRK_VAR_FBT_READING] = 2,
+  [JRK_VAR_ANALOG_READING_SDA] = 2,
+  [JRK_VAR_ANALOG_READING_FBA] = 2,
+  [JRK_VAR_DIGITAL_READINGS] = 1,
+  [JRK_VAR_RAW_CURRENT] = 2,
+  [JRK_VAR_ENCODED_HARD_CURRENT_LIMIT] = 2,
+  [JRK_VAR_LAST_DUTY_CYCLE] = 2,
+  [JRK_VAR_CURRENT_CHOPPING_CONSECUTIVE_COUNT] = 1,
+  [JRK_VAR_CURRENT_CHOPPING_OCCURRENCE_COUNT] = 1,
+};
+
+static jrk_error * check_column_args(const uint8_t * buffers, size_t stride,
+  uint8_t offset, uint8_t size, const void * output)
+{
+  if (buffers == NULL)
+  {
+    return jrk_error_create("Buffer pointer is null.");
+  }
+
+  if (output == NULL)
+  {
+    return jrk_error_create("Output pointer is null.");
+  }
+
+  if (offset >= JRK_VARIABLES_SIZE || variable_sizes[offset] == 0)
+  {
+    return jrk_error_create("There is no variable at offset 0x%x.",
+      (unsigned int)offset);
+  }
+
+  if (variable_sizes[offset] != size)
+  {
+    return jrk_error_create(
+      "The variable at offset 0x%x is %u bytes, not %u.",
+      (unsigned int)offset, (unsigned int)variable_sizes[offset],
+      (unsigned int)size);
+  }
+
+  if (stride < (size_t)offset + size)
+  {
+    return jrk_error_create("The stride is too small.");
+  }
+
+  return NULL;
+}
+
+// The column decoders have a separate loop for the usual stride so that the
+// compiler knows the stride and can unroll and vectorize the loop.  The
+// restrict pointers tell it that writing to the output cannot change the
+// input, which it would otherwise have to assume because the input is made of
+// bytes.
+
+jrk_error * jrk_variables_decode_column_uint8(const uint8_t * buffers,
+  size_t stride, size_t count, uint8_t offset, uint8_t * output)
+{
+  jrk_error * error = check_column_args(buffers, stride, offset, 1, output);
+  if (error != NULL) { return error; }
+
+  const uint8_t * restrict p = buffers + offset;
+  uint8_t * restrict out = output;
+  if (stride == JRK_VARIABLES_SIZE)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      out[i] = p[i * JRK_VARIABLES_SIZE];
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      out[i] = p[i * stride];
+    }
+  }
+  return NULL;
+}
+
+jrk_error * jrk_variables_decode_column_uint16(const uint8_t * buffers,
+  size_t stride, size_t count, uint8_t offset, uint16_t * output)
+{
+  jrk_error * error = check_column_args(buffers, stride, offset, 2, output);
+  if (error != NULL) { return error; }
+
+  const uint8_t * restrict p = buffers + offset;
+  uint16_t * restrict out = output;
+  if (stride == JRK_VARIABLES_SIZE)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      out[i] = read_uint16_t(p + i * JRK_VARIABLES_SIZE);
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      out[i] = read_uint16_t(p + i * stride);
+    }
+  }
+  return NULL;
+}
+
+jrk_error * jrk_variables_decode_column_int16(const uint8_t * buffers,
+  size_t stride, size_t count, uint8_t offset, int16_t * output)
+{
+  // Signed and unsigned 16-bit integers have the same size and alignment, and
+  // the bits are the same.
+  return jrk_variables_decode_column_uint16(buffers, stride, count, offset,
+    (uint16_t *)output);
+}
+
+jrk_error * jrk_variables_decode_column_uint32(const uint8_t * buffers,
+  size_t stride, size_t count, uint8_t offset, uint32_t * output)
+{
+  jrk_error * error = check_column_args(buffers, stride, offset, 4, output);
+  if (error != NULL) { return error; }
+
+  const uint8_t * restrict p = buffers + offset;
+  uint32_t * restrict out = output;
+  if (stride == JRK_VARIABLES_SIZE)
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      out[i] = read_uint32_t(p + i * JRK_VARIABLES_SIZE);
+    }
+  }
+  else
+  {
+    for (size_t i = 0; i < count; i++)
+    {
+      out[i] = read_uint32_t(p + i * stride);
+    }
+  }
+  return NULL;
+}
+
+// When two selected variables are separated by this many unused bytes or
+// fewer, jrk_get_variables_masked_into() reads them in one transfer because the
+// overhead of another transfer costs more than reading a few extra bytes.
+#define VARIABLE_SEGMENT_MAX_GAP 4
+
+// The "Get variables" flags that clear a variable, and the offset of the
+// variable each one clears.
+static const struct
+{
+  uint8_t flag;
+  uint8_t offset;
+} clearing_flags[] = {
+  { JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_HALTING,
+    JRK_VAR_ERROR_FLAGS_HALTING },
+  { JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_OCCURRED,
+    JRK_VAR_ERROR_FLAGS_OCCURRED },
+  { JRK_GET_VARIABLES_FLAG_CLEAR_CURRENT_CHOPPING_OCCURRENCE_COUNT,
+    JRK_VAR_CURRENT_CHOPPING_OCCURRENCE_COUNT },
+};
+
+// Decodes the variables selected by the mask from the buffer.  Bit N of the
+// mask selects the variable at offset N.  Variables that are not selected are
+// not modified.
+static void write_buffer_to_variables(const uint8_t * buf, jrk_variables * vars,
+  uint64_t mask)
 {
   assert(vars != NULL);
   assert(buf != NULL);
 
   // Beginning of auto-generated buffer-to-variables code.
 
-  vars->input = read_uint16_t(buf + JRK_VAR_INPUT);
-  vars->target = read_uint16_t(buf + JRK_VAR_TARGET);
-  vars->feedback = read_uint16_t(buf + JRK_VAR_FEEDBACK);
-  vars->scaled_feedback = read_uint16_t(buf + JRK_VAR_SCALED_FEEDBACK);
-  vars->integral = read_int16_t(buf + JRK_VAR_INTEGRAL);
-  vars->duty_cycle_target = read_int16_t(buf + JRK_VAR_DUTY_CYCLE_TARGET);
-  vars->duty_cycle = read_int16_t(buf + JRK_VAR_DUTY_CYCLE);
-  vars->current_low_res = buf[JRK_VAR_CURRENT_LOW_RES];
-  vars->pid_period_exceeded = buf[JRK_VAR_PID_PERIOD_EXCEEDED] & 1;
-  vars->pid_period_count = read_uint16_t(buf + JRK_VAR_PID_PERIOD_COUNT);
-  vars->error_flags_halting = read_uint16_t(buf + JRK_VAR_ERROR_FLAGS_HALTING);
-  vars->error_flags_occurred = read_uint16_t(buf + JRK_VAR_ERROR_FLAGS_OCCURRED);
-  vars->vin_voltage = read_uint16_t(buf + JRK_VAR_VIN_VOLTAGE);
-  vars->current = read_uint16_t(buf + JRK_VAR_CURRENT);
-  vars->device_reset = buf[JRK_VAR_DEVICE_RESET];
-  vars->up_time = read_uint32_t(buf + JRK_VAR_UP_TIME);
-  vars->rc_pulse_width = read_uint16_t(buf + JRK_VAR_RC_PULSE_WIDTH);
-  vars->fbt_reading = read_uint16_t(buf + JRK_VAR_FBT_READING);
-  vars->raw_current = read_uint16_t(buf + JRK_VAR_RAW_CURRENT);
-  vars->encoded_hard_current_limit = read_uint16_t(buf + JRK_VAR_ENCODED_HARD_CURRENT_LIMIT);
-  vars->last_duty_cycle = read_int16_t(buf + JRK_VAR_LAST_DUTY_CYCLE);
-  vars->current_chopping_consecutive_count = buf[JRK_VAR_CURRENT_CHOPPING_CONSECUTIVE_COUNT];
-  vars->current_chopping_occurrence_count = buf[JRK_VAR_CURRENT_CHOPPING_OCCURRENCE_COUNT];
+  if (mask >> JRK_VAR_INPUT & 1)
+  {
+    vars->input = read_uint16_t(buf + JRK_VAR_INPUT);
+  }
+  if (mask >> JRK_VAR_TARGET & 1)
+  {
+    vars->target = read_uint16_t(buf + JRK_VAR_TARGET);
+  }
+  if (mask >> JRK_VAR_FEEDBACK & 1)
+  {
+    vars->feedback = read_uint16_t(buf + JRK_VAR_FEEDBACK);
+  }
+  if (mask >> JRK_VAR_SCALED_FEEDBACK & 1)
+  {
+    vars->scaled_feedback = read_uint16_t(buf + JRK_VAR_SCALED_FEEDBACK);
+  }
+  if (mask >> JRK_VAR_INTEGRAL & 1)
+  {
+    vars->integral = read_int16_t(buf + JRK_VAR_INTEGRAL);
+  }
+  if (mask >> JRK_VAR_DUTY_CYCLE_TARGET & 1)
+  {
+    vars->duty_cycle_target = read_int16_t(buf + JRK_VAR_DUTY_CYCLE_TARGET);
+  }
+  if (mask >> JRK_VAR_DUTY_CYCLE & 1)
+  {
+    vars->duty_cycle = read_int16_t(buf + JRK_VAR_DUTY_CYCLE);
+  }
+  if (mask >> JRK_VAR_CURRENT_LOW_RES & 1)
+  {
+    vars->current_low_res = buf[JRK_VAR_CURRENT_LOW_RES];
+  }
+  if (mask >> JRK_VAR_PID_PERIOD_EXCEEDED & 1)
+  {
+    vars->pid_period_exceeded = buf[JRK_VAR_PID_PERIOD_EXCEEDED] & 1;
+  }
+  if (mask >> JRK_VAR_PID_PERIOD_COUNT & 1)
+  {
+    vars->pid_period_count = read_uint16_t(buf + JRK_VAR_PID_PERIOD_COUNT);
+  }
+  if (mask >> JRK_VAR_ERROR_FLAGS_HALTING & 1)
+  {
+    vars->error_flags_halting = read_uint16_t(buf + JRK_VAR_ERROR_FLAGS_HALTING);
+  }
+  if (mask >> JRK_VAR_ERROR_FLAGS_OCCURRED & 1)
+  {
+    vars->error_flags_occurred = read_uint16_t(buf + JRK_VAR_ERROR_FLAGS_OCCURRED);
+  }
+  if (mask >> JRK_VAR_VIN_VOLTAGE & 1)
+  {
+    vars->vin_voltage = read_uint16_t(buf + JRK_VAR_VIN_VOLTAGE);
+  }
+  if (mask >> JRK_VAR_CURRENT & 1)
+  {
+    vars->current = read_uint16_t(buf + JRK_VAR_CURRENT);
+  }
+  if (mask >> JRK_VAR_DEVICE_RESET & 1)
+  {
+    vars->device_reset = buf[JRK_VAR_DEVICE_RESET];
+  }
+  if (mask >> JRK_VAR_UP_TIME & 1)
+  {
+    vars->up_time = read_uint32_t(buf + JRK_VAR_UP_TIME);
+  }
+  if (mask >> JRK_VAR_RC_PULSE_WIDTH & 1)
+  {
+    vars->rc_pulse_width = read_uint16_t(buf + JRK_VAR_RC_PULSE_WIDTH);
+  }
+  if (mask >> JRK_VAR_FBT_READING & 1)
+  {
+    vars->fbt_reading = read_uint16_t(buf + JRK_VAR_FBT_READING);
+  }
+  if (mask >> JRK_VAR_RAW_CURRENT & 1)
+  {
+    vars->raw_current = read_uint16_t(buf + JRK_VAR_RAW_CURRENT);
+  }
+  if (mask >> JRK_VAR_ENCODED_HARD_CURRENT_LIMIT & 1)
+  {
+    vars->encoded_hard_current_limit = read_uint16_t(buf + JRK_VAR_ENCODED_HARD_CURRENT_LIMIT);
+  }
+  if (mask >> JRK_VAR_LAST_DUTY_CYCLE & 1)
+  {
+    vars->last_duty_cycle = read_int16_t(buf + JRK_VAR_LAST_DUTY_CYCLE);
+  }
+  if (mask >> JRK_VAR_CURRENT_CHOPPING_CONSECUTIVE_COUNT & 1)
+  {
+    vars->current_chopping_consecutive_count = buf[JRK_VAR_CURRENT_CHOPPING_CONSECUTIVE_COUNT];
+  }
+  if (mask >> JRK_VAR_CURRENT_CHOPPING_OCCURRENCE_COUNT & 1)
+  {
+    vars->current_chopping_occurrence_count = buf[JRK_VAR_CURRENT_CHOPPING_OCCURRENCE_COUNT];
+  }
 
   // End of auto-generated buffer-to-variables code.
 
-  vars->force_mode = buf[JRK_VAR_FLAG_BYTE1] & 3;
+  if (mask >> JRK_VAR_FLAG_BYTE1 & 1)
+  {
+    vars->force_mode = buf[JRK_VAR_FLAG_BYTE1] & 3;
+  }
 
+  if (mask >> JRK_VAR_DIGITAL_READINGS & 1)
   {
     // Digital readings.
     uint8_t d = buf[JRK_VAR_DIGITAL_READINGS];
@@ -163,8 +417,11 @@ static void write_buffer_to_variables(const uint8_t * buf, jrk_variables * vars)
   {
     vars->pin_info[JRK_PIN_NUM_SCL].analog_reading = 0xFFFF;
 
-    vars->pin_info[JRK_PIN_NUM_SDA].analog_reading =
-      read_uint16_t(buf + JRK_VAR_ANALOG_READING_SDA);
+    if (mask >> JRK_VAR_ANALOG_READING_SDA & 1)
+    {
+      vars->pin_info[JRK_PIN_NUM_SDA].analog_reading =
+        read_uint16_t(buf + JRK_VAR_ANALOG_READING_SDA);
+    }
 
     vars->pin_info[JRK_PIN_NUM_TX].analog_reading = 0xFFFF;
 
@@ -174,15 +431,37 @@ static void write_buffer_to_variables(const uint8_t * buf, jrk_variables * vars)
 
     vars->pin_info[JRK_PIN_NUM_AUX].analog_reading = 0xFFFF;
 
-    vars->pin_info[JRK_PIN_NUM_FBA].analog_reading =
-      read_uint16_t(buf + JRK_VAR_ANALOG_READING_FBA);
+    if (mask >> JRK_VAR_ANALOG_READING_FBA & 1)
+    {
+      vars->pin_info[JRK_PIN_NUM_FBA].analog_reading =
+        read_uint16_t(buf + JRK_VAR_ANALOG_READING_FBA);
+    }
 
     vars->pin_info[JRK_PIN_NUM_FBT].analog_reading = 0xFFFF;
   }
 }
 
+void jrk_variables_read_from_buffer(jrk_variables * vars, const uint8_t * buf)
+{
+  if (vars == NULL || buf == NULL) { return; }
+  write_buffer_to_variables(buf, vars, JRK_VARIABLES_MASK_ALL);
+}
+
+uint8_t jrk_variable_size(size_t offset)
+{
+  if (offset >= JRK_VARIABLES_SIZE) { return 0; }
+  return variable_sizes[offset];
+}
+
 jrk_error * jrk_get_variables(jrk_handle * handle, jrk_variables ** variables,
   uint16_t flags)
+{
+  return jrk_get_variables_masked(handle, variables,
+    JRK_VARIABLES_MASK_ALL, flags);
+}
+
+jrk_error * jrk_get_variables_masked(jrk_handle * handle,
+  jrk_variables ** variables, uint64_t mask, uint16_t flags)
 {
   if (variables == NULL)
   {
@@ -205,18 +484,10 @@ jrk_error * jrk_get_variables(jrk_handle * handle, jrk_variables ** variables,
     error = jrk_variables_create(&new_variables);
   }
 
-  // Read all the variables from the device.
-  uint8_t buf[JRK_VARIABLES_SIZE];
+  // Read the variables from the device into the new object.
   if (error == NULL)
   {
-    size_t index = 0;
-    error = jrk_get_variable_segment(handle, index, sizeof(buf), buf, flags);
-  }
-
-  // Store the variables in the new variables object.
-  if (error == NULL)
-  {
-    write_buffer_to_variables(buf, new_variables);
+    error = jrk_get_variables_masked_into(handle, new_variables, mask, flags);
   }
 
   // Pass the new variables to the caller.
@@ -228,6 +499,98 @@ jrk_error * jrk_get_variables(jrk_handle * handle, jrk_variables ** variables,
 
   jrk_variables_free(new_variables);
 
+  return error;
+}
+
+jrk_error * jrk_get_variables_into(jrk_handle * handle,
+  jrk_variables * variables, uint16_t flags)
+{
+  return jrk_get_variables_masked_into(handle, variables,
+    JRK_VARIABLES_MASK_ALL, flags);
+}
+
+jrk_error * jrk_get_variables_masked_into(jrk_handle * handle,
+  jrk_variables * variables, uint64_t mask, uint16_t flags)
+{
+  if (variables == NULL)
+  {
+    return jrk_error_create("Variables pointer is null.");
+  }
+
+  if (handle == NULL)
+  {
+    return jrk_error_create("Handle is null.");
+  }
+
+  jrk_error * error = NULL;
+
+  // Work out which segments of the variables data structure to read.  Each
+  // segment covers one or more selected variables.  When every variable is
+  // selected, this results in a single segment covering the whole structure.
+  size_t segment_start[JRK_VARIABLES_SIZE];
+  size_t segment_end[JRK_VARIABLES_SIZE];
+  size_t segment_count = 0;
+  for (size_t i = 0; i < JRK_VARIABLES_SIZE; i++)
+  {
+    if (!(mask >> i & 1) || variable_sizes[i] == 0) { continue; }
+
+    size_t end = i + variable_sizes[i];
+    if (segment_count > 0 &&
+      i <= segment_end[segment_count - 1] + VARIABLE_SEGMENT_MAX_GAP)
+    {
+      segment_end[segment_count - 1] = end;
+    }
+    else
+    {
+      segment_start[segment_count] = i;
+      segment_end[segment_count] = end;
+      segment_count++;
+    }
+  }
+
+  // Each flag that clears a variable is sent with the segment that reads that
+  // variable, so the value we return includes every event up to the moment it
+  // was cleared.  Other flags, and flags for variables we are not reading, are
+  // sent with the last segment.
+  uint16_t segment_flags[JRK_VARIABLES_SIZE] = { 0 };
+  if (segment_count > 0)
+  {
+    uint16_t remaining_flags = flags;
+    for (size_t f = 0; f < sizeof(clearing_flags) / sizeof(clearing_flags[0]);
+      f++)
+    {
+      uint16_t flag = 1 << clearing_flags[f].flag;
+      size_t offset = clearing_flags[f].offset;
+      if (!(flags & flag)) { continue; }
+      for (size_t i = 0; i < segment_count; i++)
+      {
+        if (segment_start[i] <= offset && offset < segment_end[i])
+        {
+          segment_flags[i] |= flag;
+          remaining_flags &= ~flag;
+        }
+      }
+    }
+    segment_flags[segment_count - 1] |= remaining_flags;
+  }
+
+  // Read the segments from the device.
+  uint8_t buf[JRK_VARIABLES_SIZE] = { 0 };
+  for (size_t i = 0; error == NULL && i < segment_count; i++)
+  {
+    size_t start = segment_start[i];
+    error = jrk_get_variable_segment(handle, start,
+      segment_end[i] - start, buf + start, segment_flags[i]);
+  }
+
+  // Store the selected variables in the caller's object.  This is only done
+  // after every segment was read successfully, so the object is not modified
+  // if there is an error.
+  if (error == NULL)
+  {
+    write_buffer_to_variables(buf, variables, mask);
+  }
+
   if (error != NULL)
   {
     error = jrk_error_add(error,
@@ -43,14 +43,17 @@ def generate_buffer_to_variables_code(stream)
     addr = info.fetch(:address, "JRK_VAR_#{name.upcase}")
     bit_addr = info.fetch(:bit_address, 0)
 
+    stream.puts "if (mask >> #{addr} & 1)"
+    stream.puts "{"
     if type == :bool
       shift = " >> #{bit_addr}" if bit_addr != 0
-      stream.puts "vars->#{name} = buf[#{addr}]#{shift} & 1;"
+      stream.puts "  vars->#{name} = buf[#{addr}]#{shift} & 1;"
     elsif [:uint8_t, :int8_t].include?(type)
-      stream.puts "vars->#{name} = buf[#{addr}];"
+      stream.puts "  vars->#{name} = buf[#{addr}];"
     else
-      stream.puts "vars->#{name} = read_#{type}(buf + #{addr});"
+      stream.puts "  vars->#{name} = read_#{type}(buf + #{addr});"
     end
+    stream.puts "}"
   end
 end
 
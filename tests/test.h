@@ -0,0 +1,54 @@
+// Helpers shared by the tests.  Each test program runs its checks, prints a
+// line for every check that fails, and exits with a non-zero status if any of
+// them failed.
+
+#pragma once
+
+#include <jrk.h>
+
+#include <stdbool.h>
+#include <stdio.h>
+
+static int test_failure_count;
+
+#define CHECK(condition) \
+  check((condition), #condition, __FILE__, __LINE__)
+
+#define CHECK_OK(error) \
+  check_ok((error), #error, __FILE__, __LINE__)
+
+static inline bool check(bool condition, const char * text,
+  const char * file, int line)
+{
+  if (!condition)
+  {
+    fprintf(stderr, "%s:%d: Check failed: %s\n", file, line, text);
+    test_failure_count++;
+  }
+  return condition;
+}
+
+// Checks that a function returned no error, and frees the error if it did.
+static inline bool check_ok(jrk_error * error, const char * text,
+  const char * file, int line)
+{
+  if (error != NULL)
+  {
+    fprintf(stderr, "%s:%d: %s failed: %s\n", file, line, text,
+      jrk_error_get_message(error));
+    jrk_error_free(error);
+    test_failure_count++;
+    return false;
+  }
+  return true;
+}
+
+static inline int test_result(void)
+{
+  if (test_failure_count != 0)
+  {
+    fprintf(stderr, "%d checks failed.\n", test_failure_count);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,222 @@
+// Tests serial handles by connecting one to a pseudo-terminal.  A thread on
+// the other side of the pseudo-terminal acts like a jrk: it decodes the
+// compact protocol commands and performs them on a simulated jrk over its USB
+// interface.  Reading and writing settings over serial should then give the
+// same results as doing it over USB.
+
+#define _XOPEN_SOURCE 600
+
+#include "test.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+typedef struct responder
+{
+  int fd;
+  jrk_handle * handle;
+  pthread_t thread;
+  int unknown_command_count;
+  int error_count;
+} responder;
+
+static bool read_exact(int fd, uint8_t * buffer, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t result = read(fd, buffer, length);
+    if (result <= 0) { return false; }
+    buffer += result;
+    length -= result;
+  }
+  return true;
+}
+
+static bool write_exact(int fd, const uint8_t * buffer, size_t length)
+{
+  while (length > 0)
+  {
+    ssize_t result = write(fd, buffer, length);
+    if (result <= 0) { return false; }
+    buffer += result;
+    length -= result;
+  }
+  return true;
+}
+
+static void responder_check(responder * r, jrk_error * error)
+{
+  if (error != NULL)
+  {
+    fprintf(stderr, "Simulator error: %s\n", jrk_error_get_message(error));
+    jrk_error_free(error);
+    r->error_count++;
+  }
+}
+
+// Handles commands until the other side of the pseudo-terminal is closed.
+static void * responder_run(void * arg)
+{
+  responder * r = arg;
+  uint8_t command;
+  while (read_exact(r->fd, &command, 1))
+  {
+    uint8_t args[2];
+    uint8_t data[JRK_MAX_SERIAL_SET_RAM_SETTINGS_SIZE + 1];
+    uint8_t response[JRK_MAX_SERIAL_RESPONSE_SIZE];
+
+    switch (command)
+    {
+    case JRK_CMD_GET_RAM_SETTINGS:
+    case JRK_CMD_GET_VARIABLES:
+      if (!read_exact(r->fd, args, 2)) { return NULL; }
+      if (command == JRK_CMD_GET_RAM_SETTINGS)
+      {
+        responder_check(r, jrk_get_ram_setting_segment(r->handle,
+          args[0], args[1], response));
+      }
+      else
+      {
+        responder_check(r, jrk_get_variable_segment(r->handle,
+          args[0], args[1], response, 0));
+      }
+      if (!write_exact(r->fd, response, args[1])) { return NULL; }
+      break;
+
+    case JRK_CMD_SET_RAM_SETTINGS:
+      if (!read_exact(r->fd, args, 2)) { return NULL; }
+      if (!read_exact(r->fd, data, args[1] + 1)) { return NULL; }
+      for (size_t i = 0; i < args[1]; i++)
+      {
+        data[i] |= (data[args[1]] >> i & 1) << 7;
+      }
+      responder_check(r, jrk_set_ram_setting_segment(r->handle,
+        args[0], args[1], data));
+      break;
+
+    default:
+      r->unknown_command_count++;
+      break;
+    }
+  }
+  return NULL;
+}
+
+// Opens a pseudo-terminal and returns the file descriptor of its master side,
+// or -1 if there is an error.  The name of the slave side, which acts like a
+// serial port, is written to slave_name.
+static int open_pty(const char ** slave_name)
+{
+  int fd = posix_openpt(O_RDWR | O_NOCTTY);
+  if (fd < 0) { return -1; }
+  if (grantpt(fd) || unlockpt(fd) || (*slave_name = ptsname(fd)) == NULL)
+  {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+static void test_settings_round_trip(jrk_simulator * simulator)
+{
+  jrk_device * device = NULL;
+  jrk_handle * usb_handle = NULL;
+  CHECK_OK(jrk_simulator_get_device(simulator, &device));
+  CHECK_OK(jrk_handle_open(device, &usb_handle));
+  if (usb_handle == NULL) { jrk_device_free(device); return; }
+  uint8_t product = jrk_device_get_product(device);
+  uint16_t firmware_version = jrk_device_get_firmware_version(device);
+
+  jrk_settings * usb_settings = NULL;
+  CHECK_OK(jrk_get_ram_settings(usb_handle, &usb_settings));
+
+  const char * pty_name = NULL;
+  responder r = { 0 };
+  r.handle = usb_handle;
+  r.fd = open_pty(&pty_name);
+  if (!CHECK(r.fd >= 0)) { return; }
+
+  jrk_serial_port * port = NULL;
+  CHECK_OK(jrk_serial_port_open(pty_name, 9600, &port));
+  if (port == NULL) { close(r.fd); return; }
+
+  // Start the responder after the port is open: reading from the master side
+  // fails while nothing has the slave side open.
+  CHECK(pthread_create(&r.thread, NULL, responder_run, &r) == 0);
+
+  // A serial handle opened with the product reads settings that are marked
+  // with the product and match what we read over USB.
+  jrk_handle * serial_handle = NULL;
+  CHECK_OK(jrk_handle_open_serial(port, 11, 0,
+    product, firmware_version, &serial_handle));
+  jrk_settings * settings = NULL;
+  CHECK_OK(jrk_get_ram_settings(serial_handle, &settings));
+  CHECK(jrk_settings_get_product(settings) == product);
+  CHECK(jrk_settings_get_firmware_version(settings) == firmware_version);
+  CHECK(jrk_settings_get_encoded_hard_current_limit_forward(settings) ==
+    jrk_settings_get_encoded_hard_current_limit_forward(usb_settings));
+  CHECK(jrk_settings_get_encoded_hard_current_limit_forward(settings) != 0);
+  CHECK(jrk_settings_get_proportional_multiplier(settings) ==
+    jrk_settings_get_proportional_multiplier(usb_settings));
+
+  // Settings written over serial keep their product-specific values.
+  jrk_settings_set_encoded_hard_current_limit_forward(settings, 80);
+  jrk_settings_set_proportional_multiplier(settings, 300);
+  CHECK_OK(jrk_set_ram_settings(serial_handle, settings));
+
+  // A serial handle opened without a product reads settings with no product,
+  // and writing settings with it keeps the product the settings have instead
+  // of replacing the product-specific values with zeros.
+  jrk_handle * unknown_handle = NULL;
+  CHECK_OK(jrk_handle_open_serial(port, 11, 0, 0, 0, &unknown_handle));
+  jrk_settings * unknown_settings = NULL;
+  CHECK_OK(jrk_get_ram_settings(unknown_handle, &unknown_settings));
+  CHECK(jrk_settings_get_product(unknown_settings) == 0);
+  CHECK(jrk_settings_get_encoded_hard_current_limit_forward(
+    unknown_settings) == 80);
+  jrk_settings_set_encoded_hard_current_limit_reverse(settings, 70);
+  CHECK_OK(jrk_set_ram_settings(unknown_handle, settings));
+
+  jrk_settings_free(unknown_settings);
+  jrk_handle_close(unknown_handle);
+  jrk_settings_free(settings);
+  jrk_handle_close(serial_handle);
+
+  // Closing the port makes the responder's reads fail so it stops.
+  jrk_serial_port_close(port);
+  pthread_join(r.thread, NULL);
+  close(r.fd);
+  CHECK(r.unknown_command_count == 0);
+  CHECK(r.error_count == 0);
+
+  // Check what the simulated jrk actually has now.
+  jrk_settings * final_settings = NULL;
+  CHECK_OK(jrk_get_ram_settings(usb_handle, &final_settings));
+  CHECK(jrk_settings_get_encoded_hard_current_limit_forward(
+    final_settings) == 80);
+  CHECK(jrk_settings_get_encoded_hard_current_limit_reverse(
+    final_settings) == 70);
+  CHECK(jrk_settings_get_proportional_multiplier(final_settings) == 300);
+
+  jrk_settings_free(final_settings);
+  jrk_settings_free(usb_settings);
+  jrk_handle_close(usb_handle);
+  jrk_device_free(device);
+}
+
+int main()
+{
+  jrk_simulator * simulator = NULL;
+  CHECK_OK(jrk_simulator_create(JRK_PRODUCT_UMC04A_30V, "00000001",
+    &simulator));
+  if (simulator == NULL) { return test_result(); }
+  jrk_simulator_set_real_time(simulator, false);
+
+  test_settings_round_trip(simulator);
+
+  jrk_simulator_free(simulator);
+  return test_result();
+}
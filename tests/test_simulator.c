@@ -0,0 +1,332 @@
+// Tests the parts of the library that talk to a device, using simulated jrks
+// that do not run in real time so the results are deterministic.
+
+#include "test.h"
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef struct test_device
+{
+  jrk_simulator * simulator;
+  jrk_device * device;
+  jrk_handle * handle;
+} test_device;
+
+static bool test_device_open(test_device * d)
+{
+  memset(d, 0, sizeof(*d));
+  CHECK_OK(jrk_simulator_create(JRK_PRODUCT_UMC04A_30V, "00000001",
+    &d->simulator));
+  if (d->simulator == NULL) { return false; }
+  jrk_simulator_set_real_time(d->simulator, false);
+  CHECK_OK(jrk_simulator_get_device(d->simulator, &d->device));
+  CHECK_OK(jrk_handle_open(d->device, &d->handle));
+  return d->handle != NULL;
+}
+
+static void test_device_close(test_device * d)
+{
+  jrk_handle_close(d->handle);
+  jrk_device_free(d->device);
+  jrk_simulator_free(d->simulator);
+}
+
+static jrk_device * device_with_serial_number(jrk_device ** list,
+  const char * serial_number)
+{
+  for (size_t i = 0; list != NULL && list[i] != NULL; i++)
+  {
+    if (strcmp(jrk_device_get_serial_number(list[i]), serial_number) == 0)
+    {
+      return list[i];
+    }
+  }
+  return NULL;
+}
+
+static void device_list_free(jrk_device ** list)
+{
+  for (size_t i = 0; list != NULL && list[i] != NULL; i++)
+  {
+    jrk_device_free(list[i]);
+  }
+  jrk_list_free(list);
+}
+
+// Checks that the simulated jrks requested with JRK2_SIMULATED_DEVICES, which
+// ctest sets, are only created once: every device list refers to the same
+// simulators.
+static void test_env_simulators(void)
+{
+  jrk_device ** list1 = NULL;
+  jrk_device ** list2 = NULL;
+  size_t count1 = 0, count2 = 0;
+  CHECK_OK(jrk_list_connected_devices(&list1, &count1));
+  CHECK_OK(jrk_list_connected_devices(&list2, &count2));
+  CHECK(count1 == count2);
+
+  jrk_device * device1 = device_with_serial_number(list1, "SIM00002");
+  jrk_device * device2 = device_with_serial_number(list2, "SIM00002");
+  if (CHECK(device1 != NULL && device2 != NULL))
+  {
+    CHECK(strcmp(jrk_device_get_os_id(device1),
+      jrk_device_get_os_id(device2)) == 0);
+
+    // A target sent through a handle from one list is seen through a handle
+    // from the other.
+    jrk_handle * handle1 = NULL;
+    jrk_handle * handle2 = NULL;
+    CHECK_OK(jrk_handle_open(device1, &handle1));
+    CHECK_OK(jrk_handle_open(device2, &handle2));
+    CHECK_OK(jrk_set_target(handle1, 1234));
+    jrk_variables * vars = NULL;
+    CHECK_OK(jrk_get_variables(handle2, &vars, 0));
+    CHECK(vars != NULL && jrk_variables_get_target(vars) == 1234);
+    jrk_variables_free(vars);
+    jrk_handle_close(handle2);
+    jrk_handle_close(handle1);
+  }
+
+  device_list_free(list2);
+  device_list_free(list1);
+}
+
+// Checks that jrk_set_eeprom_settings_delta() only writes the bytes that
+// changed and leaves the EEPROM holding the settings.
+static void test_settings_delta(void)
+{
+  test_device d;
+  if (!test_device_open(&d)) { test_device_close(&d); return; }
+
+  jrk_settings * settings = NULL;
+  CHECK_OK(jrk_get_eeprom_settings(d.handle, &settings));
+  if (settings == NULL) { test_device_close(&d); return; }
+
+  // Writing the settings that are already there does nothing.
+  size_t bytes_written = 99;
+  CHECK_OK(jrk_set_eeprom_settings_delta(d.handle, settings, &bytes_written));
+  CHECK(bytes_written == 0);
+
+  // Changing one two-byte setting writes at most two bytes.
+  jrk_settings_set_proportional_multiplier(settings, 300);
+  CHECK_OK(jrk_set_eeprom_settings_delta(d.handle, settings, &bytes_written));
+  CHECK(bytes_written >= 1 && bytes_written <= 2);
+
+  jrk_settings * read_settings = NULL;
+  CHECK_OK(jrk_get_eeprom_settings(d.handle, &read_settings));
+  CHECK(jrk_settings_get_proportional_multiplier(read_settings) == 300);
+  jrk_settings_free(read_settings);
+
+  jrk_settings_free(settings);
+  test_device_close(&d);
+}
+
+typedef struct progress_log
+{
+  uint32_t call_count;
+  uint32_t first_progress;
+  uint32_t last_progress;
+  uint32_t max_progress;
+  bool max_changed;
+} progress_log;
+
+static void log_progress(void * user_data, uint32_t progress,
+  uint32_t max_progress)
+{
+  progress_log * log = user_data;
+  if (log->call_count == 0)
+  {
+    log->first_progress = progress;
+  }
+  else if (max_progress != log->max_progress)
+  {
+    log->max_changed = true;
+  }
+  log->call_count++;
+  log->last_progress = progress;
+  log->max_progress = max_progress;
+}
+
+// Checks that jrk_apply_eeprom_settings() only writes the bytes that changed,
+// reports consistent progress, and leaves the EEPROM holding the settings.
+static void test_settings_apply(void)
+{
+  test_device d;
+  if (!test_device_open(&d)) { test_device_close(&d); return; }
+
+  jrk_settings * settings = NULL;
+  CHECK_OK(jrk_get_eeprom_settings(d.handle, &settings));
+  if (settings == NULL) { test_device_close(&d); return; }
+
+  // The progress has one step for the first read, one for each byte written,
+  // and one for the read that verifies them.
+  jrk_settings_set_proportional_multiplier(settings, 301);
+  jrk_settings_set_integral_multiplier(settings, 5);
+  progress_log log = { 0 };
+  size_t bytes_written = 0;
+  CHECK_OK(jrk_apply_eeprom_settings(d.handle, settings,
+    log_progress, &log, &bytes_written));
+  CHECK(bytes_written >= 2);
+  CHECK(log.first_progress == 1);
+  CHECK(log.last_progress == log.max_progress);
+  CHECK(log.max_progress == bytes_written + 2);
+  CHECK(log.call_count == bytes_written + 2);
+  CHECK(!log.max_changed);
+
+  jrk_settings * read_settings = NULL;
+  CHECK_OK(jrk_get_eeprom_settings(d.handle, &read_settings));
+  CHECK(jrk_settings_get_proportional_multiplier(read_settings) == 301);
+  CHECK(jrk_settings_get_integral_multiplier(read_settings) == 5);
+  jrk_settings_free(read_settings);
+
+  // Applying the same settings again only reads.
+  memset(&log, 0, sizeof(log));
+  CHECK_OK(jrk_apply_eeprom_settings(d.handle, settings,
+    log_progress, &log, &bytes_written));
+  CHECK(bytes_written == 0);
+  CHECK(log.max_progress == 2);
+
+  jrk_settings_free(settings);
+  test_device_close(&d);
+}
+
+// Checks that reading variables in several segments returns the same values
+// as reading all of them, and that the clearing flags work.
+static void test_masked_variables(void)
+{
+  test_device d;
+  if (!test_device_open(&d)) { test_device_close(&d); return; }
+
+  // The simulator starts with the "Awaiting command" error, which gets added
+  // to the "Error flags occurred" variable in each PID period until we set
+  // the target.
+  jrk_simulator_advance(d.simulator, 20);
+  CHECK_OK(jrk_set_target(d.handle, 3000));
+  jrk_simulator_advance(d.simulator, 50);
+
+  jrk_variables * all = NULL;
+  CHECK_OK(jrk_get_variables(d.handle, &all, 0));
+
+  // These variables are far enough apart to need three segments, with the
+  // error flags in the middle one.
+  uint64_t mask = (1ULL << JRK_VAR_FEEDBACK) |
+    (1ULL << JRK_VAR_ERROR_FLAGS_OCCURRED) | (1ULL << JRK_VAR_UP_TIME);
+  uint16_t clear = 1 << JRK_GET_VARIABLES_FLAG_CLEAR_ERROR_FLAGS_OCCURRED;
+
+  jrk_variables * some = NULL;
+  CHECK_OK(jrk_get_variables_masked(d.handle, &some, mask, clear));
+  CHECK(jrk_variables_get_feedback(some) == jrk_variables_get_feedback(all));
+  CHECK(jrk_variables_get_up_time(some) == jrk_variables_get_up_time(all));
+  CHECK(jrk_variables_get_error_flags_occurred(some) ==
+    jrk_variables_get_error_flags_occurred(all));
+  CHECK(jrk_variables_get_error_flags_occurred(some) != 0);
+  CHECK(jrk_variables_get_target(some) == 0);
+  CHECK(jrk_variables_get_duty_cycle(some) == 0);
+
+  // The flags were cleared, and no time has passed since then.
+  CHECK_OK(jrk_get_variables_into(d.handle, all, 0));
+  CHECK(jrk_variables_get_error_flags_occurred(all) == 0);
+
+  // Reading into an existing object only changes the selected variables.
+  jrk_simulator_advance(d.simulator, 10);
+  CHECK_OK(jrk_get_variables_masked_into(d.handle, all,
+    1ULL << JRK_VAR_UP_TIME, 0));
+  CHECK(jrk_variables_get_up_time(all) ==
+    jrk_variables_get_up_time(some) + 10);
+  CHECK(jrk_variables_get_error_flags_occurred(all) == 0);
+
+  jrk_variables_free(some);
+  jrk_variables_free(all);
+  test_device_close(&d);
+}
+
+// Checks that variables written to a recording can be read back, including
+// after seeking.
+static void test_recording_round_trip(void)
+{
+  test_device d;
+  if (!test_device_open(&d)) { test_device_close(&d); return; }
+
+  // Enough records to fill several blocks.
+  enum { record_count = 600 };
+  static uint8_t records[record_count][JRK_VARIABLES_SIZE];
+
+  const char * filename = "test_recording.tmp";
+  jrk_recorder * recorder = NULL;
+  CHECK_OK(jrk_recorder_create(filename, JRK_RECORDER_FLAG_COMPRESS,
+    &recorder));
+  if (recorder == NULL) { test_device_close(&d); return; }
+
+  CHECK_OK(jrk_set_target(d.handle, 2500));
+  for (size_t i = 0; i < record_count; i++)
+  {
+    jrk_simulator_advance(d.simulator, 1);
+    CHECK_OK(jrk_get_variable_segment(d.handle, 0, JRK_VARIABLES_SIZE,
+      records[i], 0));
+    CHECK_OK(jrk_recorder_write(recorder, records[i]));
+  }
+  CHECK_OK(jrk_recorder_finish(recorder));
+  jrk_recorder_free(recorder);
+
+  jrk_recording * recording = NULL;
+  CHECK_OK(jrk_recording_open(filename, &recording));
+  if (recording != NULL)
+  {
+    CHECK(jrk_recording_get_record_count(recording) == record_count);
+
+    size_t match_count = 0;
+    for (size_t i = 0; i < record_count; i++)
+    {
+      uint8_t buffer[JRK_VARIABLES_SIZE];
+      bool done = true;
+      CHECK_OK(jrk_recording_read_buffer(recording, buffer, &done));
+      if (!done && memcmp(buffer, records[i], JRK_VARIABLES_SIZE) == 0)
+      {
+        match_count++;
+      }
+    }
+    CHECK(match_count == record_count);
+
+    uint8_t buffer[JRK_VARIABLES_SIZE];
+    bool done = false;
+    CHECK_OK(jrk_recording_read_buffer(recording, buffer, &done));
+    CHECK(done);
+
+    // Seek to a record in the middle of a block by its up time.
+    size_t target = 300;
+    uint32_t up_time = records[target][JRK_VAR_UP_TIME] |
+      records[target][JRK_VAR_UP_TIME + 1] << 8 |
+      records[target][JRK_VAR_UP_TIME + 2] << 16 |
+      (uint32_t)records[target][JRK_VAR_UP_TIME + 3] << 24;
+    CHECK_OK(jrk_recording_seek_up_time(recording, up_time));
+    CHECK_OK(jrk_recording_read_buffer(recording, buffer, &done));
+    CHECK(!done && memcmp(buffer, records[target], JRK_VARIABLES_SIZE) == 0);
+
+    // Seek by record number and decode a record.
+    jrk_variables * vars = NULL;
+    CHECK_OK(jrk_variables_create(&vars));
+    CHECK_OK(jrk_recording_seek(recording, 257));
+    CHECK_OK(jrk_recording_read_variables(recording, vars, &done));
+    CHECK(!done);
+    const uint8_t * feedback = records[257] + JRK_VAR_FEEDBACK;
+    CHECK(jrk_variables_get_feedback(vars) == (feedback[0] | feedback[1] << 8));
+    jrk_variables_free(vars);
+
+    jrk_recording_close(recording);
+  }
+
+  remove(filename);
+  test_device_close(&d);
+}
+
+int main()
+{
+  test_env_simulators();
+  test_settings_delta();
+  test_settings_apply();
+  test_masked_variables();
+  test_recording_round_trip();
+  return test_result();
+}
@@ -0,0 +1,286 @@
+// Tests the header-only C++ classes that use threads: jrk::poller with a
+// jrk::history, jrk::batch_runner, jrk::control_loop, and jrk::async_handle.
+// They talk to simulated jrks that run in real time, since the classes have
+// their own threads and schedules.
+
+#include "test.h"
+
+#include <jrk_async.hpp>
+#include <jrk_batch.hpp>
+#include <jrk_control_loop.hpp>
+#include <jrk_history.hpp>
+#include <jrk_poller.hpp>
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock test_clock;
+
+// Waits for the condition to become true.  Returns false if it took too long.
+template <typename Condition>
+static bool wait_for(Condition condition)
+{
+  test_clock::time_point timeout = test_clock::now() +
+    std::chrono::seconds(5);
+  while (!condition())
+  {
+    if (test_clock::now() > timeout) { return false; }
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+  }
+  return true;
+}
+
+static jrk::simulator make_simulator(const std::string & serial_number)
+{
+  jrk::simulator simulator(JRK_PRODUCT_UMC04A_30V, serial_number);
+  simulator.set_real_time(true);
+  return simulator;
+}
+
+static uint16_t read_target(jrk::handle & handle)
+{
+  return handle.get_variables(0).get_target();
+}
+
+// Polls two simulated jrks with one worker each, keeping a history for each.
+static void test_poller_history()
+{
+  jrk::simulator simulator1 = make_simulator("00000001");
+  jrk::simulator simulator2 = make_simulator("00000002");
+  std::vector<jrk::device> devices = {
+    simulator1.get_device(), simulator2.get_device() };
+
+  jrk::poller_options options;
+  options.period = std::chrono::milliseconds(1);
+  options.history_capacity = 16;
+  jrk::poller poller(devices, options);
+  CHECK(poller.get_device_count() == 2);
+
+  for (size_t i = 0; i < poller.get_device_count(); i++)
+  {
+    const jrk::history * history = poller.get_history(i);
+    if (!CHECK(history != NULL)) { continue; }
+    CHECK(wait_for([&] { return history->get_count() >= 40; }));
+
+    jrk::poller_snapshot snapshot = poller.get_snapshot(i);
+    CHECK(snapshot.success());
+    CHECK(snapshot.variables.is_present());
+    CHECK(poller.get_sequence(i) >= snapshot.sequence);
+
+    // The history only keeps the newest samples, in order.
+    std::vector<jrk::history_sample> samples;
+    uint64_t next = history->get_since(0, samples);
+    CHECK(samples.size() <= 16);
+    CHECK(!samples.empty() && samples.back().index + 1 == next);
+    for (size_t j = 1; j < samples.size(); j++)
+    {
+      CHECK(samples[j].index > samples[j - 1].index);
+      CHECK(samples[j].get_up_time() >= samples[j - 1].get_up_time());
+    }
+
+    jrk::history_sample latest;
+    CHECK(history->get_latest(latest));
+    CHECK(latest.index + 1 >= next);
+
+    // Every sample in a range of up times is in that range.
+    if (samples.empty()) { continue; }
+    uint32_t begin = samples.front().get_up_time();
+    uint32_t end = samples.back().get_up_time();
+    std::vector<jrk::history_sample> range;
+    history->get_range(begin, end, range);
+    for (const jrk::history_sample & sample : range)
+    {
+      CHECK(sample.get_up_time() >= begin && sample.get_up_time() < end);
+    }
+  }
+}
+
+// Sends a short batch and checks that it runs on schedule, then cancels a long
+// one.
+static void test_batch_runner()
+{
+  jrk::simulator simulator = make_simulator("00000001");
+  jrk::handle handle(simulator.get_device());
+
+  std::vector<jrk::batch_command> commands = {
+    { jrk::batch_command_type::set_target, 1000,
+      std::chrono::microseconds(0) },
+    { jrk::batch_command_type::set_target, 2000,
+      std::chrono::microseconds(5000) },
+    { jrk::batch_command_type::set_target, 3000,
+      std::chrono::microseconds(5000) },
+  };
+
+  {
+    jrk::batch_runner runner(handle, commands);
+    const std::vector<jrk::batch_command_result> & results = runner.wait();
+    CHECK(runner.is_done());
+    CHECK(results.size() == commands.size());
+    for (size_t i = 0; i < results.size(); i++)
+    {
+      CHECK(results[i].success());
+      CHECK(results[i].get_lateness().count() >= 0);
+      if (i > 0)
+      {
+        CHECK(results[i].scheduled_time - results[i - 1].scheduled_time ==
+          std::chrono::microseconds(5000));
+      }
+    }
+  }
+  CHECK(read_target(handle) == 3000);
+
+  commands[1].delay = std::chrono::seconds(60);
+  {
+    // The runner has the handle to itself, so just give it time to send the
+    // first command.
+    jrk::batch_runner runner(handle, commands);
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    test_clock::time_point start = test_clock::now();
+    runner.cancel();
+    const std::vector<jrk::batch_command_result> & results = runner.wait();
+    CHECK(test_clock::now() - start < std::chrono::seconds(1));
+    CHECK(results[0].success());
+    CHECK(!results[1].sent && !results[2].sent);
+  }
+  CHECK(read_target(handle) == 1000);
+}
+
+// Runs a loop that sends the setpoint as the target.
+static void test_control_loop()
+{
+  jrk::simulator simulator = make_simulator("00000001");
+  jrk::handle handle(simulator.get_device());
+
+  jrk::control_loop_options options;
+  options.period = std::chrono::milliseconds(2);
+  options.output = jrk::control_output::target;
+  options.stop_motor_on_exit = false;
+
+  std::atomic<uint64_t> last_index { 0 };
+  jrk::control_loop loop(handle,
+    [&](const jrk::variables &, const jrk::control_tick & tick)
+    {
+      last_index = tick.index;
+      return tick.setpoint;
+    },
+    options);
+
+  loop.set_setpoint(1234);
+  CHECK(wait_for([&] { return loop.get_stats().ticks >= 20; }));
+  loop.stop();
+  CHECK(loop.is_done());
+  CHECK(!loop.get_last_error().is_present());
+
+  jrk::control_loop_stats stats = loop.get_stats();
+  CHECK(stats.errors == 0);
+  CHECK(stats.wake_jitter.total == stats.ticks);
+  CHECK(stats.latency.total == stats.ticks);
+  CHECK(last_index + 1 == stats.ticks);
+  CHECK(read_target(handle) == 1234);
+
+  // Stopping does not wait for the next tick.
+  options.period = std::chrono::seconds(60);
+  jrk::control_loop slow_loop(handle,
+    [](const jrk::variables &, const jrk::control_tick & tick)
+    {
+      return tick.setpoint;
+    },
+    options);
+  CHECK(wait_for([&] { return slow_loop.get_stats().ticks == 1; }));
+  test_clock::time_point start = test_clock::now();
+  slow_loop.stop();
+  CHECK(test_clock::now() - start < std::chrono::seconds(1));
+}
+
+// Sends requests to one simulator through two handles on different threads.
+static void test_shared_simulator()
+{
+  jrk::simulator simulator = make_simulator("00000001");
+  jrk::device device = simulator.get_device();
+
+  std::atomic<bool> failed { false };
+  auto worker = [&](uint16_t target)
+  {
+    try
+    {
+      jrk::handle handle(device);
+      uint8_t buffer[4];
+      for (int i = 0; i < 500; i++)
+      {
+        handle.set_target(target);
+        handle.get_variables(0);
+        handle.get_ram_setting_segment(JRK_SETTING_PROPORTIONAL_MULTIPLIER,
+          sizeof(buffer), buffer);
+      }
+    }
+    catch (const std::exception &)
+    {
+      failed = true;
+    }
+  };
+
+  std::thread thread1(worker, 1000);
+  std::thread thread2(worker, 3000);
+  thread1.join();
+  thread2.join();
+  CHECK(!failed);
+
+  jrk::handle handle(device);
+  uint16_t target = read_target(handle);
+  CHECK(target == 1000 || target == 3000);
+}
+
+// Queues commands and variable reads on an async handle.
+static void test_async_handle()
+{
+  jrk::simulator simulator = make_simulator("00000001");
+  jrk::async_handle async(jrk::handle(simulator.get_device()));
+
+  async.post([](jrk::handle & handle) { handle.set_target(777); });
+  uint32_t first = async.request_variables(0);
+  uint32_t second = async.request_variables(0);
+
+  std::atomic<uint16_t> callback_target { 0 };
+  async.request_variables(0, [&](jrk::async_variables_result & result)
+  {
+    if (result.success())
+    {
+      callback_target = result.variables.get_target();
+    }
+  });
+
+  async.wait_until_idle();
+  CHECK(async.get_pending_count() == 0);
+  CHECK(callback_target == 777);
+
+  jrk::async_variables_result result;
+  CHECK(async.try_get_variables(result));
+  CHECK(result.sequence == first && result.success());
+  CHECK(result.variables.is_present() &&
+    result.variables.get_target() == 777);
+  CHECK(async.try_get_variables(result));
+  CHECK(result.sequence == second && result.success());
+  CHECK(!async.try_get_variables(result));
+  CHECK(async.get_dropped_count() == 0);
+}
+
+int main()
+{
+  try
+  {
+    test_poller_history();
+    test_batch_runner();
+    test_control_loop();
+    test_shared_simulator();
+    test_async_handle();
+  }
+  catch (const std::exception & e)
+  {
+    fprintf(stderr, "Exception: %s\n", e.what());
+    test_failure_count++;
+  }
+  return test_result();
+}